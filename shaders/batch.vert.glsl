@@ -10,12 +10,18 @@ layout(std140, binding = 0) uniform CameraMats {
     vec2 resolution;
 } CAM;
 
+// Must match PackedVertex::TANGENT_BIAS
+#define TANGENT_BIAS (1.0 / 32767.0)
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 uv;
-layout(location = 2) in vec3 normal;
-layout(location = 3) in vec4 tangent;
+// Octahedral normal in xy, tangent in zw, see PackedVertex
+layout(location = 2) in vec4 normalTangent;
 
-layout(location = 4) in mat4 modelMatrix;
+// Top three rows of the model matrix
+layout(location = 4) in vec4 modelRow0;
+layout(location = 5) in vec4 modelRow1;
+layout(location = 6) in vec4 modelRow2;
 
 out Vertex {
   vec2 uv;
@@ -25,7 +31,25 @@ out Vertex {
   flat int drawID;
 } OUT;
 
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
 void main() {
+  mat4 modelMatrix = transpose(
+      mat4(modelRow0, modelRow1, modelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+
+  vec3 normal = octDecode(normalTangent.xy);
+  // Handedness is the sign of the second component, which was remapped
+  // away from zero
+  float handedness = normalTangent.w < 0.0 ? -1.0 : 1.0;
+  float tangentY =
+      (abs(normalTangent.w) - TANGENT_BIAS) / (1.0 - TANGENT_BIAS) * 2.0 - 1.0;
+  vec4 tangent = vec4(octDecode(vec2(normalTangent.z, tangentY)), handedness);
+
   vec4 local = vec4(position, 1.0);
 
   mat4 mvp = CAM.viewProj * modelMatrix;
@@ -7,7 +7,10 @@ layout(std140, binding = 5) uniform LightUniforms {
 } U;
 
 layout(location = 0) in vec3 position;
-layout(location = 4) in mat4 modelMatrix;
+// Top three rows of the model matrix
+layout(location = 4) in vec4 modelRow0;
+layout(location = 5) in vec4 modelRow1;
+layout(location = 6) in vec4 modelRow2;
 
 out Vertex {
     vec4 fragPos;
@@ -16,6 +19,9 @@ out Vertex {
 } OUT;
 
 void main() {
+  mat4 modelMatrix = transpose(
+      mat4(modelRow0, modelRow1, modelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+
   OUT.fragPos = modelMatrix * vec4(position, 1.0);
 
   OUT.lightPos = U.lightPos;
@@ -0,0 +1,102 @@
+#version 460 core
+
+// Must match ClusteredLighting::BIN_GROUP_SIZE
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// Must match ClusteredLighting
+#define TILES_X 16u
+#define TILES_Y 9u
+#define SLICES 24u
+#define MAX_CLUSTER_LIGHTS 64u
+
+layout(std140, binding = 0) uniform CameraMats {
+    mat4 view;
+    mat4 proj;
+    mat4 viewProj;
+    mat4 invView;
+    mat4 invProj;
+    mat4 invViewProj;
+    vec2 resolution;
+    vec2 uvRange;
+} CAM;
+
+// Matches LightData
+struct Light {
+  // World space position and radius
+  vec4 sphere;
+  vec4 color;
+  // Spot direction in xyz, w is 1 for spot lights
+  vec4 direction;
+  // Edge of each of the light's tiles in the shadow atlas, 0 for none
+  uint tileSize;
+  // Atlas origin of each tile as x | y << 16, one per cube face for point
+  // lights. Spot lights only use the first
+  uint tiles[6];
+  uint pad;
+  mat4 shadowMatrix;
+};
+
+layout(std430, binding = 1) readonly buffer Lights {
+  Light lights[];
+} LIGHTS;
+
+// Per cluster, the light count followed by up to MAX_CLUSTER_LIGHTS indices
+layout(std430, binding = 2) writeonly buffer Clusters {
+  uint entries[];
+} CLUSTERS;
+
+layout(location = 0) uniform uint firstLight;
+layout(location = 1) uniform uint lightCount;
+layout(location = 2) uniform float zNear;
+layout(location = 3) uniform float zFar;
+
+float sliceDepth(uint slice) {
+  return zNear * pow(zFar / zNear, float(slice) / float(SLICES));
+}
+
+void main() {
+  uint cluster = gl_GlobalInvocationID.x;
+  if (cluster >= TILES_X * TILES_Y * SLICES) {
+    return;
+  }
+
+  uint tileX = cluster % TILES_X;
+  uint tileY = (cluster / TILES_X) % TILES_Y;
+  uint slice = cluster / (TILES_X * TILES_Y);
+
+  // The tile's side planes in view space, from the projection's scale
+  // alone, so the depth convention does not matter
+  vec2 tiles = vec2(TILES_X, TILES_Y);
+  vec2 ndcMin = vec2(tileX, tileY) / tiles * 2.0 - 1.0;
+  vec2 ndcMax = vec2(tileX + 1, tileY + 1) / tiles * 2.0 - 1.0;
+  vec2 scale = vec2(CAM.proj[0][0], CAM.proj[1][1]);
+  float nearDepth = sliceDepth(slice);
+  float farDepth = sliceDepth(slice + 1);
+
+  vec2 a = ndcMin / scale;
+  vec2 b = ndcMax / scale;
+  vec3 boxMin = vec3(min(min(a * nearDepth, a * farDepth),
+                         min(b * nearDepth, b * farDepth)),
+                     -farDepth);
+  vec3 boxMax = vec3(max(max(a * nearDepth, a * farDepth),
+                         max(b * nearDepth, b * farDepth)),
+                     -nearDepth);
+
+  uint base = cluster * (MAX_CLUSTER_LIGHTS + 1);
+  uint count = 0;
+  for (uint i = firstLight; i < firstLight + lightCount; ++i) {
+    vec4 sphere = LIGHTS.lights[i].sphere;
+    vec3 center = (CAM.view * vec4(sphere.xyz, 1.0)).xyz;
+    vec3 closest = clamp(center, boxMin, boxMax);
+    vec3 offset = center - closest;
+    if (dot(offset, offset) > sphere.w * sphere.w) {
+      continue;
+    }
+
+    CLUSTERS.entries[base + 1 + count] = i;
+    if (++count == MAX_CLUSTER_LIGHTS) {
+      break;
+    }
+  }
+  CLUSTERS.entries[base] = count;
+}
@@ -0,0 +1,134 @@
+#version 460 core
+
+// Must match SkinningBatch::CULL_GROUP_SIZE
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// Must match SkinningBatch::Cull::Mode
+#define CULL_NONE 0
+#define CULL_CAMERA 1
+#define CULL_MATRIX 2
+#define CULL_SPHERE 3
+
+layout(std140, binding = 0) uniform CameraMats {
+    mat4 view;
+    mat4 proj;
+    mat4 viewProj;
+    mat4 invView;
+    mat4 invProj;
+    mat4 invViewProj;
+    vec2 resolution;
+} CAM;
+
+// Only rewritten when the instance moves
+struct Instance {
+  // World space bounding sphere
+  vec4 sphere;
+  // Views the instance is drawn in
+  uint mask;
+  uint pad0;
+  uint pad1;
+  uint pad2;
+};
+
+layout(std430, binding = 1) readonly buffer Instances {
+  Instance instances[];
+} IN;
+
+struct Transform {
+  vec4 rows[3];
+};
+
+layout(std430, binding = 2) readonly buffer InputTransforms {
+  Transform transforms[];
+} IN_TRANSFORMS;
+
+layout(std430, binding = 3) buffer Counters {
+  uint drawCount;
+  uint poseCounts[];
+} COUNTERS;
+
+layout(std430, binding = 4) writeonly buffer OutputTransforms {
+  Transform transforms[];
+} OUT_TRANSFORMS;
+
+// The frame's pose of each instance, the only per instance data that
+// changes as characters animate
+layout(std430, binding = 5) readonly buffer InstancePoses {
+  uint poses[];
+} INSTANCE_POSES;
+
+struct Pose {
+  // Where the pose's instances start in the output transforms
+  uint firstSlot;
+  uint firstLayer;
+  uint layerCount;
+  uint outputStart;
+};
+
+layout(std430, binding = 6) readonly buffer Poses {
+  Pose poses[];
+} POSES;
+
+// Set for every pose with a survivor in any view, so skinning can skip
+// the rest
+layout(std430, binding = 7) writeonly buffer VisiblePoses {
+  uint poses[];
+} VISIBLE;
+
+layout(location = 0) uniform uint instanceCount;
+layout(location = 1) uniform uint viewMask;
+layout(location = 2) uniform uint mode;
+layout(location = 3) uniform mat4 cullMatrix;
+layout(location = 4) uniform vec4 cullSphere;
+
+vec4 row(mat4 m, int i) {
+  return vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+}
+
+// Only the side planes are tested. Together they already reject anything
+// behind the eye, and they do not depend on the depth convention
+bool inFrustum(mat4 m, vec4 sphere) {
+  vec4 w = row(m, 3);
+  vec4 planes[4] = vec4[4](w + row(m, 0), w - row(m, 0), w + row(m, 1),
+                           w - row(m, 1));
+  for (int i = 0; i < 4; ++i) {
+    vec4 plane = planes[i] / length(planes[i].xyz);
+    if (dot(plane.xyz, sphere.xyz) + plane.w < -sphere.w) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool visible(vec4 sphere) {
+  switch (mode) {
+  case CULL_CAMERA:
+    return inFrustum(CAM.viewProj, sphere);
+  case CULL_MATRIX:
+    return inFrustum(cullMatrix, sphere);
+  case CULL_SPHERE:
+    return distance(sphere.xyz, cullSphere.xyz) < sphere.w + cullSphere.w;
+  default:
+    return true;
+  }
+}
+
+void main() {
+  uint slot = gl_GlobalInvocationID.x;
+  if (slot >= instanceCount) {
+    return;
+  }
+
+  Instance instance = IN.instances[slot];
+  if ((instance.mask & viewMask) == 0 || !visible(instance.sphere)) {
+    return;
+  }
+
+  // Survivors are compacted to the front of their pose's range, so one
+  // command per layer covers them
+  uint pose = INSTANCE_POSES.poses[slot];
+  uint index = atomicAdd(COUNTERS.poseCounts[pose], 1);
+  OUT_TRANSFORMS.transforms[POSES.poses[pose].firstSlot + index] =
+      IN_TRANSFORMS.transforms[slot];
+  VISIBLE.poses[pose] = 1;
+}
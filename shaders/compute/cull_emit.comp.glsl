@@ -0,0 +1,78 @@
+#version 460 core
+
+// Must match SkinningBatch::CULL_GROUP_SIZE
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+struct Pose {
+  uint firstSlot;
+  // Into the layer and texture tables
+  uint firstLayer;
+  uint layerCount;
+  // First vertex in the skinned vertex buffer
+  uint outputStart;
+};
+
+layout(std430, binding = 1) readonly buffer Poses {
+  Pose poses[];
+} POSES;
+
+// firstIndex, indexCount
+layout(std430, binding = 2) readonly buffer Layers {
+  uvec2 layers[];
+} LAYERS;
+
+struct TextureSet {
+  uvec2 diffuse;
+  uvec2 bump;
+  uvec2 material;
+};
+
+layout(std430, binding = 3) readonly buffer InputTextures {
+  TextureSet sets[];
+} IN_TEXTURES;
+
+layout(std430, binding = 4) buffer Counters {
+  uint drawCount;
+  uint poseCounts[];
+} COUNTERS;
+
+struct Command {
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int baseVertex;
+  uint baseInstance;
+};
+
+layout(std430, binding = 5) writeonly buffer Commands {
+  Command commands[];
+} COMMANDS;
+
+// Read by gl_DrawID in the batch fragment shader
+layout(std430, binding = 6) writeonly buffer OutputTextures {
+  TextureSet sets[];
+} OUT_TEXTURES;
+
+layout(location = 0) uniform uint poseCount;
+
+void main() {
+  uint p = gl_GlobalInvocationID.x;
+  if (p >= poseCount) {
+    return;
+  }
+
+  uint instances = COUNTERS.poseCounts[p];
+  if (instances == 0) {
+    return;
+  }
+
+  Pose pose = POSES.poses[p];
+  uint first = atomicAdd(COUNTERS.drawCount, pose.layerCount);
+  for (uint l = 0; l < pose.layerCount; ++l) {
+    uvec2 layer = LAYERS.layers[pose.firstLayer + l];
+    COMMANDS.commands[first + l] =
+        Command(layer.y, instances, layer.x, int(pose.outputStart),
+                pose.firstSlot);
+    OUT_TEXTURES.sets[first + l] = IN_TEXTURES.sets[pose.firstLayer + l];
+  }
+}
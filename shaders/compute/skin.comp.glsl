@@ -1,61 +1,204 @@
 #version 460 core
 
-layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+// Must match SkinningBatch::GROUP_SIZE
+layout(local_size_x = 128, local_size_y = 1, local_size_z = 1) in;
 
+// Joints of a larger skeleton are decoded for every vertex instead
+#define MAX_SHARED_JOINTS 128
+// Must match AnimationClip::FRAME_STEPS
+#define FRAME_STEPS 4
+
+// Matches PackedWeightedVertex. Position is split into floats so the
+// struct stays 4 byte aligned
 struct InVertex {
-  vec3 position;
-  vec2 uv;
-  vec3 normal;
-  vec4 tangent;
-  vec4 weights;
-  ivec4 weightIndices;
+  float px, py, pz;
+  uint uv;
+  uint normal;
+  uint tangent;
+  // unorm8 x4
+  uint weights;
+  // uint8 x4
+  uint joints;
 };
 
 layout(std430, binding = 1) readonly buffer InputVertices {
   InVertex vertices[];
 } IN;
 
+// Matches PackedVertex
 struct OutVertex {
-  vec3 position;
-  vec2 uv;
-  vec3 normal;
-  vec4 tangent;
+  float px, py, pz;
+  uint uv;
+  uint normal;
+  uint tangent;
 };
 
 layout(std430, binding = 2) buffer OutputVertices {
   OutVertex vertices[];
 } OUT;
 
-layout(std430, binding = 3) readonly buffer JointMats {
-    mat4 joints[];
-} JOINTS;
+// rotation.xy, rotation.zw as snorm16, translation.xy as unorm16, then
+// translation.z as unorm16 and scale as half
+layout(std430, binding = 3) readonly buffer JointKeys {
+  uvec4 keys[];
+} KEYS;
+
+struct Clip {
+  vec4 translationMin;
+  vec4 translationRange;
+  uint keyStart;
+  uint jointCount;
+  uint keyCount;
+  uint keyStride;
+};
+
+layout(std430, binding = 5) readonly buffer Clips {
+  Clip clips[];
+} CLIPS;
+
+struct Job {
+  uint inputStart;
+  uint clip;
+  uint jointCount;
+  // In 1 / FRAME_STEPS of a frame
+  uint frame;
+  uint outputStart;
+  uint vertexCount;
+  uint firstGroup;
+  // Index into the visibility flags
+  uint pose;
+};
+
+layout(std430, binding = 4) readonly buffer Jobs {
+  Job jobs[];
+} JOBS;
+
+// Written by the cull pass of every view this frame
+layout(std430, binding = 6) readonly buffer VisiblePoses {
+  uint poses[];
+} VISIBLE;
 
-layout(location = 0) uniform uvec4 uInfo;
-layout(location = 1) uniform uint frame;
+layout(location = 0) uniform uint groupCount;
+
+shared mat4 sharedJoints[MAX_SHARED_JOINTS];
+shared uint sharedJob;
+
+struct Transform {
+  vec4 rotation;
+  vec3 translation;
+  float scale;
+};
+
+Transform decode(uvec4 key, Clip clip) {
+  Transform t;
+  t.rotation = vec4(unpackSnorm2x16(key.x), unpackSnorm2x16(key.y));
+  vec3 normalized = vec3(unpackUnorm2x16(key.z), unpackUnorm2x16(key.w).x);
+  t.translation = clip.translationMin.xyz +
+                  normalized * clip.translationRange.xyz;
+  t.scale = unpackHalf2x16(key.w).y;
+  return t;
+}
+
+// Interpolates the joint between the two keys either side of the frame
+mat4 sampleJoint(Clip clip, uint frame, uint joint) {
+  float keyPosition = float(frame) / float(FRAME_STEPS * clip.keyStride);
+  uint first = uint(keyPosition) % clip.keyCount;
+  uint second = (first + 1) % clip.keyCount;
+  float t = fract(keyPosition);
+
+  Transform a = decode(KEYS.keys[clip.keyStart + first * clip.jointCount +
+                                  joint], clip);
+  Transform b = decode(KEYS.keys[clip.keyStart + second * clip.jointCount +
+                                  joint], clip);
+
+  // Keep to the shorter arc, then nlerp
+  vec4 to = dot(a.rotation, b.rotation) < 0.0 ? -b.rotation : b.rotation;
+  vec4 q = normalize(mix(a.rotation, to, t));
+  float scale = mix(a.scale, b.scale, t);
+
+  float x2 = q.x * q.x, y2 = q.y * q.y, z2 = q.z * q.z;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+  mat3 rotation = mat3(
+      1.0 - 2.0 * (y2 + z2), 2.0 * (xy + wz), 2.0 * (xz - wy),
+      2.0 * (xy - wz), 1.0 - 2.0 * (x2 + z2), 2.0 * (yz + wx),
+      2.0 * (xz + wy), 2.0 * (yz - wx), 1.0 - 2.0 * (x2 + y2));
+
+  mat4 m = mat4(rotation * scale);
+  m[3] = vec4(mix(a.translation, b.translation, t), 1.0);
+  return m;
+}
+
+mat4 joint(Clip clip, uint frame, int index, bool useShared) {
+  return useShared ? sharedJoints[index]
+                   : sampleJoint(clip, frame, uint(index));
+}
 
 void main() {
-  uint inVertexStart = uInfo.x;
-  uint jointStartOffset = uInfo.y;
-  uint jointCount = uInfo.z;
-  uint outVertexStart = uInfo.w;
+  uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+  // Padding groups from spilling into y
+  if (group >= groupCount) {
+    return;
+  }
 
-  uint vIndex = gl_GlobalInvocationID.x + inVertexStart;
-  uint vOutIndex = gl_GlobalInvocationID.x + outVertexStart;
+  // Jobs are sorted by firstGroup, so find the last one starting at or
+  // before this group
+  if (gl_LocalInvocationIndex == 0) {
+    uint lo = 0;
+    uint hi = uint(JOBS.jobs.length()) - 1;
+    while (lo < hi) {
+      uint mid = (lo + hi + 1) / 2;
+      if (JOBS.jobs[mid].firstGroup <= group) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    sharedJob = lo;
+  }
+  barrier();
+
+  Job job = JOBS.jobs[sharedJob];
+  // No view kept an instance of the pose. The job is the same for the whole
+  // group, so every invocation leaves before the next barrier
+  if (VISIBLE.poses[job.pose] == 0) {
+    return;
+  }
+
+  Clip clip = CLIPS.clips[job.clip];
+  bool useShared = job.jointCount <= MAX_SHARED_JOINTS;
+
+  // Every vertex in the group shares the pose, so each joint is decoded once
+  if (useShared && job.jointCount != 0) {
+    for (uint i = gl_LocalInvocationIndex; i < job.jointCount;
+         i += gl_WorkGroupSize.x) {
+      sharedJoints[i] = sampleJoint(clip, job.frame, i);
+    }
+  }
+  barrier();
+
+  uint vertex = (group - job.firstGroup) * gl_WorkGroupSize.x +
+                gl_LocalInvocationIndex;
+  if (vertex >= job.vertexCount) {
+    return;
+  }
+
+  uint vIndex = vertex + job.inputStart;
+  uint vOutIndex = vertex + job.outputStart;
 
   InVertex v = IN.vertices[vIndex];
 
-  vec4 local = vec4(v.position, 1.0);
+  vec4 local = vec4(v.px, v.py, v.pz, 1.0);
 
   vec4 skelPos = vec4(0.0);
 
-  if (jointCount != 0) {
-    uint frameIndex = (frame * jointCount) + jointStartOffset;
-
+  if (job.jointCount != 0) {
+    vec4 weights = unpackUnorm4x8(v.weights);
     for (int i = 0; i < 4; ++i) {
-      int jointIndex = v.weightIndices[i];
-      float weight = v.weights[i];
+      int jointIndex = int(bitfieldExtract(v.joints, i * 8, 8));
+      float weight = weights[i];
 
-      mat4 jointOne = JOINTS.joints[frameIndex + jointIndex];
+      mat4 jointOne = joint(clip, job.frame, jointIndex, useShared);
 
       skelPos += jointOne * local * weight;
     }
@@ -63,8 +206,7 @@ void main() {
     skelPos = local;
   }
 
-  OUT.vertices[vOutIndex].position = skelPos.xyz;
-  OUT.vertices[vOutIndex].uv = v.uv;
-  OUT.vertices[vOutIndex].normal = v.normal;
-  OUT.vertices[vOutIndex].tangent = v.tangent;
-}
\ No newline at end of file
+  // The rest is already packed the way the batch VAO reads it
+  OUT.vertices[vOutIndex] =
+      OutVertex(skelPos.x, skelPos.y, skelPos.z, v.uv, v.normal, v.tangent);
+}
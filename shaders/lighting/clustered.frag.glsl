@@ -0,0 +1,265 @@
+#version 460 core
+
+// Must match ClusteredLighting
+#define TILES_X 16u
+#define TILES_Y 9u
+#define SLICES 24u
+#define MAX_CLUSTER_LIGHTS 64u
+
+layout(std140, binding = 0) uniform CameraMats {
+    mat4 view;
+    mat4 proj;
+    mat4 viewProj;
+    mat4 invView;
+    mat4 invProj;
+    mat4 invViewProj;
+    vec2 resolution;
+    vec2 uvRange;
+} CAM;
+
+layout(binding = 0) uniform sampler2D diffuseTex;
+layout(binding = 1) uniform sampler2D normalTex;
+layout(binding = 2) uniform sampler2D materialTex;
+layout(binding = 3) uniform sampler2D depthTex;
+
+// Matches LightData
+struct Light {
+  // World space position and radius
+  vec4 sphere;
+  vec4 color;
+  // Spot direction in xyz, w is 1 for spot lights
+  vec4 direction;
+  // Edge of each of the light's tiles in the shadow atlas, 0 for none
+  uint tileSize;
+  // Atlas origin of each tile as x | y << 16, one per cube face for point
+  // lights. Spot lights only use the first
+  uint tiles[6];
+  uint pad;
+  mat4 shadowMatrix;
+};
+
+layout(std430, binding = 1) readonly buffer Lights {
+  Light lights[];
+} LIGHTS;
+
+layout(std430, binding = 2) readonly buffer Clusters {
+  uint entries[];
+} CLUSTERS;
+
+layout(binding = 5) uniform sampler2D shadowAtlas;
+
+// Cube faces in the order PointLight renders them, with the up vector each
+// face's view was built with
+const vec3 FACE_DIRS[6] = vec3[](
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0));
+const vec3 FACE_UPS[6] = vec3[](
+    vec3(0.0, -1.0, 0.0), vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, -1.0),
+    vec3(0.0, 0.0, -1.0), vec3(0.0, -1.0, 0.0), vec3(0.0, -1.0, 0.0));
+
+layout(location = 0) uniform float zNear;
+layout(location = 1) uniform float zFar;
+
+const float PI = 3.14159265359;
+const float SHADOW_BIAS = 0.05;
+
+layout(location = 0) out vec4 diffuseOut;
+layout(location = 1) out vec4 specularOut;
+
+// Reads a light's tile at uv across it, never past its edges into the next
+float sampleTile(uint size, uint origin, vec2 uv) {
+  vec2 corner = vec2(origin & 0xffffu, origin >> 16);
+  vec2 texel = clamp(uv * float(size), vec2(0.5), vec2(float(size) - 0.5));
+  vec2 atlasSize = vec2(textureSize(shadowAtlas, 0));
+  return texture(shadowAtlas, (corner + texel) / atlasSize).r;
+}
+
+// The cube face v points through and where on it, projected the same way as
+// the face's 90 degree view
+uint cubeFace(vec3 v, out vec2 uv) {
+  vec3 a = abs(v);
+  uint face = a.x >= a.y && a.x >= a.z ? (v.x > 0.0 ? 0u : 1u)
+              : a.y >= a.z             ? (v.y > 0.0 ? 2u : 3u)
+                                       : (v.z > 0.0 ? 4u : 5u);
+  vec3 forward = FACE_DIRS[face];
+  vec3 side = normalize(cross(forward, FACE_UPS[face]));
+  vec3 up = cross(side, forward);
+  uv = vec2(dot(side, v), dot(up, v)) / dot(forward, v) * 0.5 + 0.5;
+  return face;
+}
+
+// Tiles hold 1 - distance / radius, the same as the volume passes
+float pointOcclusion(Light light, vec3 fragPos) {
+  if (light.tileSize == 0u) {
+    return 1.0;
+  }
+  vec3 worldToLight = fragPos - light.sphere.xyz;
+  vec2 uv;
+  uint origin = light.tiles[cubeFace(worldToLight, uv)];
+
+  float offset = 1.0 / float(light.tileSize);
+  float depth = sampleTile(light.tileSize, origin, uv);
+  depth += sampleTile(light.tileSize, origin, uv + vec2(offset, 0.0));
+  depth += sampleTile(light.tileSize, origin, uv + vec2(-offset, 0.0));
+  depth += sampleTile(light.tileSize, origin, uv + vec2(0.0, offset));
+  depth += sampleTile(light.tileSize, origin, uv + vec2(0.0, -offset));
+  depth = (1.0 - depth / 5.0) * light.sphere.w;
+
+  return length(worldToLight) - SHADOW_BIAS > depth ? 0.0 : 1.0;
+}
+
+float spotOcclusion(Light light, vec3 fragPos) {
+  if (light.tileSize == 0u) {
+    return 1.0;
+  }
+  vec4 clip = light.shadowMatrix * vec4(fragPos, 1.0);
+  if (clip.w <= 0.0) {
+    return 1.0;
+  }
+  vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+  if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) {
+    return 1.0;
+  }
+
+  float depth = sampleTile(light.tileSize, light.tiles[0], uv);
+  depth = (1.0 - depth) * light.sphere.w;
+  float current = length(fragPos - light.sphere.xyz);
+  return current - SHADOW_BIAS > depth ? 0.0 : 1.0;
+}
+
+float DistributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a      = roughness*roughness;
+    float a2     = a*a;
+    float NdotH  = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH*NdotH;
+
+    float num   = a2;
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+
+    return num / denom;
+}
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r*r) / 8.0;
+
+    float num   = NdotV;
+    float denom = NdotV * (1.0 - k) + k;
+
+    return num / denom;
+}
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx2  = GeometrySchlickGGX(NdotV, roughness);
+    float ggx1  = GeometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+
+void main() {
+  vec2 uv;
+  uv.y = gl_FragCoord.y / CAM.resolution.y;
+
+  float uvRange = CAM.uvRange.y - CAM.uvRange.x;
+
+  float windowX = CAM.resolution.x / uvRange;
+
+  float fragPercentage = gl_FragCoord.x / windowX;
+
+  uv.x = fragPercentage;
+
+  // UV coord of this fragment relative to the viewport, not the window
+  float viewportX = (fragPercentage - CAM.uvRange.x) / uvRange;
+
+  diffuseOut = vec4(0.0, 0.0, 0.0, 1.0);
+  specularOut = vec4(0.0, 0.0, 0.0, 1.0);
+
+  // Depth is cleared to 0, so nothing was drawn here
+  float depth = texture(depthTex, uv).r;
+  if (depth == 0.0) {
+    return;
+  }
+
+  vec3 ndc = vec3(vec2(viewportX, uv.y), depth) * 2.0 - 1.0;
+  vec4 invClip = CAM.invViewProj * vec4(ndc, 1.0);
+  vec3 world = invClip.xyz / invClip.w;
+
+  // Clusters are laid out over the viewport, so follow the split
+  float viewDepth = -(CAM.view * vec4(world, 1.0)).z;
+  uint tileX = min(uint(viewportX * float(TILES_X)), TILES_X - 1u);
+  uint tileY = min(uint(uv.y * float(TILES_Y)), TILES_Y - 1u);
+  uint slice = uint(clamp(log(viewDepth / zNear) / log(zFar / zNear) *
+                              float(SLICES),
+                          0.0, float(SLICES - 1u)));
+  uint cluster = (slice * TILES_Y + tileY) * TILES_X + tileX;
+  uint base = cluster * (MAX_CLUSTER_LIGHTS + 1);
+  uint count = CLUSTERS.entries[base];
+
+  vec4 aSample = texture(diffuseTex, uv);
+  vec3 albedo = pow(aSample.rgb, vec3(2.2)) * aSample.a;
+  vec4 material = texture(materialTex, uv);
+  float metallic = material.g;
+  float roughness = material.b;
+
+  vec3 F0 = vec3(0.04);
+  F0 = mix(F0, albedo.rgb, metallic);
+
+  vec3 camPos = CAM.invView[3].xyz;
+  vec3 normal = normalize(texture(normalTex, uv).xyz);
+  vec3 viewDir = normalize(camPos - world);
+
+  // The G-buffer is read once, however many lights touch the pixel
+  for (uint i = 0; i < count; ++i) {
+    Light light = LIGHTS.lights[CLUSTERS.entries[base + 1 + i]];
+
+    float dist = length(light.sphere.xyz - world);
+    float atten = 1.0 - clamp(dist / light.sphere.w, 0.0, 1.0);
+
+    vec3 incident = normalize(light.sphere.xyz - world);
+    bool spot = light.direction.w != 0.0;
+    if (spot) {
+      float theta = dot(incident, normalize(light.direction.xyz));
+      float epsilon = 0.75;
+      atten *= clamp((theta - epsilon) / (1.0 - epsilon), 0.0, 1.0);
+    }
+    if (atten == 0.0) {
+      continue;
+    }
+
+    vec3 halfDir = normalize(incident + viewDir);
+    vec3 radiance = light.color.rgb * light.color.a * atten;
+
+    float NDF = DistributionGGX(normal, halfDir, roughness);
+    float G = GeometrySmith(normal, viewDir, incident, roughness);
+    vec3 F = fresnelSchlick(max(dot(halfDir, viewDir), 0.0), F0);
+
+    vec3 kD = vec3(1.0) - F;
+    kD *= 1.0 - metallic;
+
+    vec3 numerator = NDF * G * F;
+    float denominator = 4.0 * max(dot(normal, viewDir), 0.0) *
+                        max(dot(normal, incident), 0.0) + 0.001;
+    vec3 specular = numerator / denominator;
+
+    float NdotL = clamp(dot(normal, incident), 0.0, 1.0);
+    if (NdotL == 0.0) {
+      continue;
+    }
+
+    radiance *= spot ? spotOcclusion(light, world)
+                     : pointOcclusion(light, world);
+
+    specularOut.rgb += specular * radiance * NdotL;
+    diffuseOut.rgb += kD * (albedo.rgb / PI + specular) * NdotL * radiance;
+  }
+}
@@ -0,0 +1,5 @@
+#version 460 core
+
+// Only whether any sample passed the depth test is wanted, see
+// LightVisibility, so nothing is written
+void main() {}
@@ -16,17 +16,38 @@ out Vertex {
     flat float radius;
 } OUT;
 
+// Whether all three corners are outside the same side of a face's frustum, or
+// behind the light, so the triangle cannot land in that face
+bool outsideFace(vec4 a, vec4 b, vec4 c) {
+  vec3 x = vec3(a.x, b.x, c.x);
+  vec3 y = vec3(a.y, b.y, c.y);
+  vec3 w = vec3(a.w, b.w, c.w);
+  return all(lessThan(x, -w)) || all(greaterThan(x, w)) ||
+         all(lessThan(y, -w)) || all(greaterThan(y, w)) ||
+         all(lessThanEqual(w, vec3(0.0)));
+}
+
 void main() {
+  // Each face has its own viewport onto the light's tiles in the atlas
   for (int face = 0; face < 6; ++face) {
-    gl_Layer = face;
+    vec4 clip[3];
+    for (int vertex = 0; vertex < 3; ++vertex) {
+      clip[vertex] = U.shadowMatrix[face] * gl_in[vertex].gl_Position;
+    }
+    // Most triangles only touch one or two faces, so the rest are never
+    // sent on to be clipped away
+    if (outsideFace(clip[0], clip[1], clip[2])) {
+      continue;
+    }
 
+    gl_ViewportIndex = face;
     for (int vertex = 0; vertex < 3; ++vertex) {
       OUT.fragPos = gl_in[vertex].gl_Position;
       OUT.lightPos = U.lightPos;
       OUT.radius = U.radius;
-      gl_Position = U.shadowMatrix[face] * OUT.fragPos;
+      gl_Position = clip[vertex];
       EmitVertex();
     }
     EndPrimitive();
   }
-}
\ No newline at end of file
+}
@@ -15,34 +15,90 @@ layout(binding = 0) uniform sampler2D diffuseTex;
 layout(binding = 1) uniform sampler2D normalTex;
 layout(binding = 2) uniform sampler2D materialTex;
 layout(binding = 3) uniform sampler2D depthTex;
-layout(binding = 4) uniform samplerCube shadowMap;
+
+// Matches LightData
+struct Light {
+  // World space position and radius
+  vec4 sphere;
+  vec4 color;
+  // Spot direction in xyz, w is 1 for spot lights
+  vec4 direction;
+  // Edge of each of the light's tiles in the shadow atlas, 0 for none
+  uint tileSize;
+  // Atlas origin of each tile as x | y << 16, one per cube face for point
+  // lights. Spot lights only use the first
+  uint tiles[6];
+  uint pad;
+  mat4 shadowMatrix;
+};
+
+layout(std430, binding = 1) readonly buffer Lights {
+  Light lights[];
+} LIGHTS;
+
+layout(binding = 5) uniform sampler2D shadowAtlas;
+
+// Cube faces in the order PointLight renders them, with the up vector each
+// face's view was built with
+const vec3 FACE_DIRS[6] = vec3[](
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0));
+const vec3 FACE_UPS[6] = vec3[](
+    vec3(0.0, -1.0, 0.0), vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, -1.0),
+    vec3(0.0, 0.0, -1.0), vec3(0.0, -1.0, 0.0), vec3(0.0, -1.0, 0.0));
 
 layout(location = 3) uniform uint fullbright = 0;
 
 const float PI = 3.14159265359;
 
 in Vertex {
-  vec3 lightPos;
-  float lightRadius;
-  vec4 lightColor;
+  flat uint light;
 } IN;
 
 layout(location = 0) out vec4 diffuseOut;
 layout(location = 1) out vec4 specularOut;
 
-float calculateOcclusion(vec3 fragPos) {
-  vec3 worldToLight = fragPos - IN.lightPos;
-  float depthCenter = texture(shadowMap, worldToLight).r;
+// Reads a light's tile at uv across it, never past its edges into the next
+float sampleTile(uint size, uint origin, vec2 uv) {
+  vec2 corner = vec2(origin & 0xffffu, origin >> 16);
+  vec2 texel = clamp(uv * float(size), vec2(0.5), vec2(float(size) - 0.5));
+  vec2 atlasSize = vec2(textureSize(shadowAtlas, 0));
+  return texture(shadowAtlas, (corner + texel) / atlasSize).r;
+}
+
+// The cube face v points through and where on it, projected the same way as
+// the face's 90 degree view
+uint cubeFace(vec3 v, out vec2 uv) {
+  vec3 a = abs(v);
+  uint face = a.x >= a.y && a.x >= a.z ? (v.x > 0.0 ? 0u : 1u)
+              : a.y >= a.z             ? (v.y > 0.0 ? 2u : 3u)
+                                       : (v.z > 0.0 ? 4u : 5u);
+  vec3 forward = FACE_DIRS[face];
+  vec3 side = normalize(cross(forward, FACE_UPS[face]));
+  vec3 up = cross(side, forward);
+  uv = vec2(dot(side, v), dot(up, v)) / dot(forward, v) * 0.5 + 0.5;
+  return face;
+}
+
+float calculateOcclusion(Light light, vec3 fragPos) {
+  if (light.tileSize == 0u) {
+    return 1.0;
+  }
+  vec3 worldToLight = fragPos - light.sphere.xyz;
+  vec2 uv;
+  uint origin = light.tiles[cubeFace(worldToLight, uv)];
 
-  float offset = 1.0f / 4096.0f; // assuming 2048x2048 shadow map resolution
+  // One texel of the light's tile
+  float offset = 1.0 / float(light.tileSize);
 
-  float depthRight = texture(shadowMap, worldToLight + vec3(offset, 0.0, 0.0)).r;
-  float depthLeft = texture(shadowMap, worldToLight + vec3(-offset, 0.0, 0.0)).r;
-  float depthUp = texture(shadowMap, worldToLight + vec3(0.0, offset, 0.0)).r;
-  float depthDown =  texture(shadowMap, worldToLight + vec3(0.0, -offset, 0.0)).r;
+  float depthCenter = sampleTile(light.tileSize, origin, uv);
+  float depthRight = sampleTile(light.tileSize, origin, uv + vec2(offset, 0.0));
+  float depthLeft = sampleTile(light.tileSize, origin, uv + vec2(-offset, 0.0));
+  float depthUp = sampleTile(light.tileSize, origin, uv + vec2(0.0, offset));
+  float depthDown = sampleTile(light.tileSize, origin, uv + vec2(0.0, -offset));
   float depth = 1.0 - (depthCenter + depthRight + depthLeft + depthUp + depthDown) / 5.0;
 
-  depth *= IN.lightRadius;
+  depth *= light.sphere.w;
 
   float currentDepth = length(worldToLight);
 
@@ -91,8 +147,10 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
 }
 
 void main() {
+  Light light = LIGHTS.lights[IN.light];
+
   if (fullbright != 0) {
-    diffuseOut = vec4(IN.lightColor.rbg * IN.lightColor.a, 1.0);
+    diffuseOut = vec4(light.color.rbg * light.color.a, 1.0);
     specularOut = vec4(0.0);
     return;
   }
@@ -116,9 +174,9 @@ void main() {
   vec4 invClip = CAM.invViewProj * vec4(ndc, 1.0);
   vec3 world = invClip.xyz / invClip.w;
 
-  float dist = length(IN.lightPos - world);
+  float dist = length(light.sphere.xyz - world);
 
-  float atten = 1.0 - clamp(dist / IN.lightRadius, 0.0, 1.0);
+  float atten = 1.0 - clamp(dist / light.sphere.w, 0.0, 1.0);
 
   if (atten == 0.0) {
       discard;
@@ -138,11 +196,11 @@ void main() {
 
   vec3 normal = normalize(texture(normalTex, uv).xyz);
 
-  vec3 incident = normalize(IN.lightPos - world);
+  vec3 incident = normalize(light.sphere.xyz - world);
   vec3 viewDir = normalize(camPos - world);
   vec3 halfDir = normalize(incident + viewDir);
 
-  vec3 radiance = IN.lightColor.rgb * IN.lightColor.a;
+  vec3 radiance = light.color.rgb * light.color.a;
   radiance *= atten;
 
   float NDF = DistributionGGX(normal, halfDir, roughness);
@@ -159,7 +217,7 @@ void main() {
 
   float NdotL = clamp(dot(normal, incident), 0.0, 1.0);
   
-  float shadowOcclusion = calculateOcclusion(world);
+  float shadowOcclusion = calculateOcclusion(light, world);
   radiance *= shadowOcclusion;
 
   specularOut = vec4(specular * radiance * NdotL, 1.0);
@@ -11,26 +11,40 @@ layout(std140, binding = 0) uniform CameraMats {
     vec2 uvRange;
 } CAM;
 
-layout(location = 0) uniform vec3 lightPos;
-layout(location = 1) uniform float lightRadius;
-layout(location = 2) uniform vec4 lightColor;
+// Matches LightData
+struct Light {
+  // World space position and radius
+  vec4 sphere;
+  vec4 color;
+  // Spot direction in xyz, w is 1 for spot lights
+  vec4 direction;
+  // Edge of each of the light's tiles in the shadow atlas, 0 for none
+  uint tileSize;
+  // Atlas origin of each tile as x | y << 16, one per cube face for point
+  // lights. Spot lights only use the first
+  uint tiles[6];
+  uint pad;
+  mat4 shadowMatrix;
+};
+
+layout(std430, binding = 1) readonly buffer Lights {
+  Light lights[];
+} LIGHTS;
 
 layout(location = 0) in vec3 position;
 
 out Vertex {
-  vec3 lightPos;
-  float lightRadius;
-  vec4 lightColor;
+  flat uint light;
 } OUT;
 
 void main() {
-    vec3 scale = vec3(lightRadius);
-    vec3 worldPos = (position * scale) + lightPos;
+    // Each instance is one light, starting from the draw's base instance
+    uint index = gl_BaseInstance + gl_InstanceID;
+    vec4 sphere = LIGHTS.lights[index].sphere;
+    vec3 worldPos = (position * sphere.w) + sphere.xyz;
 
     gl_Position = CAM.viewProj * vec4(worldPos, 1.0);
 
-    OUT.lightPos = lightPos;
-    OUT.lightRadius = lightRadius;
-    OUT.lightColor = lightColor;
+    OUT.light = index;
 }
 
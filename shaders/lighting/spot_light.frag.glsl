@@ -15,35 +15,64 @@ layout(binding = 0) uniform sampler2D diffuseTex;
 layout(binding = 1) uniform sampler2D normalTex;
 layout(binding = 2) uniform sampler2D materialTex;
 layout(binding = 3) uniform sampler2D depthTex;
-layout(binding = 4) uniform samplerCube shadowMap;
+
+// Matches LightData
+struct Light {
+  // World space position and radius
+  vec4 sphere;
+  vec4 color;
+  // Spot direction in xyz, w is 1 for spot lights
+  vec4 direction;
+  // Edge of each of the light's tiles in the shadow atlas, 0 for none
+  uint tileSize;
+  // Atlas origin of each tile as x | y << 16, one per cube face for point
+  // lights. Spot lights only use the first
+  uint tiles[6];
+  uint pad;
+  mat4 shadowMatrix;
+};
+
+layout(std430, binding = 1) readonly buffer Lights {
+  Light lights[];
+} LIGHTS;
+
+layout(binding = 5) uniform sampler2D shadowAtlas;
 
 const float PI = 3.14159265359;
 
 in Vertex {
-  vec3 lightPos;
-  float lightRadius;
-  vec4 lightColor;
-  vec3 lightDirection;
+  flat uint light;
 } IN;
 
 layout(location = 0) out vec4 diffuseOut;
 layout(location = 1) out vec4 specularOut;
 
-float calculateOcclusion(vec3 fragPos) {
-  vec3 worldToLight = fragPos - IN.lightPos;
-  float depthCenter = texture(shadowMap, worldToLight).r;
-
-  float offset = 1.0f / 4096.0f; // assuming 2048x2048 shadow map resolution
+// Reads a light's tile at uv across it, never past its edges into the next
+float sampleTile(uint size, uint origin, vec2 uv) {
+  vec2 corner = vec2(origin & 0xffffu, origin >> 16);
+  vec2 texel = clamp(uv * float(size), vec2(0.5), vec2(float(size) - 0.5));
+  vec2 atlasSize = vec2(textureSize(shadowAtlas, 0));
+  return texture(shadowAtlas, (corner + texel) / atlasSize).r;
+}
 
-  float depthRight = texture(shadowMap, worldToLight + vec3(offset, 0.0, 0.0)).r;
-  float depthLeft = texture(shadowMap, worldToLight + vec3(-offset, 0.0, 0.0)).r;
-  float depthUp = texture(shadowMap, worldToLight + vec3(0.0, offset, 0.0)).r;
-  float depthDown =  texture(shadowMap, worldToLight + vec3(0.0, -offset, 0.0)).r;
-  float depth = 1.0 - (depthCenter + depthRight + depthLeft + depthUp + depthDown) / 5.0;
+// The tile holds 1 - distance / radius, projected through the light's matrix
+float calculateOcclusion(Light light, vec3 fragPos) {
+  if (light.tileSize == 0u) {
+    return 1.0;
+  }
+  vec4 clip = light.shadowMatrix * vec4(fragPos, 1.0);
+  if (clip.w <= 0.0) {
+    return 1.0;
+  }
+  vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+  if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) {
+    return 1.0;
+  }
 
-  depth *= IN.lightRadius;
+  float depth = sampleTile(light.tileSize, light.tiles[0], uv);
+  depth = (1.0 - depth) * light.sphere.w;
 
-  float currentDepth = length(worldToLight);
+  float currentDepth = length(fragPos - light.sphere.xyz);
 
   float bias = 0.05;
   float shadow = currentDepth - bias > depth ? 0.0 : 1.0;
@@ -90,6 +119,8 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
 }
 
 void main() {
+  Light light = LIGHTS.lights[IN.light];
+
   vec2 uv;
   uv.y = gl_FragCoord.y / CAM.resolution.y;
 
@@ -109,13 +140,13 @@ void main() {
   vec4 invClip = CAM.invViewProj * vec4(ndc, 1.0);
   vec3 world = invClip.xyz / invClip.w;
 
-  float dist = length(IN.lightPos - world);
+  float dist = length(light.sphere.xyz - world);
 
-  float distAtten = 1.0 - clamp(dist / IN.lightRadius, 0.0, 1.0);
+  float distAtten = 1.0 - clamp(dist / light.sphere.w, 0.0, 1.0);
 
-  vec3 incident = normalize(IN.lightPos - world);
+  vec3 incident = normalize(light.sphere.xyz - world);
 
-  float theta = dot(incident, normalize(IN.lightDirection));
+  float theta = dot(incident, normalize(light.direction.xyz));
   float epsilon = 0.75;
   float spotAtten = clamp((theta - epsilon) / (1.0 - epsilon), 0.0, 1.0);
   
@@ -142,7 +173,7 @@ void main() {
   vec3 viewDir = normalize(camPos - world);
   vec3 halfDir = normalize(incident + viewDir);
 
-  vec3 radiance = IN.lightColor.rgb * IN.lightColor.a;
+  vec3 radiance = light.color.rgb * light.color.a;
   radiance *= atten;
 
   float NDF = DistributionGGX(normal, halfDir, roughness);
@@ -159,7 +190,7 @@ void main() {
 
   float NdotL = clamp(dot(normal, incident), 0.0, 1.0);
   
-  float shadowOcclusion = calculateOcclusion(world);
+  float shadowOcclusion = calculateOcclusion(light, world);
   radiance *= shadowOcclusion;
 
   specularOut = vec4(specular * radiance * NdotL, 1.0);
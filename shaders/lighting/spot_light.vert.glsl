@@ -11,29 +11,45 @@ layout(std140, binding = 0) uniform CameraMats {
     vec2 uvRange;
 } CAM;
 
-layout(location = 0) uniform vec3 lightPos;
-layout(location = 1) uniform float lightRadius;
-layout(location = 2) uniform vec4 lightColor;
-layout(location = 3) uniform vec3 lightDirection;
-layout(location = 4) uniform mat4 modelMatrix;
+// Matches LightData
+struct Light {
+  // World space position and radius
+  vec4 sphere;
+  vec4 color;
+  // Spot direction in xyz, w is 1 for spot lights
+  vec4 direction;
+  // Edge of each of the light's tiles in the shadow atlas, 0 for none
+  uint tileSize;
+  // Atlas origin of each tile as x | y << 16, one per cube face for point
+  // lights. Spot lights only use the first
+  uint tiles[6];
+  uint pad;
+  mat4 shadowMatrix;
+};
+
+layout(std430, binding = 1) readonly buffer Lights {
+  Light lights[];
+} LIGHTS;
 
 layout(location = 0) in vec3 position;
 
 out Vertex {
-  vec3 lightPos;
-  float lightRadius;
-  vec4 lightColor;
-  vec3 lightDirection;
+  flat uint light;
 } OUT;
 
 void main() {
-    vec3 worldPos = (modelMatrix * vec4(position, 1.0)).xyz;
+    // Each instance is one light, starting from the draw's base instance
+    uint index = gl_BaseInstance + gl_InstanceID;
+    Light light = LIGHTS.lights[index];
+
+    // Same basis as SpotLight::modelMatrix, with the cone along direction
+    vec3 forward = light.direction.xyz;
+    vec3 right = normalize(cross(vec3(0.0, 1.0, 0.0), forward));
+    vec3 up = cross(forward, right);
+    vec3 worldPos = light.sphere.xyz +
+                    mat3(right, up, forward) * (position * light.sphere.w);
 
     gl_Position = CAM.viewProj * vec4(worldPos, 1.0);
 
-    OUT.lightPos = lightPos;
-    OUT.lightRadius = lightRadius;
-    OUT.lightColor = lightColor;
-    OUT.lightDirection = lightDirection;
+    OUT.light = index;
 }
-
@@ -36,7 +36,9 @@ void main() {
 
   vec3 normal = IN.normal;
   if (isTextureValid(tex.bump)) {
-    vec3 bump = texture(sampler2D(tex.bump), IN.uv).xyz * 2.0 - 1.0;
+    // Normal maps are BC5, which only keeps x and y
+    vec2 xy = texture(sampler2D(tex.bump), IN.uv).xy * 2.0 - 1.0;
+    vec3 bump = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
 
     mat3 TBN = mat3(normalize(IN.tangent), normalize(IN.binormal), normalize(IN.normal));
 
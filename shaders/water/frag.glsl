@@ -30,7 +30,9 @@ void main() {
 
   vec2 bumpOffset = vec2(CAM.time * 0.05, CAM.time * 0.0125);
 
-  vec3 bump = texture(waterBump, IN.uv + bumpOffset).rgb * 2.0 - 1.0;
+  // BC5, so only x and y are stored
+  vec2 xy = texture(waterBump, IN.uv + bumpOffset).xy * 2.0 - 1.0;
+  vec3 bump = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
 
   vec3 tangent = vec3(1.0, 0.0, 0.0);
   vec3 binormal = vec3(0.0, 0.0, 1.0);
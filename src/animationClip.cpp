@@ -0,0 +1,207 @@
+#include "animationClip.hpp"
+
+#include "logger/logger.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <limits>
+#include <optional>
+
+namespace {
+  struct Transform {
+    glm::quat rotation;
+    glm::vec3 translation;
+    float scale;
+  };
+
+  // Keys only hold a uniform scale, so joints scaling each axis by more than
+  // tolerance apart, or mirroring, come out wrong
+  std::optional<std::string> scaleProblem(const glm::mat4& m,
+                                          float tolerance) {
+    glm::vec3 lengths(glm::length(glm::vec3(m[0])),
+                      glm::length(glm::vec3(m[1])),
+                      glm::length(glm::vec3(m[2])));
+    float spread = std::max({lengths.x, lengths.y, lengths.z}) -
+                   std::min({lengths.x, lengths.y, lengths.z});
+    if (spread > tolerance) {
+      return fmt::format("non uniform scale ({}, {}, {})", lengths.x,
+                         lengths.y, lengths.z);
+    }
+    if (glm::determinant(glm::mat3(m)) < 0.0f) {
+      return "a reflection";
+    }
+    return std::nullopt;
+  }
+
+  Transform decompose(const glm::mat4& m) {
+    float scale =
+        (glm::length(glm::vec3(m[0])) + glm::length(glm::vec3(m[1])) +
+         glm::length(glm::vec3(m[2]))) /
+        3.0f;
+    glm::mat3 rotation(m);
+    if (scale > 0.0f) {
+      rotation /= scale;
+    }
+    return {glm::normalize(glm::quat_cast(rotation)), glm::vec3(m[3]), scale};
+  }
+
+  AnimationClip::Key encode(const Transform& transform,
+                            const AnimationClip::Params& params) {
+    const auto& q = transform.rotation;
+    glm::vec3 t = (transform.translation - glm::vec3(params.translationMin)) /
+                  glm::vec3(params.translationRange);
+
+    return {
+        glm::packSnorm2x16(glm::vec2(q.x, q.y)),
+        glm::packSnorm2x16(glm::vec2(q.z, q.w)),
+        glm::packUnorm2x16(glm::vec2(t.x, t.y)),
+        (glm::packUnorm2x16(glm::vec2(t.z, 0.0f)) & 0xFFFFu) |
+            (static_cast<uint32_t>(glm::packHalf1x16(transform.scale)) << 16),
+    };
+  }
+
+  Transform decode(const AnimationClip::Key& key,
+                   const AnimationClip::Params& params) {
+    glm::vec2 xy = glm::unpackSnorm2x16(key[0]);
+    glm::vec2 zw = glm::unpackSnorm2x16(key[1]);
+    glm::quat rotation;
+    rotation.x = xy.x;
+    rotation.y = xy.y;
+    rotation.z = zw.x;
+    rotation.w = zw.y;
+
+    glm::vec2 txy = glm::unpackUnorm2x16(key[2]);
+    float tz = glm::unpackUnorm2x16(key[3]).x;
+    float scale = glm::unpackHalf1x16(static_cast<uint16_t>(key[3] >> 16));
+
+    glm::vec3 translation = glm::vec3(params.translationMin) +
+                            glm::vec3(txy.x, txy.y, tz) *
+                                glm::vec3(params.translationRange);
+    return {rotation, translation, scale};
+  }
+
+  glm::mat4 blend(const Transform& a, const Transform& b, float t) {
+    // Keep to the shorter arc, then nlerp
+    glm::quat to = glm::dot(a.rotation, b.rotation) < 0.0f ? -b.rotation
+                                                          : b.rotation;
+    glm::quat rotation = glm::normalize(a.rotation * (1.0f - t) + to * t);
+
+    glm::mat4 m = glm::mat4_cast(rotation) * glm::mix(a.scale, b.scale, t);
+    m[3] = glm::vec4(glm::mix(a.translation, b.translation, t), 1.0f);
+    return m;
+  }
+
+  float difference(const glm::mat4& a, const glm::mat4& b,
+                   float translationExtent) {
+    float diff = 0.0f;
+    for (int c = 0; c < 3; ++c) {
+      for (int r = 0; r < 3; ++r) {
+        diff = std::max(diff, std::abs(a[c][r] - b[c][r]));
+      }
+      diff = std::max(diff, std::abs(a[3][c] - b[3][c]) / translationExtent);
+    }
+    return diff;
+  }
+} // namespace
+
+std::expected<AnimationClip, std::string>
+AnimationClip::compress(std::span<const glm::mat4> matrices,
+                        uint32_t jointCount, uint32_t frameCount,
+                        float frameRate, const Options& options) {
+  if (jointCount == 0 || frameCount == 0) {
+    return std::unexpected("Clip has no joints or frames");
+  }
+  if (matrices.size() != size_t(jointCount) * frameCount) {
+    return std::unexpected(
+        fmt::format("Expected {} joint matrices, got {}",
+                    size_t(jointCount) * frameCount, matrices.size()));
+  }
+
+  std::vector<Transform> transforms;
+  transforms.reserve(matrices.size());
+  glm::vec3 min(std::numeric_limits<float>::max());
+  glm::vec3 max(std::numeric_limits<float>::lowest());
+  AnimationClip clip;
+  for (size_t i = 0; i < matrices.size(); ++i) {
+    if (clip.issue.empty()) {
+      if (auto problem = scaleProblem(matrices[i], options.tolerance)) {
+        clip.issue = fmt::format("joint {} of frame {} has {}",
+                                   i % jointCount, i / jointCount, *problem);
+      }
+    }
+    transforms.push_back(decompose(matrices[i]));
+    min = glm::min(min, transforms.back().translation);
+    max = glm::max(max, transforms.back().translation);
+  }
+
+  clip.frames = frameCount;
+  clip.rate = frameRate;
+  clip.gpu.jointCount = jointCount;
+  clip.gpu.translationMin = glm::vec4(min, 0.0f);
+
+  // A joint that never moves along an axis still needs a non zero range to
+  // divide by
+  glm::vec3 range = max - min;
+  for (int i = 0; i < 3; ++i) {
+    range[i] = range[i] > 1e-6f ? range[i] : 1.0f;
+  }
+  clip.gpu.translationRange = glm::vec4(range, 0.0f);
+  float extent = std::max({range.x, range.y, range.z});
+
+  // Try the longest stride first. Only divisors of the frame count are used
+  // so the loop back from the last key to the first is a full stride too.
+  // A clip that is already off keeps every frame, so it is off no further
+  bool reduce = options.reduceKeys && clip.issue.empty();
+  uint32_t longest = reduce ? MAX_KEY_STRIDE : 1;
+  for (uint32_t stride = std::min(longest, frameCount); stride >= 1;
+       --stride) {
+    if (frameCount % stride != 0) {
+      continue;
+    }
+
+    clip.gpu.keyStride = stride;
+    clip.gpu.keyCount = frameCount / stride;
+    clip.data.clear();
+    clip.data.reserve(size_t(clip.gpu.keyCount) * jointCount);
+    for (uint32_t frame = 0; frame < frameCount; frame += stride) {
+      for (uint32_t joint = 0; joint < jointCount; ++joint) {
+        clip.data.push_back(
+            encode(transforms[size_t(frame) * jointCount + joint], clip.gpu));
+      }
+    }
+
+    clip.error = 0.0f;
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+      for (uint32_t joint = 0; joint < jointCount; ++joint) {
+        clip.error = std::max(
+            clip.error,
+            difference(clip.sample(joint, frame * FRAME_STEPS),
+                       matrices[size_t(frame) * jointCount + joint], extent));
+      }
+    }
+
+    if (clip.error <= options.tolerance || stride == 1) {
+      break;
+    }
+  }
+
+  // Even keeping every frame, quantization alone misses the tolerance
+  if (clip.issue.empty() && clip.error > options.tolerance) {
+    clip.issue = fmt::format("error {:.5f} over the tolerance of {:.5f}",
+                               clip.error, options.tolerance);
+  }
+  return clip;
+}
+
+glm::mat4 AnimationClip::sample(uint32_t joint, uint32_t step) const {
+  float keyPosition = static_cast<float>(step) /
+                      static_cast<float>(FRAME_STEPS * gpu.keyStride);
+  float whole = std::floor(keyPosition);
+  auto first = static_cast<uint32_t>(whole) % gpu.keyCount;
+  auto second = (first + 1) % gpu.keyCount;
+
+  return blend(decode(data[size_t(first) * gpu.jointCount + joint], gpu),
+               decode(data[size_t(second) * gpu.jointCount + joint], gpu),
+               keyPosition - whole);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <glm/glm.hpp>
+#include <span>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// An animation clip compressed for the skinning shader to decode.
+///
+/// Every joint's baked matrix is split into a rotation, a translation and a
+/// uniform scale, and stored as a 16 byte Key instead of a 64 byte mat4: the
+/// rotation as four snorm16s, the translation as three unorm16s relative to
+/// the clip's bounds and the scale as a half. Keys can also be kept for only
+/// every keyStride'th frame, with the shader interpolating the rest, when
+/// that stays within the tolerance.
+///
+/// skin.comp.glsl decodes and interpolates each joint once per workgroup
+/// into shared memory, so the vertices still only read finished matrices.
+/// </summary>
+class AnimationClip {
+public:
+  /// Sub frame steps a pose can sit at, which the shader interpolates
+  /// between. Must match FRAME_STEPS in skin.comp.glsl
+  constexpr static uint32_t FRAME_STEPS = 4;
+  /// Longest gap between kept frames key reduction will try
+  constexpr static uint32_t MAX_KEY_STRIDE = 8;
+
+  /// rotation.xy, rotation.zw as snorm16 pairs, translation.xy as a unorm16
+  /// pair, then translation.z as unorm16 and scale as half
+  using Key = std::array<uint32_t, 4>;
+
+  /// Matches the std430 layout of the clip table in skin.comp.glsl
+  struct Params {
+    glm::vec4 translationMin = glm::vec4(0.0f);
+    glm::vec4 translationRange = glm::vec4(0.0f);
+    /// First key of the clip in the key section
+    uint32_t keyStart = 0;
+    uint32_t jointCount = 0;
+    /// Keys per joint
+    uint32_t keyCount = 0;
+    /// Frames between consecutive keys
+    uint32_t keyStride = 1;
+  };
+
+  struct Options {
+    /// Drop frames that interpolation reproduces within tolerance
+    bool reduceKeys = true;
+    /// Largest error allowed in any element of a joint matrix, with the
+    /// translation measured against the clip's extent
+    float tolerance = 2e-3f;
+  };
+
+  /// <summary>
+  /// Compresses frameCount frames of jointCount baked joint matrices, laid
+  /// out frame by frame as Mesh::writeJointData produces them.
+  ///
+  /// A joint that scales its axes differently or mirrors cannot be stored,
+  /// and the clip keeps every frame with those joints' scale averaged. A
+  /// clip that misses the tolerance even keeping every frame is kept as it
+  /// is. Either way problem() says why.
+  /// </summary>
+  static std::expected<AnimationClip, std::string>
+  compress(std::span<const glm::mat4> matrices, uint32_t jointCount,
+           uint32_t frameCount, float frameRate, const Options& options);
+
+  inline const Params& params() const { return gpu; }
+  inline std::span<const Key> keys() const { return data; }
+  inline uint32_t frameCount() const { return frames; }
+  inline float frameRate() const { return rate; }
+  /// Largest error left after compression, in the units of tolerance
+  inline float maxError() const { return error; }
+  /// Why the clip is further off than the tolerance, empty if it is not
+  inline const std::string& problem() const { return issue; }
+
+  inline size_t compressedBytes() const { return data.size() * sizeof(Key); }
+  inline size_t bakedBytes() const {
+    return size_t(frames) * gpu.jointCount * sizeof(glm::mat4);
+  }
+
+  /// <summary>
+  /// Decodes one joint at a sub frame step, the same way the shader does.
+  /// </summary>
+  glm::mat4 sample(uint32_t joint, uint32_t step) const;
+
+private:
+  AnimationClip() = default;
+
+  std::vector<Key> data;
+  Params gpu;
+  uint32_t frames = 0;
+  float rate = 0.0f;
+  float error = 0.0f;
+  std::string issue;
+};
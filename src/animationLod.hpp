@@ -0,0 +1,65 @@
+#pragma once
+
+#include "animationClip.hpp"
+#include <array>
+#include <cstdint>
+
+/// <summary>
+/// How often a skinned character's pose moves on, by how large it is on
+/// screen. The skinning batch shares one skinned pose between every instance
+/// on the same mesh, clip and step, so coarser steps mean fewer poses to
+/// skin rather than skipped work per character.
+///
+/// Large characters animate on every sub frame step. Reduced ones hold each
+/// pose for interval whole frames of their clip, so they share poses with
+/// many more characters. Frozen ones all stand on the clip's first step.
+/// </summary>
+struct AnimationLod {
+  enum class Tier : uint8_t {
+    FULL,
+    REDUCED,
+    FROZEN,
+  };
+  constexpr static size_t TIER_COUNT = 3;
+
+  /// Screen size at or above which characters animate fully
+  float fullSize = 0.05f;
+  /// Screen size below which characters freeze
+  float frozenSize = 0.01f;
+  /// Clip frames a reduced character holds each pose for
+  int interval = 2;
+
+  /// <summary>
+  /// Bounding radius over distance from the eye, which is the fraction of
+  /// half the view's height the character covers at a 90 degree field of
+  /// view.
+  /// </summary>
+  static float screenSize(float radius, float distance) {
+    return distance <= radius ? 1.0f : radius / distance;
+  }
+
+  Tier tier(float radius, float distance) const {
+    float size = screenSize(radius, distance);
+    if (size >= fullSize) {
+      return Tier::FULL;
+    }
+    return size >= frozenSize ? Tier::REDUCED : Tier::FROZEN;
+  }
+
+  /// <summary>
+  /// The step a character on step of its clip is posed on in tier.
+  /// </summary>
+  uint32_t step(Tier tier, uint32_t step) const {
+    switch (tier) {
+    case Tier::REDUCED: {
+      auto hold =
+          static_cast<uint32_t>(interval) * AnimationClip::FRAME_STEPS;
+      return step - step % hold;
+    }
+    case Tier::FROZEN:
+      return 0;
+    default:
+      return step;
+    }
+  }
+};
@@ -0,0 +1,267 @@
+#include "assetLoader.hpp"
+
+#include "logger/logger.hpp"
+#include <algorithm>
+
+namespace {
+  // Large enough for the biggest single level we upload (the 4096x4096 BC4
+  // height map, or a 2048x2048 BC7 cube face) with room to spare
+  constexpr GLuint STAGING_RING_SIZE = 64 * 1024 * 1024;
+  constexpr size_t PAGE_SIZE = 4096;
+} // namespace
+
+AssetLoader::AssetLoader(ThreadPool& pool)
+    : pool(pool), ring(STAGING_RING_SIZE) {}
+
+std::string AssetLoader::key(std::string_view path, bool flip, int channels) {
+  return fmt::format("{}|{}|{}", path, flip, channels);
+}
+
+void AssetLoader::prefetch(std::string_view path, bool flip, int channels) {
+  auto k = key(path, flip, channels);
+  if (images.contains(k)) {
+    return;
+  }
+
+  images.emplace(std::move(k),
+                 pool.submit([path = std::string(path), flip,
+                              channels]() -> ImageResult {
+                       auto start = Clock::now();
+                       auto imgRes =
+                           engine::Image::fromFile(path, flip, channels);
+                       if (!imgRes) {
+                         return std::unexpected(imgRes.error());
+                       }
+                       return DecodedImage{std::move(*imgRes), channels,
+                                           msSince(start)};
+                     }).share());
+}
+
+const AssetLoader::ImageResult&
+AssetLoader::image(std::string_view path, bool flip, int channels) {
+  prefetch(path, flip, channels);
+  return images.at(key(path, flip, channels)).get();
+}
+
+void AssetLoader::release() {
+  images.clear();
+  packs.clear();
+}
+
+void AssetLoader::prefetch(const std::string& path,
+                           const TexturePack::Sources& sources) {
+  if (packs.contains(path)) {
+    return;
+  }
+
+  if (!TexturePack::isUpToDate(path, sources)) {
+    for (const auto& face : sources.faces) {
+      prefetch(face.path, face.flip, TexturePack::channels(sources.role));
+    }
+    return;
+  }
+
+  packs.emplace(path, pool.submit([path]() -> OpenedPack {
+    auto start = Clock::now();
+    auto pack = TexturePack::open(path);
+    if (pack) {
+      // Mapping is lazy, so fault every page in here rather than during the
+      // upload on the main thread
+      auto raw = pack->raw();
+      volatile std::byte sink{};
+      for (size_t i = 0; i < raw.size(); i += PAGE_SIZE) {
+        sink = raw[i];
+      }
+      (void)sink;
+    }
+    return {std::move(pack), msSince(start)};
+  }));
+}
+
+void AssetLoader::record(Timing&& timing) {
+  std::scoped_lock lock(timingMutex);
+  _timings.push_back(std::move(timing));
+}
+
+template <typename F>
+void AssetLoader::staged(const void* data, GLuint size, F&& upload) {
+  if (auto offset = ring.push(data, size)) {
+    ring.bindUnpack();
+    upload(reinterpret_cast<const void*>(static_cast<uintptr_t>(*offset)));
+    StagingRing::unbindUnpack();
+    ring.fence();
+  } else {
+    upload(data);
+  }
+}
+
+AssetLoader::OpenedPack
+AssetLoader::pack(const std::string& path,
+                  const TexturePack::Sources& sources) {
+  auto start = Clock::now();
+
+  if (auto it = packs.find(path); it != packs.end()) {
+    auto opened = it->second.get();
+    packs.erase(it);
+    if (opened.pack) {
+      return opened;
+    }
+    Logger::info("Rebuilding texture pack: {}", opened.pack.error());
+  } else if (TexturePack::isUpToDate(path, sources)) {
+    auto pack = TexturePack::open(path);
+    if (pack) {
+      return {std::move(pack), msSince(start)};
+    }
+    Logger::info("Rebuilding texture pack: {}", pack.error());
+  } else {
+    Logger::info("Texture pack {} is missing or stale, rebuilding", path);
+  }
+
+  return {rebuild(path, sources), msSince(start)};
+}
+
+std::expected<TexturePack, std::string>
+AssetLoader::rebuild(const std::string& path,
+                     const TexturePack::Sources& sources) {
+  std::vector<const engine::Image*> faces;
+  for (const auto& face : sources.faces) {
+    auto& decoded =
+        image(face.path, face.flip, TexturePack::channels(sources.role));
+    if (!decoded) {
+      return std::unexpected(decoded.error());
+    }
+    faces.push_back(&decoded->image);
+  }
+
+  auto bytes = TexturePack::build(sources.role, faces);
+  if (!bytes) {
+    return std::unexpected(fmt::format("{}: {}", path, bytes.error()));
+  }
+
+  if (auto res = TexturePack::write(path, *bytes); !res) {
+    Logger::error("Failed to save texture pack: {}", res.error());
+  } else if (auto pack = TexturePack::open(path)) {
+    return pack;
+  }
+
+  return TexturePack::fromBytes(std::move(*bytes));
+}
+
+std::expected<gl::Texture, std::string>
+AssetLoader::texture(const std::string& path,
+                     const TexturePack::Sources& sources) {
+  auto opened = pack(path, sources);
+  if (!opened.pack) {
+    return std::unexpected(opened.pack.error());
+  }
+  const auto& pack = *opened.pack;
+  const auto& header = pack.header();
+  if (header.faces != 1) {
+    return std::unexpected(path + " is a cube map, not a 2D texture");
+  }
+
+  auto start = Clock::now();
+  auto tex = upload(pack, 0);
+  record({path, opened.openMs, msSince(start)});
+
+  return tex;
+}
+
+std::expected<TexturePack, std::string>
+AssetLoader::openPack(const std::string& path,
+                      const TexturePack::Sources& sources) {
+  auto opened = pack(path, sources);
+  if (opened.pack) {
+    record({path, opened.openMs, 0.0f});
+  }
+  return std::move(opened.pack);
+}
+
+gl::Texture AssetLoader::upload(const TexturePack& pack, uint32_t baseLevel) {
+  const auto& header = pack.header();
+  const auto& top = pack.level(baseLevel);
+
+  gl::Texture tex;
+  tex.storage(static_cast<int>(header.levels - baseLevel), header.format,
+              {static_cast<int>(top.width), static_cast<int>(top.height)});
+
+  for (uint32_t i = baseLevel; i < header.levels; ++i) {
+    const auto& level = pack.level(i);
+    auto data = pack.data(level);
+    staged(data.data(), static_cast<GLuint>(data.size()),
+           [&](const void* blocks) {
+             glCompressedTextureSubImage2D(
+                 tex.id(), static_cast<GLint>(i - baseLevel), 0, 0,
+                 static_cast<GLsizei>(level.width),
+                 static_cast<GLsizei>(level.height), header.format,
+                 static_cast<GLsizei>(data.size()), blocks);
+           });
+  }
+
+  return tex;
+}
+
+std::expected<gl::CubeMap, std::string>
+AssetLoader::cubeMap(const std::string& path,
+                     const TexturePack::Sources& sources) {
+  auto opened = pack(path, sources);
+  if (!opened.pack) {
+    return std::unexpected(opened.pack.error());
+  }
+  const auto& pack = *opened.pack;
+  const auto& header = pack.header();
+  if (header.faces != 6) {
+    return std::unexpected(path + " is a 2D texture, not a cube map");
+  }
+
+  auto start = Clock::now();
+
+  gl::CubeMap cubeMap;
+  cubeMap.storage(static_cast<int>(header.levels), header.format,
+                  {static_cast<int>(header.width),
+                   static_cast<int>(header.height)});
+
+  // Cube maps are addressed as six layers in face order through DSA
+  for (uint32_t i = 0; i < header.levels; ++i) {
+    for (uint32_t face = 0; face < header.faces; ++face) {
+      const auto& level = pack.level(i, face);
+      auto data = pack.data(level);
+      staged(data.data(), static_cast<GLuint>(data.size()),
+             [&](const void* blocks) {
+               glCompressedTextureSubImage3D(
+                   cubeMap.id(), static_cast<GLint>(i), 0, 0,
+                   static_cast<GLint>(face),
+                   static_cast<GLsizei>(level.width),
+                   static_cast<GLsizei>(level.height), 1, header.format,
+                   static_cast<GLsizei>(data.size()), blocks);
+             });
+    }
+  }
+
+  record({path, opened.openMs, msSince(start)});
+
+  return cubeMap;
+}
+
+void AssetLoader::logSummary() {
+  _totalMs = msSince(created);
+
+  std::scoped_lock lock(timingMutex);
+  std::sort(_timings.begin(), _timings.end(),
+            [](const Timing& a, const Timing& b) {
+              return a.decodeMs + a.uploadMs > b.decodeMs + b.uploadMs;
+            });
+
+  float decodeMs = 0.0f;
+  float uploadMs = 0.0f;
+  for (const auto& timing : _timings) {
+    Logger::debug("  {:>8.2f}ms decode | {:>8.2f}ms upload | {}",
+                  timing.decodeMs, timing.uploadMs, timing.name);
+    decodeMs += timing.decodeMs;
+    uploadMs += timing.uploadMs;
+  }
+
+  Logger::info("Loaded {} assets in {:.2f}ms ({:.2f}ms of decoding across {} "
+               "threads, {:.2f}ms uploading)",
+               _timings.size(), _totalMs, decodeMs, pool.size(), uploadMs);
+}
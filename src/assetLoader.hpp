@@ -0,0 +1,156 @@
+#pragma once
+
+#include "stagingRing.hpp"
+#include "texturePack.hpp"
+#include "threadPool.hpp"
+#include <chrono>
+#include <engine/image.hpp>
+#include <expected>
+#include <future>
+#include <gl/gl.hpp>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// <summary>
+/// Decodes images and parses asset files on a thread pool, leaving the main
+/// thread to do nothing but upload the results through a staging ring.
+///
+/// Anything requested with prefetch starts decoding immediately, so the
+/// constructor can queue every known asset up front and then block on each
+/// one only when it is actually needed.
+/// </summary>
+class AssetLoader {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct DecodedImage {
+    engine::Image image;
+    int channels;
+    float decodeMs = 0.0f;
+  };
+
+  using ImageResult = std::expected<DecodedImage, std::string>;
+
+  struct Timing {
+    std::string name;
+    float decodeMs = 0.0f;
+    float uploadMs = 0.0f;
+  };
+
+  explicit AssetLoader(ThreadPool& pool);
+
+  AssetLoader(const AssetLoader&) = delete;
+  AssetLoader& operator=(const AssetLoader&) = delete;
+
+  /// <summary>
+  /// Starts decoding an image on the pool if it has not been requested yet.
+  /// </summary>
+  void prefetch(std::string_view path, bool flip, int channels = 4);
+
+  /// <summary>
+  /// Waits for an image to finish decoding, requesting it if needed.
+  /// The result stays owned by the loader until release is called.
+  /// </summary>
+  const ImageResult& image(std::string_view path, bool flip, int channels = 4);
+
+  /// <summary>
+  /// Drops every decoded image and unclaimed pack. Call once all uploads are
+  /// done.
+  /// </summary>
+  void release();
+
+  /// <summary>
+  /// Runs an arbitrary loading job on the pool, recording how long it took.
+  /// </summary>
+  template <typename F> auto load(std::string_view name, F&& fn) {
+    return pool.submit(
+        [this, name = std::string(name), fn = std::forward<F>(fn)]() mutable {
+          auto start = Clock::now();
+          auto result = fn();
+          record({name, msSince(start), 0.0f});
+          return result;
+        });
+  }
+
+  /// <summary>
+  /// Starts opening a texture pack on the pool if it is up to date, or
+  /// decoding its source images if it will have to be rebuilt.
+  /// </summary>
+  void prefetch(const std::string& path, const TexturePack::Sources& sources);
+
+  /// <summary>
+  /// Uploads every baked level of a single face texture pack, building the
+  /// pack first if it is missing or older than its source.
+  /// </summary>
+  std::expected<gl::Texture, std::string>
+  texture(const std::string& path, const TexturePack::Sources& sources);
+
+  /// <summary>
+  /// Takes the prefetched pack for path, or opens it now, building it first
+  /// if it is missing or older than its sources. For callers that keep the
+  /// pack around and upload from it themselves.
+  /// </summary>
+  std::expected<TexturePack, std::string>
+  openPack(const std::string& path, const TexturePack::Sources& sources);
+
+  /// <summary>
+  /// Uploads a single face pack from baseLevel down, giving a texture whose
+  /// top level is the pack's baseLevel.
+  /// </summary>
+  gl::Texture upload(const TexturePack& pack, uint32_t baseLevel = 0);
+
+  /// <summary>
+  /// Uploads every baked level of a six face texture pack as a cube map,
+  /// building the pack first if it is missing or older than its sources.
+  /// </summary>
+  std::expected<gl::CubeMap, std::string>
+  cubeMap(const std::string& path, const TexturePack::Sources& sources);
+
+  /// <summary>
+  /// Logs the time spent on each asset and in total since construction.
+  /// </summary>
+  void logSummary();
+
+  inline const std::vector<Timing>& timings() const { return _timings; }
+  inline float totalMs() const { return _totalMs; }
+  inline size_t threadCount() const { return pool.size(); }
+
+  static float msSince(Clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(Clock::now() - start)
+        .count();
+  }
+
+private:
+  struct OpenedPack {
+    std::expected<TexturePack, std::string> pack;
+    float openMs = 0.0f;
+  };
+
+  void record(Timing&& timing);
+  // Copies data into the ring (when it fits) and calls upload with either
+  // the ring offset or the client pointer
+  template <typename F> void staged(const void* data, GLuint size, F&& upload);
+
+  // Takes the prefetched pack for path, or opens or rebuilds it now
+  OpenedPack pack(const std::string& path, const TexturePack::Sources& sources);
+  // Compresses the (prefetched) source images into a pack and saves it
+  std::expected<TexturePack, std::string>
+  rebuild(const std::string& path, const TexturePack::Sources& sources);
+
+  static std::string key(std::string_view path, bool flip, int channels);
+
+  ThreadPool& pool;
+  StagingRing ring;
+
+  std::unordered_map<std::string, std::shared_future<ImageResult>> images;
+  std::unordered_map<std::string, std::future<OpenedPack>> packs;
+
+  std::mutex timingMutex;
+  std::vector<Timing> _timings;
+
+  Clock::time_point created = Clock::now();
+  float _totalMs = 0.0f;
+};
@@ -0,0 +1,254 @@
+#include "benchmark.hpp"
+
+#include "logger/logger.hpp"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <string_view>
+
+namespace {
+  struct Summary {
+    float mean = 0.0f;
+    float p50 = 0.0f;
+    float p95 = 0.0f;
+    float p99 = 0.0f;
+    float max = 0.0f;
+  };
+
+  Summary summarize(std::vector<float> values) {
+    if (values.empty()) {
+      return {};
+    }
+
+    std::sort(values.begin(), values.end());
+    auto at = [&](float percentile) {
+      auto index = static_cast<size_t>(percentile *
+                                        static_cast<float>(values.size() - 1));
+      return values[index];
+    };
+
+    double sum = 0.0;
+    for (float v : values) {
+      sum += v;
+    }
+
+    return {static_cast<float>(sum / static_cast<double>(values.size())),
+            at(0.5f), at(0.95f), at(0.99f), values.back()};
+  }
+
+  std::string summaryJson(const Summary& s) {
+    return fmt::format("{{\"mean\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, "
+                       "\"p99\": {:.4f}, \"max\": {:.4f}}}",
+                       s.mean, s.p50, s.p95, s.p99, s.max);
+  }
+
+  std::string escapeJson(std::string_view str) {
+    std::string out;
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+      }
+      out += c;
+    }
+    return out;
+  }
+} // namespace
+
+std::expected<std::optional<Benchmark::Options>, std::string>
+Benchmark::parse(int argc, char** argv) {
+  std::optional<Options> options;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--benchmark") {
+      options.emplace();
+      continue;
+    }
+
+    if (arg != "--timestep" && arg != "--output") {
+      return std::unexpected(fmt::format("Unknown argument {}", arg));
+    }
+    if (i + 1 >= argc) {
+      return std::unexpected(fmt::format("{} needs a value", arg));
+    }
+    std::string_view value = argv[++i];
+
+    if (!options) {
+      options.emplace();
+    }
+    if (arg == "--output") {
+      options->output = value;
+      continue;
+    }
+
+    float timestep = 0.0f;
+    auto res =
+        std::from_chars(value.data(), value.data() + value.size(), timestep);
+    if (res.ec != std::errc{} || timestep <= 0.0f) {
+      return std::unexpected(fmt::format("Invalid timestep {}", value));
+    }
+    options->timestep = timestep;
+  }
+
+  return options;
+}
+
+Benchmark::Benchmark(Options options) : options(std::move(options)) {
+  for (auto& q : queries) {
+    glCreateQueries(GL_TIME_ELAPSED, 1, &q.query);
+  }
+}
+
+Benchmark::~Benchmark() {
+  for (auto& q : queries) {
+    glDeleteQueries(1, &q.query);
+  }
+}
+
+void Benchmark::beginFrame(float trackTime) {
+  auto& q = queries[nextQuery];
+  if (q.frame) {
+    // The ring is full, so this one has to be read before it is reused
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &elapsed);
+    frames[*q.frame].gpuMs = static_cast<float>(elapsed) / 1e6f;
+    q.frame = std::nullopt;
+  }
+
+  frameTrackTime = trackTime;
+  frameStart = Clock::now();
+  glBeginQuery(GL_TIME_ELAPSED, q.query);
+}
+
+void Benchmark::endFrame(const FrameCounters& counters) {
+  glEndQuery(GL_TIME_ELAPSED);
+  auto cpuMs =
+      std::chrono::duration<float, std::milli>(Clock::now() - frameStart)
+          .count();
+
+  queries[nextQuery].frame = frames.size();
+  nextQuery = (nextQuery + 1) % QUERY_COUNT;
+
+  frames.push_back({static_cast<uint32_t>(frames.size()), frameTrackTime,
+                    cpuMs, 0.0f, counters});
+
+  collect(false);
+}
+
+void Benchmark::collect(bool wait) {
+  for (auto& q : queries) {
+    if (!q.frame) {
+      continue;
+    }
+
+    if (!wait) {
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(q.query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+        continue;
+      }
+    }
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &elapsed);
+    frames[*q.frame].gpuMs = static_cast<float>(elapsed) / 1e6f;
+    q.frame = std::nullopt;
+  }
+}
+
+std::expected<void, std::string> Benchmark::finish() {
+  collect(true);
+
+  if (auto res = writeCsv(options.output + ".csv"); !res) {
+    return res;
+  }
+  if (auto res = writeJson(options.output + ".json"); !res) {
+    return res;
+  }
+
+  std::vector<float> cpu, gpu;
+  for (const auto& frame : frames) {
+    cpu.push_back(frame.cpuMs);
+    gpu.push_back(frame.gpuMs);
+  }
+  auto cpuSummary = summarize(cpu);
+  auto gpuSummary = summarize(gpu);
+  Logger::info("Benchmarked {} frames: CPU {:.3f}ms mean, {:.3f}ms p99 | GPU "
+               "{:.3f}ms mean, {:.3f}ms p99. Written to {}.json/.csv",
+               frames.size(), cpuSummary.mean, cpuSummary.p99,
+               gpuSummary.mean, gpuSummary.p99, options.output);
+  return {};
+}
+
+std::expected<void, std::string>
+Benchmark::writeCsv(const std::string& path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return std::unexpected("Failed to open " + path + " for writing");
+  }
+
+  file << "frame,track_time,cpu_ms,gpu_ms,multi_draws,batched_draws,"
+          "instances,shadow_passes,cached_shadows,hidden_shadows,"
+          "light_volumes,upload_bytes\n";
+  for (const auto& f : frames) {
+    file << fmt::format("{},{:.4f},{:.4f},{:.4f},{},{},{},{},{},{},{},{}\n",
+                        f.index, f.trackTime, f.cpuMs, f.gpuMs,
+                        f.counters.multiDraws, f.counters.batchedDraws,
+                        f.counters.instances, f.counters.shadowPasses,
+                        f.counters.cachedShadows, f.counters.hiddenShadows,
+                        f.counters.lightVolumes, f.counters.uploadBytes);
+  }
+
+  if (!file) {
+    return std::unexpected("Failed to write " + path);
+  }
+  return {};
+}
+
+std::expected<void, std::string>
+Benchmark::writeJson(const std::string& path) const {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return std::unexpected("Failed to open " + path + " for writing");
+  }
+
+  auto glString = [](GLenum name) {
+    auto str = reinterpret_cast<const char*>(glGetString(name));
+    return escapeJson(str ? str : "");
+  };
+
+  std::vector<float> cpu, gpu;
+  for (const auto& frame : frames) {
+    cpu.push_back(frame.cpuMs);
+    gpu.push_back(frame.gpuMs);
+  }
+
+  file << "{\n";
+  file << fmt::format("  \"renderer\": \"{}\",\n", glString(GL_RENDERER));
+  file << fmt::format("  \"version\": \"{}\",\n", glString(GL_VERSION));
+  file << fmt::format("  \"timestep\": {},\n", options.timestep);
+  file << fmt::format("  \"frameCount\": {},\n", frames.size());
+  file << fmt::format("  \"cpuMs\": {},\n", summaryJson(summarize(cpu)));
+  file << fmt::format("  \"gpuMs\": {},\n", summaryJson(summarize(gpu)));
+  file << "  \"frames\": [\n";
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const auto& f = frames[i];
+    file << fmt::format(
+        "    {{\"frame\": {}, \"trackTime\": {:.4f}, \"cpuMs\": {:.4f}, "
+        "\"gpuMs\": {:.4f}, \"multiDraws\": {}, \"batchedDraws\": {}, "
+        "\"instances\": {}, \"shadowPasses\": {}, \"cachedShadows\": {}, "
+        "\"hiddenShadows\": {}, \"lightVolumes\": {}, "
+        "\"uploadBytes\": {}}}{}\n",
+        f.index, f.trackTime, f.cpuMs, f.gpuMs, f.counters.multiDraws,
+        f.counters.batchedDraws, f.counters.instances, f.counters.shadowPasses,
+        f.counters.cachedShadows, f.counters.hiddenShadows,
+        f.counters.lightVolumes, f.counters.uploadBytes,
+        i + 1 < frames.size() ? "," : "");
+  }
+  file << "  ]\n}\n";
+
+  if (!file) {
+    return std::unexpected("Failed to write " + path);
+  }
+  return {};
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <gl/gl.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Work submitted in one frame, counted by the renderer as it draws.
+/// </summary>
+struct FrameCounters {
+  /// glMultiDrawElementsIndirect calls
+  uint32_t multiDraws = 0;
+  /// Indirect commands nodes wrote across every multi draw, not counting
+  /// the empty ones padding them
+  uint32_t batchedDraws = 0;
+  uint32_t instances = 0;
+  /// Shadow map passes, one per light (point lights render all six faces in
+  /// one layered pass)
+  uint32_t shadowPasses = 0;
+  /// Shadow maps kept from an earlier frame, as nothing in range moved
+  uint32_t cachedShadows = 0;
+  /// Point light shadows skipped as the light reached nothing on screen
+  uint32_t hiddenShadows = 0;
+  uint32_t lightVolumes = 0;
+  /// Bytes written to persistently mapped instance and material data
+  uint32_t uploadBytes = 0;
+};
+
+/// <summary>
+/// Records per frame CPU time, GPU time and draw counts while the renderer
+/// plays the camera track with a fixed timestep, and writes them out as
+/// JSON and CSV once the track finishes.
+///
+/// GPU time comes from GL_TIME_ELAPSED queries kept in a small ring, so
+/// results are read a few frames late rather than stalling on each one.
+/// </summary>
+class Benchmark {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Options {
+    /// Seconds of track time per frame
+    float timestep = 1.0f / 60.0f;
+    /// Path the .json and .csv extensions are added to
+    std::string output = "benchmark";
+  };
+
+  struct Frame {
+    uint32_t index;
+    float trackTime;
+    float cpuMs;
+    float gpuMs = 0.0f;
+    FrameCounters counters;
+  };
+
+  /// <summary>
+  /// Looks for --benchmark in the arguments, along with the optional
+  /// --timestep &lt;seconds&gt; and --output &lt;path&gt;.
+  /// </summary>
+  /// <returns>nullopt when not benchmarking, or an error for bad
+  /// arguments</returns>
+  static std::expected<std::optional<Options>, std::string>
+  parse(int argc, char** argv);
+
+  explicit Benchmark(Options options);
+  ~Benchmark();
+
+  Benchmark(const Benchmark&) = delete;
+  Benchmark& operator=(const Benchmark&) = delete;
+
+  inline float timestep() const { return options.timestep; }
+
+  /// <summary>
+  /// Starts the CPU timer and GPU query for a frame. Call at the start of
+  /// update.
+  /// </summary>
+  void beginFrame(float trackTime);
+
+  /// <summary>
+  /// Stops the timers for the frame begun last. Call at the end of render.
+  /// </summary>
+  void endFrame(const FrameCounters& counters);
+
+  /// <summary>
+  /// Waits for the outstanding GPU queries and writes both files.
+  /// </summary>
+  std::expected<void, std::string> finish();
+
+private:
+  constexpr static size_t QUERY_COUNT = 4;
+
+  struct PendingQuery {
+    GLuint query = 0;
+    std::optional<size_t> frame = std::nullopt;
+  };
+
+  // Reads back every query that has finished, or all of them if wait is set
+  void collect(bool wait);
+
+  std::expected<void, std::string> writeCsv(const std::string& path) const;
+  std::expected<void, std::string> writeJson(const std::string& path) const;
+
+  Options options;
+
+  std::array<PendingQuery, QUERY_COUNT> queries;
+  size_t nextQuery = 0;
+
+  Clock::time_point frameStart;
+  float frameTrackTime = 0.0f;
+  std::vector<Frame> frames;
+};
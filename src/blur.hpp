@@ -7,8 +7,9 @@ class Blur : public PostProcess {
 
 public:
   Blur() = default;
-  inline static std::expected<Blur, std::string> create() {
-    auto programOpt = gl::Program::fromFiles({
+  inline static std::expected<Blur, std::string>
+  create(ProgramCache& programs) {
+    auto programOpt = programs.load({
         {SHADERDIR "fullscreen.vert.glsl", gl::Shader::Type::VERTEX},
         {SHADERDIR "postprocess/blur.frag.glsl", gl::Shader::Type::FRAGMENT},
     });
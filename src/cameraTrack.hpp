@@ -65,6 +65,18 @@ public:
     effects.push_back(Effect{startTime, endTime, action});
   }
 
+  /// <summary>
+  /// Seconds into the track, before it wraps back to 0.
+  /// </summary>
+  float time() const { return _time; }
+
+  /// <summary>
+  /// Time of the last keyframe, after which update wraps back to the start.
+  /// </summary>
+  float duration() const {
+    return keyframes.empty() ? 0.0f : keyframes.back().time;
+  }
+
   void update(float deltaTime) {
     _time += deltaTime;
 
@@ -0,0 +1,97 @@
+#include "character.hpp"
+
+#include "animationClip.hpp"
+#include <glm/ext/matrix_transform.hpp>
+
+namespace {
+  /// Quantised to sub frame steps so characters close in time still share
+  /// a pose
+  ScenePool::Animation stepped(const SkinnedMesh::Clip& clip, size_t index) {
+    return {
+        .clip = static_cast<uint32_t>(index),
+        .length = static_cast<float>(clip.frameCount) / clip.frameRate,
+        .stepsPerSecond =
+            clip.frameRate * static_cast<float>(AnimationClip::FRAME_STEPS),
+        .stepCount = clip.frameCount * AnimationClip::FRAME_STEPS,
+    };
+  }
+} // namespace
+
+void Character::place(const glm::mat4& transform, const glm::vec3& scale) {
+  scene.setLocal(node, glm::scale(transform, scale));
+}
+
+void Character::setRadius(float radius) { scene.setRadius(node, radius); }
+
+void Character::setClip(size_t index) {
+  if (index >= mesh->clips.size()) {
+    return;
+  }
+
+  scene.setAnimation(node, stepped(mesh->clips[index], index), 0.0f);
+}
+
+void Character::setFrame(GLuint startFrame) {
+  if (mesh->clips.empty()) {
+    return;
+  }
+
+  uint32_t clip = scene.clip(node);
+  const auto& current = mesh->clips[clip];
+  GLuint start = startFrame % current.frameCount;
+  scene.setAnimation(node, stepped(current, clip),
+                     static_cast<float>(start) / current.frameRate);
+}
+
+void Character::updateLod(const AnimationLod& lod, const glm::vec3& eye) {
+  float distance = glm::length(glm::vec3(scene.world(node)[3]) - eye);
+  tier = lod.tier(scene.radius(node), distance);
+  poseStep = lod.step(tier, scene.step(node));
+}
+
+glm::vec4 Character::bounds() const {
+  return glm::vec4(glm::vec3(scene.world(node)[3]), scene.radius(node));
+}
+
+void Character::skinVertices(GLuint& writtenVertices) {
+  // Where the vertices end up is up to the batch, since characters on the
+  // same frame share them
+  GLuint clipIndex =
+      mesh->clips.empty() ? 0 : mesh->clips[scene.clip(node)].index;
+  GLuint jointCount = mesh->clips.empty() ? 0 : mesh->jointCount;
+  instance = skinning.add(mesh->baseVertex, mesh->vertexCount, clipIndex,
+                          jointCount, poseStep, mesh->layers);
+
+  engine::scene::Node::skinVertices(writtenVertices);
+}
+
+void Character::writeInstanceData(gl::MappingRef& instanceMap,
+                                  GLuint& writtenInstances,
+                                  gl::MappingRef& textureMap) {
+  writeTransform();
+  writeTextures();
+
+  engine::scene::Node::writeInstanceData(instanceMap, writtenInstances,
+                                         textureMap);
+}
+
+void Character::writeTransform() {
+  skinning.setTransform(instance, scene.world(node), scene.radius(node));
+}
+
+void Character::writeTextures() {
+  // Runs whether or not the cull then keeps the instance, so the textures of
+  // a crowd member out of view stay loaded, see TextureResidency
+  if (skinning.needsTextures(instance)) {
+    std::vector<engine::mesh::TextureHandleSet> sets;
+    sets.reserve(mesh->textures.size());
+    for (const auto& set : mesh->textures) {
+      engine::mesh::TextureHandleSet handles = {};
+      handles.diffuse = textures.handle(set.diffuse);
+      handles.bump = textures.handle(set.bump);
+      handles.material = textures.handle(set.material);
+      sets.push_back(handles);
+    }
+    skinning.setTextures(instance, std::move(sets));
+  }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "animationLod.hpp"
+#include "scenePool.hpp"
+#include "skinningBatch.hpp"
+#include "textureResidency.hpp"
+#include <engine/app.hpp>
+#include <engine/mesh/mesh.hpp>
+#include <engine/scene_node.hpp>
+#include <gl/gl.hpp>
+#include <memory>
+#include <vector>
+
+/// <summary>
+/// Where a skinned mesh lives inside the renderer's static mesh buffer, along
+/// with the textures each of its layers is drawn with.
+/// </summary>
+struct SkinnedMesh {
+  /// Textures registered with the TextureResidency, NONE when the layer has
+  /// no such map
+  struct TextureSet {
+    TextureResidency::Id diffuse = TextureResidency::NONE;
+    TextureResidency::Id bump = TextureResidency::NONE;
+    TextureResidency::Id material = TextureResidency::NONE;
+  };
+
+  using Layer = SkinningBatch::Layer;
+
+  /// An animation the mesh can play, compressed by AnimationClip
+  struct Clip {
+    /// Entry in the renderer's clip table
+    GLuint index = 0;
+    GLuint frameCount = 0;
+    float frameRate = 0.0f;
+  };
+
+  /// First WeightedVertex of the mesh in the static buffer
+  GLuint baseVertex = 0;
+  GLuint vertexCount = 0;
+  GLuint jointCount = 0;
+
+  /// Every clip shares the mesh's skeleton
+  std::vector<Clip> clips;
+
+  std::vector<Layer> layers;
+  /// One per layer
+  std::vector<TextureSet> textures;
+};
+
+/// <summary>
+/// An animated instance of a SkinnedMesh. Characters are drawn by the
+/// renderer's batch pass through the frame's SkinningBatch: each one adds
+/// itself on its current pose and hands over its transform and bounds, and
+/// the batch culls and draws them on the GPU. Characters sharing a pose share
+/// the skinned vertices and their draws. Texture handles come from the
+/// TextureResidency when a pose first needs them, which is what keeps the
+/// textures in use resident.
+///
+/// Characters are kept out of the scene graph, so the CPU never culls them
+/// one by one. Their transform, bounds and animation live in a ScenePool
+/// node instead, which updates the whole crowd at once.
+/// </summary>
+class Character : public engine::scene::Node {
+public:
+  Character(std::shared_ptr<const SkinnedMesh> mesh,
+            TextureResidency& textures, SkinningBatch& skinning,
+            ScenePool& scene, ScenePool::Handle parent = {})
+      : engine::scene::Node(engine::scene::Node::RenderType::LIT),
+        mesh(std::move(mesh)), textures(textures), skinning(skinning),
+        scene(scene), node(scene.create(parent)) {
+    setClip(0);
+  }
+
+  ~Character() { scene.destroy(node); }
+
+  Character(const Character&) = delete;
+  Character& operator=(const Character&) = delete;
+
+  /// <summary>
+  /// Sets the model matrix the batch pass draws this character with,
+  /// relative to its parent in the pool.
+  /// </summary>
+  void place(const glm::mat4& transform, const glm::vec3& scale);
+  /// <summary>
+  /// World space radius the character is culled with.
+  /// </summary>
+  void setRadius(float radius);
+  /// <summary>
+  /// Switches to one of the mesh's clips, from its first frame.
+  /// </summary>
+  void setClip(size_t index);
+  void setFrame(GLuint startFrame);
+
+  /// <summary>
+  /// Picks the character's animation tier from its screen size seen from
+  /// eye, and the step it is posed on this frame. Must be called before
+  /// skinVertices. Only touches this character, so characters can be
+  /// updated on many threads at once.
+  /// </summary>
+  void updateLod(const AnimationLod& lod, const glm::vec3& eye);
+  inline AnimationLod::Tier lodTier() const { return tier; }
+
+  /// <summary>
+  /// World space bounding sphere as of the last pool update, xyz center and
+  /// w radius.
+  /// </summary>
+  glm::vec4 bounds() const;
+
+  void skinVertices(GLuint& writtenVertices) override;
+  void writeInstanceData(gl::MappingRef& instanceMap, GLuint& writtenInstances,
+                         gl::MappingRef& textureMap) override;
+
+  /// <summary>
+  /// Hands this frame's transform to the skinning batch. Only touches this
+  /// character's instance, so characters can be updated on many threads at
+  /// once.
+  /// </summary>
+  void writeTransform();
+  /// <summary>
+  /// Gives the batch the texture handles of the character's pose, if no
+  /// character on it has yet. Main thread only, as it touches residency.
+  /// </summary>
+  void writeTextures();
+
+protected:
+  std::shared_ptr<const SkinnedMesh> mesh;
+  TextureResidency& textures;
+  SkinningBatch& skinning;
+
+  ScenePool& scene;
+  ScenePool::Handle node;
+
+  // This frame's instance in the skinning batch
+  SkinningBatch::Instance instance = 0;
+  AnimationLod::Tier tier = AnimationLod::Tier::FULL;
+  // The step the tier poses the character on
+  uint32_t poseStep = 0;
+};
@@ -0,0 +1,62 @@
+#include "clusteredLighting.hpp"
+
+namespace {
+  // The light count, then its indices
+  constexpr GLuint CLUSTER_SIZE =
+      (ClusteredLighting::MAX_CLUSTER_LIGHTS + 1) *
+      static_cast<GLuint>(sizeof(GLuint));
+  constexpr GLuint SIDE_SIZE = ClusteredLighting::CLUSTER_COUNT * CLUSTER_SIZE;
+} // namespace
+
+std::expected<ClusteredLighting, std::string>
+ClusteredLighting::create(ProgramCache& programs, float zNear, float zFar) {
+  auto binOpt = programs.load({
+      {SHADERDIR "compute/cluster_lights.comp.glsl",
+       gl::Shader::Type::COMPUTE},
+  });
+  if (!binOpt) {
+    return std::unexpected(binOpt.error());
+  }
+
+  auto shadeOpt = programs.load({
+      {SHADERDIR "fullscreen.vert.glsl", gl::Shader::Type::VERTEX},
+      {SHADERDIR "lighting/clustered.frag.glsl", gl::Shader::Type::FRAGMENT},
+  });
+  if (!shadeOpt) {
+    return std::unexpected(shadeOpt.error());
+  }
+
+  return ClusteredLighting(std::move(*binOpt), std::move(*shadeOpt), zNear,
+                           zFar);
+}
+
+ClusteredLighting::ClusteredLighting(gl::Program&& binProgram,
+                                     gl::Program&& shadeProgram, float zNear,
+                                     float zFar)
+    : binProgram(std::move(binProgram)),
+      shadeProgram(std::move(shadeProgram)), zNear(zNear), zFar(zFar) {
+  clusters.label("Light Clusters");
+  clusters.init(SIDE_SIZE * SIDES);
+}
+
+void ClusteredLighting::bin(GLuint side, GLuint first, GLuint count) {
+  binProgram.bind();
+  clusters.bindRange(gl::Buffer::StorageTarget::STORAGE, 2, side * SIDE_SIZE,
+                     SIDE_SIZE);
+  glUniform1ui(0, first);
+  glUniform1ui(1, count);
+  glUniform1f(2, zNear);
+  glUniform1f(3, zFar);
+  glDispatchCompute((CLUSTER_COUNT + BIN_GROUP_SIZE - 1) / BIN_GROUP_SIZE, 1,
+                    1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void ClusteredLighting::shade(GLuint side) {
+  shadeProgram.bind();
+  clusters.bindRange(gl::Buffer::StorageTarget::STORAGE, 2, side * SIDE_SIZE,
+                     SIDE_SIZE);
+  glUniform1f(0, zNear);
+  glUniform1f(1, zFar);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
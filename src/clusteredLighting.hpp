@@ -0,0 +1,68 @@
+#pragma once
+
+#include "programCache.hpp"
+#include <expected>
+#include <gl/gl.hpp>
+#include <string>
+
+/// <summary>
+/// Deferred lighting that shades each pixel against only the lights that can
+/// reach it, in one full screen pass per camera instead of one volume draw
+/// per light.
+///
+/// The camera's view is split into TILES_X by TILES_Y tiles of its viewport
+/// and SLICES exponential depth slices. A compute pass bins every light's
+/// bounding sphere into the clusters it touches. The full screen pass then
+/// reads the G-buffer once per pixel and loops over its cluster's list, so
+/// adding a light costs a few more loop iterations where it shines rather
+/// than another full read of the G-buffer.
+/// </summary>
+class ClusteredLighting {
+public:
+  /// Must match cluster_lights.comp.glsl and clustered.frag.glsl
+  constexpr static GLuint TILES_X = 16;
+  constexpr static GLuint TILES_Y = 9;
+  constexpr static GLuint SLICES = 24;
+  /// Lights past this many in one cluster are dropped
+  constexpr static GLuint MAX_CLUSTER_LIGHTS = 64;
+  constexpr static GLuint CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+  /// Must match local_size_x in cluster_lights.comp.glsl
+  constexpr static GLuint BIN_GROUP_SIZE = 64;
+  /// One list per camera
+  constexpr static GLuint SIDES = 2;
+
+  static std::expected<ClusteredLighting, std::string>
+  create(ProgramCache& programs, float zNear, float zFar);
+
+  ClusteredLighting() = default;
+  ClusteredLighting(const ClusteredLighting&) = delete;
+  ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+  ClusteredLighting(ClusteredLighting&&) noexcept = default;
+  ClusteredLighting& operator=(ClusteredLighting&&) noexcept = default;
+
+  /// <summary>
+  /// Bins lights [first, first + count) of the LightData buffer bound to
+  /// storage binding 1 into side's clusters, for the camera bound to uniform
+  /// binding 0.
+  /// </summary>
+  void bin(GLuint side, GLuint first, GLuint count);
+
+  /// <summary>
+  /// Shades the bound camera's viewport from side's clusters. The G-buffer
+  /// must be bound to units 0 to 3, the light buffer to storage binding 1
+  /// and a VAO for the full screen triangle.
+  /// </summary>
+  void shade(GLuint side);
+
+private:
+  ClusteredLighting(gl::Program&& binProgram, gl::Program&& shadeProgram,
+                    float zNear, float zFar);
+
+  gl::Program binProgram;
+  gl::Program shadeProgram;
+  float zNear = 0.1f;
+  float zFar = 1.0f;
+
+  /// GPU only, each side's clusters one after the other
+  gl::Buffer clusters;
+};
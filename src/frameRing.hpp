@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <gl/gl.hpp>
+#include <optional>
+
+/// <summary>
+/// Persistently mapped buffer split into FRAMES regions, one per frame in
+/// flight. A frame sub-allocates the data of each of its passes from its own
+/// region, so no pass overwrites anything an earlier one, or an earlier
+/// frame, still has queued.
+///
+/// The end of every frame is fenced, and begin only waits on the fence of
+/// the frame that last used the region it is about to hand out. So the CPU
+/// can run up to FRAMES - 1 frames ahead of the GPU before it ever blocks.
+/// </summary>
+class FrameRing {
+public:
+  constexpr static GLuint FRAMES = 3;
+
+  explicit FrameRing(const char* name) : name(name) {}
+
+  FrameRing(const FrameRing&) = delete;
+  FrameRing& operator=(const FrameRing&) = delete;
+
+  ~FrameRing() {
+    for (auto& fence : fences) {
+      if (fence) {
+        glDeleteSync(fence);
+      }
+    }
+  }
+
+  /// <summary>
+  /// Moves on to the next region, waiting for the GPU to finish with it,
+  /// and makes sure it holds at least size bytes. Growing waits for every
+  /// region, so it should only happen while the scene is loading or its
+  /// size changes.
+  /// </summary>
+  void begin(GLuint size) {
+    frame = (frame + 1) % FRAMES;
+    wait(frame);
+
+    if (size > regionSize) {
+      for (GLuint i = 0; i < FRAMES; ++i) {
+        wait(i);
+      }
+      // Leave some room so small changes do not reallocate every frame
+      regionSize = gl::Buffer::roundToAlignment(
+          size + size / 4, gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+      buffer = {};
+      buffer.label(name);
+      buffer.init(regionSize * FRAMES, nullptr,
+                  gl::Buffer::Usage::WRITE | gl::Buffer::Usage::PERSISTENT |
+                      gl::Buffer::Usage::COHERENT);
+      mapping = buffer.map(gl::Buffer::Mapping::WRITE |
+                           gl::Buffer::Mapping::PERSISTENT |
+                           gl::Buffer::Mapping::COHERENT);
+    }
+
+    head = 0;
+  }
+
+  /// <summary>
+  /// Reserves size bytes of this frame's region.
+  /// </summary>
+  /// <returns>The offset into the buffer, or nullopt if the region is
+  /// full</returns>
+  std::optional<GLuint>
+  allocate(GLuint size,
+           GLuint alignment = gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT) {
+    GLuint start = gl::Buffer::roundToAlignment(head, alignment);
+    if (start + size > regionSize) {
+      return std::nullopt;
+    }
+    head = start + size;
+    return frame * regionSize + start;
+  }
+
+  /// <summary>
+  /// Fences everything written this frame. Call once every command reading
+  /// from the region has been issued.
+  /// </summary>
+  void end() {
+    if (fences[frame]) {
+      glDeleteSync(fences[frame]);
+    }
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  inline gl::MappingRef ref(GLuint offset) { return {mapping, offset}; }
+  inline gl::Mapping& getMapping() { return mapping; }
+  inline const gl::Buffer& getBuffer() const { return buffer; }
+
+private:
+  void wait(GLuint region) {
+    if (!fences[region]) {
+      return;
+    }
+    glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT,
+                     GL_TIMEOUT_IGNORED);
+    glDeleteSync(fences[region]);
+    fences[region] = nullptr;
+  }
+
+  const char* name;
+  GLuint frame = 0;
+  GLuint regionSize = 0;
+  GLuint head = 0;
+
+  gl::Buffer buffer;
+  gl::Mapping mapping;
+
+  std::array<GLsync, FRAMES> fences = {};
+};
@@ -6,43 +6,40 @@
 #include <engine\image.hpp>
 
 std::expected<Heightmap, std::string>
-Heightmap::fromFile(std::string_view heightFile, std::string_view diffuseFile,
-                    std::string_view normalFile) {
+Heightmap::fromFile(ResourceCache& resources, std::string_view heightFile,
+                    std::string_view diffuseFile, std::string_view normalFile) {
   Logger::debug("Loading heightmap from heightFile: {}", heightFile);
-  auto heightImgRes = engine::Image::fromFile(heightFile, true, 1);
+  auto heightTexRes = resources.texture(
+      heightFile, {true, TexturePack::Role::HEIGHT});
 
-  if (!heightImgRes.has_value()) {
-    return std::unexpected(heightImgRes.error());
+  if (!heightTexRes.has_value()) {
+    return std::unexpected(heightTexRes.error());
   }
-  auto& heightImg = heightImgRes.value();
+  auto& heightTex = heightTexRes.value();
+  heightTex->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  heightTex->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  auto heightTex = heightImg.toTexture(-1);
-  heightTex.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  heightTex.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  auto diffuseTexRes = resources.texture(diffuseFile);
 
-  auto diffuseImgRes = engine::Image::fromFile(diffuseFile, true);
-
-  if (!diffuseImgRes.has_value()) {
-    return std::unexpected(diffuseImgRes.error());
+  if (!diffuseTexRes.has_value()) {
+    return std::unexpected(diffuseTexRes.error());
   }
-  auto& diffuseImg = diffuseImgRes.value();
-
-  auto diffuseTex = diffuseImg.toTexture(-1);
-  diffuseTex.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  diffuseTex.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  auto& diffuseTex = diffuseTexRes.value();
+  diffuseTex->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  diffuseTex->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  auto normalImgRes = engine::Image::fromFile(normalFile, true);
+  // The terrain normal map is world space with y up, so z can be negative and
+  // can't be rebuilt from a BC5 pair. It stays a colour (BC7) texture.
+  auto normalTexRes = resources.texture(normalFile);
 
-  if (!normalImgRes.has_value()) {
-    return std::unexpected(normalImgRes.error());
+  if (!normalTexRes.has_value()) {
+    return std::unexpected(normalTexRes.error());
   }
-  auto& normalImg = normalImgRes.value();
-
-  auto normalTex = normalImg.toTexture();
-  normalTex.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  normalTex.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  auto& normalTex = normalTexRes.value();
+  normalTex->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  normalTex->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  auto progOpt = gl::Program::fromFiles({
+  auto progOpt = resources.program({
       {SHADERDIR "heightmap/vert.glsl", gl::Shader::Type::VERTEX},
       {SHADERDIR "heightmap/tess_con.glsl", gl::Shader::Type::TESS_CONTROL},
       {SHADERDIR "heightmap/tess_eval.glsl", gl::Shader::Type::TESS_EVAL},
@@ -53,7 +50,7 @@ Heightmap::fromFile(std::string_view heightFile, std::string_view diffuseFile,
   }
   auto& prog = progOpt.value();
 
-  auto depthProgOpt = gl::Program::fromFiles(
+  auto depthProgOpt = resources.program(
       {{SHADERDIR "heightmap/vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "heightmap/tess_con.glsl", gl::Shader::Type::TESS_CONTROL},
        {SHADERDIR "heightmap/shadow.tess_eval.glsl",
@@ -65,7 +62,7 @@ Heightmap::fromFile(std::string_view heightFile, std::string_view diffuseFile,
   }
   auto& depthProg = depthProgOpt.value();
 
-  auto deptCubeProgOpt = gl::Program::fromFiles(
+  auto deptCubeProgOpt = resources.program(
       {{SHADERDIR "heightmap/vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "heightmap/tess_con.glsl", gl::Shader::Type::TESS_CONTROL},
        {SHADERDIR "heightmap/shadow_cube.tess_eval.glsl",
@@ -84,13 +81,13 @@ Heightmap::fromFile(std::string_view heightFile, std::string_view diffuseFile,
 }
 
 void Heightmap::render(const engine::Frustum& frustum) {
-  program.bind();
+  program->bind();
 
   auto bg = engine::globals::DUMMY_VAO.bindGuard();
 
-  heightTex.bind(0);
-  diffuseTex.bind(1);
-  normalTex.bind(2);
+  heightTex->bind(0);
+  diffuseTex->bind(1);
+  normalTex->bind(2);
 
   constexpr int chunksPerAxis = 7;
 
@@ -101,9 +98,9 @@ void Heightmap::render(const engine::Frustum& frustum) {
 }
 
 void Heightmap::renderDepthOnly(const engine::Frustum& frustum) {
-  depthProgram.bind();
+  depthProgram->bind();
   auto bg = engine::globals::DUMMY_VAO.bindGuard();
-  heightTex.bind(0);
+  heightTex->bind(0);
   constexpr int chunksPerAxis = 7;
   glPatchParameteri(GL_PATCH_VERTICES, 4);
   glDrawArrays(GL_PATCHES, 0, 4 * chunksPerAxis * chunksPerAxis);
@@ -111,9 +108,9 @@ void Heightmap::renderDepthOnly(const engine::Frustum& frustum) {
 }
 
 void Heightmap::renderDepthOnlyCube() {
-  depthProgram.bind();
+  depthProgram->bind();
   auto bg = engine::globals::DUMMY_VAO.bindGuard();
-  heightTex.bind(0);
+  heightTex->bind(0);
   constexpr int chunksPerAxis = 7;
   glPatchParameteri(GL_PATCH_VERTICES, 4);
   glDrawArrays(GL_PATCHES, 0, 4 * chunksPerAxis * chunksPerAxis);
@@ -1,41 +1,47 @@
 #pragma once
 
+#include "resourceCache.hpp"
 #include <engine/image.hpp>
 #include <engine/scene_node.hpp>
 #include <expected>
 #include <gl/gl.hpp>
+#include <memory>
 #include <string>
 #include <string_view>
 
 class Heightmap : public engine::scene::Node {
-  Heightmap(gl::Texture&& heightTex, gl::Texture&& diffuseTex,
-            gl::Texture&& normalTex, gl::Program&& prog,
-            gl::Program&& depthProg, gl::Program&& depthCubeProg)
+  Heightmap(std::shared_ptr<gl::Texture> heightTex,
+            std::shared_ptr<gl::Texture> diffuseTex,
+            std::shared_ptr<gl::Texture> normalTex,
+            std::shared_ptr<gl::Program> prog,
+            std::shared_ptr<gl::Program> depthProg,
+            std::shared_ptr<gl::Program> depthCubeProg)
       : heightTex(std::move(heightTex)), diffuseTex(std::move(diffuseTex)),
         normalTex(std::move(normalTex)), program(std::move(prog)),
         depthProgram(std::move(depthProg)),
         depthCubeProgram(std::move(depthCubeProg)),
         engine::scene::Node(engine::scene::Node::RenderType::LIT, true) {
-    std::vector<gl::RawTextureHandle> handles = {this->heightTex.rawHandle(),
-                                                 this->diffuseTex.rawHandle()};
+    std::vector<gl::RawTextureHandle> handles = {
+        this->heightTex->rawHandle(), this->diffuseTex->rawHandle()};
     SetBoundingRadius(1250.0f);
   }
 
 public:
   static std::expected<Heightmap, std::string>
-  fromFile(std::string_view heightFile, std::string_view diffuseFile,
-           std::string_view normalFile);
+  fromFile(ResourceCache& resources, std::string_view heightFile,
+           std::string_view diffuseFile, std::string_view normalFile);
 
   void render(const engine::Frustum& frustum) override;
   void renderDepthOnly(const engine::Frustum& frustum) override;
   void renderDepthOnlyCube() override;
 
 protected:
-  gl::Texture heightTex;
-  gl::Texture diffuseTex;
-  gl::Texture normalTex;
+  // Shared with every other heightmap built from the same files
+  std::shared_ptr<gl::Texture> heightTex;
+  std::shared_ptr<gl::Texture> diffuseTex;
+  std::shared_ptr<gl::Texture> normalTex;
 
-  gl::Program program;
-  gl::Program depthProgram;
-  gl::Program depthCubeProgram;
+  std::shared_ptr<gl::Program> program;
+  std::shared_ptr<gl::Program> depthProgram;
+  std::shared_ptr<gl::Program> depthCubeProgram;
 };
\ No newline at end of file
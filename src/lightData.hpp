@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <gl/gl.hpp>
+#include <glm/glm.hpp>
+
+/// <summary>
+/// One light as the lighting passes read it from the frame's light buffer.
+/// Matches the std430 layout of Light in the lighting shaders.
+/// </summary>
+struct LightData {
+  /// Position in xyz, radius in w
+  glm::vec4 sphere;
+  glm::vec4 color;
+  /// Spot direction in xyz, w is 1 for spot lights
+  glm::vec4 direction;
+  /// Edge of each of the light's tiles in the shadow atlas, 0 if it has none
+  GLuint tileSize = 0;
+  /// Atlas origin of each tile as ShadowAtlas::Tile::packed, one per cube
+  /// face for point lights. Spot lights only use the first
+  std::array<GLuint, 6> tiles = {};
+  GLuint pad = 0;
+  /// Spot lights only
+  glm::mat4 shadowMatrix;
+};
+
+static_assert(sizeof(LightData) == 144);
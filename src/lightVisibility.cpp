@@ -0,0 +1,116 @@
+#include "lightVisibility.hpp"
+
+#include <algorithm>
+#include <glm/ext/matrix_transform.hpp>
+
+namespace {
+  class LightProxy : public engine::scene::Node {
+  public:
+    LightProxy(size_t light, const glm::vec4& sphere)
+        : engine::scene::Node(engine::scene::Node::RenderType::LIT),
+          light(light) {
+      SetTransform(glm::translate(glm::mat4(1.0f), glm::vec3(sphere)));
+      SetBoundingRadius(sphere.w);
+    }
+
+    size_t light;
+  };
+} // namespace
+
+std::shared_ptr<engine::scene::Node>
+LightVisibility::proxy(size_t light, const glm::vec4& sphere) {
+  return std::make_shared<LightProxy>(light, sphere);
+}
+
+LightVisibility::~LightVisibility() {
+  for (auto& slot : slots) {
+    glDeleteQueries(static_cast<GLsizei>(slot.queries.size()),
+                    slot.queries.data());
+  }
+}
+
+void LightVisibility::beginFrame(size_t count) {
+  // Answers from before a light left view say nothing about it once it is
+  // back, so they are forgotten, along with any still to come
+  for (size_t light = 0; light < inView.size(); ++light) {
+    if (!inView[light]) {
+      hiddenAnswers[light] = 0;
+      answeredFrames[light] = frame;
+    }
+  }
+  inView.assign(count, 0);
+  hiddenAnswers.resize(count, 0);
+  answeredFrames.resize(count, 0);
+
+  // Oldest first, so answers are counted in order
+  for (size_t i = 1; i <= FRAME_LATENCY; ++i) {
+    resolve(slots[(current + i) % FRAME_LATENCY]);
+  }
+
+  current = (current + 1) % FRAME_LATENCY;
+  auto& slot = slots[current];
+  // A query still running this many frames on is dropped, as a newer one
+  // will answer first
+  std::ranges::fill(slot.pending, 0);
+  slot.pending.resize(count, 0);
+  if (slot.queries.size() < count) {
+    size_t created = slot.queries.size();
+    slot.queries.resize(count);
+    glCreateQueries(GL_ANY_SAMPLES_PASSED_CONSERVATIVE,
+                    static_cast<GLsizei>(count - created),
+                    slot.queries.data() + created);
+  }
+  slot.frame = frame++;
+}
+
+void LightVisibility::markInView(const engine::scene::Node& lightProxy) {
+  size_t light = static_cast<const LightProxy&>(lightProxy).light;
+  if (light < inView.size()) {
+    inView[light] = 1;
+  }
+}
+
+void LightVisibility::test(size_t light, const std::function<void()>& draw) {
+  auto& slot = slots[current];
+  if (light >= slot.queries.size()) {
+    draw();
+    return;
+  }
+
+  glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, slot.queries[light]);
+  draw();
+  glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+  slot.pending[light] = 1;
+}
+
+size_t LightVisibility::visibleCount() const {
+  size_t count = 0;
+  for (size_t light = 0; light < inView.size(); ++light) {
+    count += visible(light) ? 1 : 0;
+  }
+  return count;
+}
+
+void LightVisibility::resolve(Slot& slot) {
+  size_t count = std::min(slot.pending.size(), hiddenAnswers.size());
+  for (size_t light = 0; light < count; ++light) {
+    if (!slot.pending[light]) {
+      continue;
+    }
+
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(slot.queries[light], GL_QUERY_RESULT_AVAILABLE,
+                        &available);
+    if (!available) {
+      continue;
+    }
+
+    GLuint passed = GL_FALSE;
+    glGetQueryObjectuiv(slot.queries[light], GL_QUERY_RESULT, &passed);
+    slot.pending[light] = 0;
+    if (slot.frame + 1 > answeredFrames[light]) {
+      hiddenAnswers[light] = passed ? 0 : hiddenAnswers[light] + 1;
+      answeredFrames[light] = slot.frame + 1;
+    }
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <engine/scene_node.hpp>
+#include <functional>
+#include <gl/gl.hpp>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+/// <summary>
+/// Tracks which lights reach anything on screen, so a light whose influence
+/// is entirely off screen can skip its shadows.
+///
+/// Each frame, every light's sphere is tested against its camera's frustum
+/// through a graph of proxy nodes, so a light coming into view is drawn the
+/// frame it arrives. Lights in view are also drawn against the G-buffer's
+/// depth inside a GL_ANY_SAMPLES_PASSED_CONSERVATIVE query. Like the
+/// profiler's, queries live in a ring of FRAME_LATENCY frames and are only
+/// read once available, so their answers are a frame or two old. Only a
+/// light every answer has found hidden for FRAME_LATENCY frames in a row is
+/// treated as hidden by them.
+/// </summary>
+class LightVisibility {
+public:
+  constexpr static uint32_t FRAME_LATENCY = 4;
+
+  /// <summary>
+  /// A node standing in for the light's sphere, for a graph of them to be
+  /// culled against a camera with Graph::BuildNodeLists. Never drawn.
+  /// </summary>
+  static std::shared_ptr<engine::scene::Node> proxy(size_t light,
+                                                    const glm::vec4& sphere);
+
+  LightVisibility() = default;
+  ~LightVisibility();
+
+  LightVisibility(const LightVisibility&) = delete;
+  LightVisibility& operator=(const LightVisibility&) = delete;
+
+  /// <summary>
+  /// Reads back every query that has finished, then starts a new frame of
+  /// queries for count lights, none of them in view until marked.
+  /// </summary>
+  void beginFrame(size_t count);
+  /// <summary>
+  /// Marks the light a node from proxy stands in for as inside a camera's
+  /// frustum this frame.
+  /// </summary>
+  void markInView(const engine::scene::Node& lightProxy);
+  /// <summary>
+  /// Runs draw inside the light's query for this frame.
+  /// </summary>
+  void test(size_t light, const std::function<void()>& draw);
+
+  /// Whether the light was marked in view this frame
+  inline bool inFrustum(size_t light) const {
+    return light < inView.size() && inView[light] != 0;
+  }
+  /// Whether the light is in view and not long hidden behind the scene
+  inline bool visible(size_t light) const {
+    return inFrustum(light) && hiddenAnswers[light] < FRAME_LATENCY;
+  }
+  size_t visibleCount() const;
+
+private:
+  struct Slot {
+    uint64_t frame = 0;
+    std::vector<GLuint> queries;
+    // Whether each light's query was issued and not yet read
+    std::vector<uint8_t> pending;
+  };
+
+  void resolve(Slot& slot);
+
+  std::array<Slot, FRAME_LATENCY> slots;
+  size_t current = 0;
+  uint64_t frame = 0;
+
+  std::vector<uint8_t> inView;
+  // Queries in a row that found each light hidden
+  std::vector<uint32_t> hiddenAnswers;
+  // One past the frame each light's latest answer came from, 0 for none
+  std::vector<uint64_t> answeredFrames;
+};
@@ -1,9 +1,32 @@
 #include "logger/logger.hpp"
 #include "renderer.hpp"
 
-int main() {
+int main(int argc, char** argv) {
   Logger::info("Starting application...");
 
+  auto benchmark = Benchmark::parse(argc, argv);
+  if (!benchmark) {
+    Logger::error("{}. Usage: CSC8502-Coursework [--benchmark] "
+                  "[--timestep <seconds>] [--output <path>]",
+                  benchmark.error());
+    return -1;
+  }
+
+  if (*benchmark) {
+#ifdef GLFW_PLATFORM_NULL
+    // No display needed. The null platform gets its context from Mesa's
+    // llvmpipe (OSMesa, or EGL surfaceless for an EGL context), and only the
+    // final copy to the invisible window is wasted work
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+    Logger::error("GLFW has no null platform, so benchmarks cannot run "
+                  "without a display. Build against GLFW 3.4 or newer");
+    return -1;
+#endif
+    Logger::info("Benchmarking the camera track at {}s per frame",
+                 (*benchmark)->timestep);
+  }
+
   {
     auto err = engine::loadPreInitEnginePlugins();
     if (err.has_value()) {
@@ -12,7 +35,7 @@ int main() {
     }
   }
 
-  Renderer app(800, 600, "CSC8502 IGNORE");
+  Renderer app(800, 600, "CSC8502 IGNORE", std::move(*benchmark));
 
   if (!app.shouldBail()) {
     Logger::info("Initialization successful, entering main loop");
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <span>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Read only memory mapping of a whole file. The view stays valid for the
+/// lifetime of the object, and pages are only read in as they are touched.
+/// </summary>
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept
+      : view(std::exchange(other.view, nullptr)),
+        length(std::exchange(other.length, 0)) {}
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      unmap();
+      view = std::exchange(other.view, nullptr);
+      length = std::exchange(other.length, 0);
+    }
+    return *this;
+  }
+
+  ~MappedFile() { unmap(); }
+
+  static std::expected<MappedFile, std::string> open(const std::string& path) {
+    MappedFile file;
+
+#ifdef _WIN32
+    HANDLE handle =
+        CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+      return std::unexpected("Failed to open " + path);
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+      CloseHandle(handle);
+      return std::unexpected("Failed to get the size of " + path);
+    }
+
+    HANDLE mapping =
+        CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(handle);
+    if (!mapping) {
+      return std::unexpected("Failed to map " + path);
+    }
+
+    file.view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!file.view) {
+      return std::unexpected("Failed to map a view of " + path);
+    }
+    file.length = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return std::unexpected("Failed to open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return std::unexpected("Failed to get the size of " + path);
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+      return std::unexpected("Failed to map " + path);
+    }
+
+    file.view = view;
+    file.length = static_cast<size_t>(st.st_size);
+#endif
+
+    return file;
+  }
+
+  inline std::span<const std::byte> bytes() const {
+    return {static_cast<const std::byte*>(view), length};
+  }
+  inline size_t size() const { return length; }
+
+private:
+  void unmap() {
+    if (!view) {
+      return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+#else
+    munmap(view, length);
+#endif
+    view = nullptr;
+    length = 0;
+  }
+
+  void* view = nullptr;
+  size_t length = 0;
+};
@@ -0,0 +1,318 @@
+#include "meshPack.hpp"
+
+#include "logger/logger.hpp"
+#include "packedVertex.hpp"
+#include <cstring>
+#include <engine/mesh/mesh.hpp>
+#include <engine/mesh/mesh_material.hpp>
+#include <filesystem>
+#include <fstream>
+#include <gl/gl.hpp>
+
+namespace {
+  uint64_t alignSection(uint64_t offset) {
+    return (offset + MeshPack::SECTION_ALIGNMENT - 1) /
+           MeshPack::SECTION_ALIGNMENT * MeshPack::SECTION_ALIGNMENT;
+  }
+
+  // The engine's Animation does not expose the playback rate, but it is the
+  // fifth token of the text header: MeshAnim <version> <joints> <frames> <fps>
+  std::expected<float, std::string> readFrameRate(const std::string& path) {
+    std::ifstream file(path);
+    std::string magic;
+    uint32_t version, joints, frames;
+    float frameRate;
+    if (!(file >> magic >> version >> joints >> frames >> frameRate) ||
+        magic != "MeshAnim") {
+      return std::unexpected(
+          fmt::format("Failed to read animation header from {}", path));
+    }
+    return frameRate;
+  }
+
+  uint32_t addString(std::string& strings, std::optional<std::string> str) {
+    if (!str) {
+      return MeshPack::NO_STRING;
+    }
+    auto offset = static_cast<uint32_t>(strings.size());
+    strings += *str;
+    strings += '\0';
+    return offset;
+  }
+} // namespace
+
+std::expected<MeshPack, std::string> MeshPack::open(const std::string& path) {
+  auto fileRes = MappedFile::open(path);
+  if (!fileRes) {
+    return std::unexpected(fileRes.error());
+  }
+
+  MeshPack pack;
+  pack.file = std::move(*fileRes);
+  if (auto res = pack.bind(pack.file.bytes()); !res) {
+    return std::unexpected(fmt::format("{}: {}", path, res.error()));
+  }
+  return pack;
+}
+
+std::expected<MeshPack, std::string> MeshPack::load(const std::string& path,
+                                                    const Sources& sources) {
+  if (isUpToDate(path, sources)) {
+    auto pack = open(path);
+    if (pack) {
+      return pack;
+    }
+    Logger::info("Rebuilding mesh pack: {}", pack.error());
+  } else {
+    Logger::info("Mesh pack {} is missing or stale, rebuilding", path);
+  }
+
+  auto bytes = build(sources);
+  if (!bytes) {
+    return std::unexpected(bytes.error());
+  }
+
+  if (auto res = write(path, *bytes); !res) {
+    Logger::error("Failed to save mesh pack: {}", res.error());
+  } else if (auto pack = open(path)) {
+    return pack;
+  }
+
+  MeshPack pack;
+  pack.owned = std::move(*bytes);
+  if (auto res = pack.bind(pack.owned); !res) {
+    return std::unexpected(res.error());
+  }
+  return pack;
+}
+
+std::expected<std::vector<std::byte>, std::string>
+MeshPack::build(const Sources& sources) {
+  auto dataRes = engine::mesh::Data::fromFile(sources.mesh);
+  if (!dataRes) {
+    return std::unexpected(dataRes.error());
+  }
+  const auto& data = *dataRes;
+
+  Header header;
+  header.vertexStride = sizeof(PackedWeightedVertex);
+  header.vertexCount = static_cast<uint32_t>(data.vertices().size());
+  header.indexCount = static_cast<uint32_t>(data.indices().size());
+  header.layerCount = static_cast<uint32_t>(data.meshLayers().size());
+
+  std::optional<engine::mesh::Animation> anim;
+  if (!sources.animation.empty()) {
+    auto frameRate = readFrameRate(sources.animation);
+    if (!frameRate) {
+      return std::unexpected(frameRate.error());
+    }
+    anim.emplace(sources.animation);
+    header.jointCount = anim->GetJointCount();
+    header.frameCount = anim->GetFrameCount();
+    header.frameRate = *frameRate;
+  }
+
+  std::optional<engine::mesh::Material> material;
+  if (!sources.material.empty()) {
+    material.emplace(sources.material);
+  }
+
+  std::vector<Layer> layers;
+  std::string strings;
+  for (uint32_t i = 0; i < header.layerCount; ++i) {
+    const auto& subMesh = data.meshLayers()[i];
+    Layer layer = {static_cast<uint32_t>(subMesh.start),
+                   static_cast<uint32_t>(subMesh.count)};
+
+    if (material) {
+      if (auto entry = material->GetMaterialForLayer(static_cast<int>(i))) {
+        auto get = [&](const char* name) -> std::optional<std::string> {
+          if (auto path = entry->GetEntry(name)) {
+            return std::string(path->data());
+          }
+          return std::nullopt;
+        };
+        layer.diffuse = addString(strings, get("Diffuse"));
+        layer.normal = addString(strings, get("Normal"));
+        layer.material = addString(strings, get("Material"));
+      }
+    }
+
+    layers.push_back(layer);
+  }
+
+  uint64_t offset = alignSection(sizeof(Header));
+  auto place = [&](Section& section, uint64_t size) {
+    section = {offset, size};
+    offset = alignSection(offset + size);
+  };
+  place(header.vertices,
+        uint64_t(header.vertexCount) * sizeof(PackedWeightedVertex));
+  place(header.indices, uint64_t(header.indexCount) * sizeof(uint32_t));
+  place(header.joints, uint64_t(header.jointCount) * header.frameCount *
+                           sizeof(glm::mat4));
+  place(header.layers, layers.size() * sizeof(Layer));
+  place(header.strings, strings.size());
+
+  // Lay the index and joint sections out at their file offsets so their
+  // readback lands in place. The engine's vertices are bigger than the packed
+  // ones, so they go after everything else and are packed on the way out
+  auto rawVertexOffset =
+      static_cast<GLuint>(header.joints.offset + header.joints.size);
+  auto rawVertexSize = static_cast<GLuint>(
+      header.vertexCount * sizeof(engine::mesh::WeightedVertex));
+  auto gpuSize = rawVertexOffset + rawVertexSize;
+  std::vector<std::byte> bytes(offset);
+  std::vector<engine::mesh::WeightedVertex> rawVertices(header.vertexCount);
+  {
+    engine::mesh::Mesh mesh(data, {});
+
+    gl::Buffer scratch(gpuSize, nullptr,
+                       gl::Buffer::Usage::WRITE | gl::Buffer::Usage::DYNAMIC);
+    {
+      auto mapping = scratch.map(gl::Buffer::Mapping::WRITE);
+
+      GLuint written = 0;
+      gl::MappingRef vertices = {mapping, rawVertexOffset};
+      mesh.writeVertexData(data, written, vertices);
+
+      auto indexOffset = static_cast<GLuint>(header.indices.offset);
+      gl::MappingRef indices = {mapping, indexOffset};
+      mesh.writeIndexData(data, indexOffset, indices);
+
+      if (anim) {
+        gl::MappingRef joints = {mapping,
+                                 static_cast<GLuint>(header.joints.offset)};
+        mesh.writeJointData(data, *anim, joints, 0);
+      }
+    }
+
+    glGetNamedBufferSubData(scratch.id(), 0, rawVertexOffset, bytes.data());
+    glGetNamedBufferSubData(scratch.id(), rawVertexOffset, rawVertexSize,
+                            rawVertices.data());
+  }
+
+  auto packedVertices = reinterpret_cast<PackedWeightedVertex*>(
+      bytes.data() + header.vertices.offset);
+  for (size_t i = 0; i < rawVertices.size(); ++i) {
+    auto packed = PackedWeightedVertex::pack(rawVertices[i]);
+    if (!packed) {
+      return std::unexpected(packed.error());
+    }
+    packedVertices[i] = *packed;
+  }
+
+  std::memcpy(bytes.data(), &header, sizeof(Header));
+  std::memcpy(bytes.data() + header.layers.offset, layers.data(),
+              header.layers.size);
+  std::memcpy(bytes.data() + header.strings.offset, strings.data(),
+              header.strings.size);
+
+  return bytes;
+}
+
+std::expected<void, std::string>
+MeshPack::write(const std::string& path, std::span<const std::byte> bytes) {
+  // Write next to the target and swap it in, so a crash never leaves a
+  // truncated pack that looks up to date
+  auto tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return std::unexpected("Failed to open " + tmp + " for writing");
+    }
+    file.write(reinterpret_cast<const char*>(bytes.data()),
+               static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+      return std::unexpected("Failed to write " + tmp);
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return std::unexpected("Failed to replace " + path);
+  }
+  return {};
+}
+
+bool MeshPack::isUpToDate(const std::string& path, const Sources& sources) {
+  std::error_code ec;
+  auto packTime = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return false;
+  }
+
+  for (const auto& source :
+       {sources.mesh, sources.animation, sources.material}) {
+    if (source.empty()) {
+      continue;
+    }
+    auto sourceTime = std::filesystem::last_write_time(source, ec);
+    if (ec || sourceTime > packTime) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::span<const MeshPack::Layer> MeshPack::layers() const {
+  auto s = section(hdr->layers);
+  return {reinterpret_cast<const Layer*>(s.data()), hdr->layerCount};
+}
+
+std::optional<std::string_view> MeshPack::string(uint32_t offset) const {
+  if (offset == NO_STRING || offset >= hdr->strings.size) {
+    return std::nullopt;
+  }
+  return std::string_view(
+      reinterpret_cast<const char*>(bytes.data() + hdr->strings.offset +
+                                    offset));
+}
+
+std::expected<void, std::string>
+MeshPack::bind(std::span<const std::byte> data) {
+  if (data.size() < sizeof(Header)) {
+    return std::unexpected("File is too small to be a mesh pack");
+  }
+
+  auto header = reinterpret_cast<const Header*>(data.data());
+  if (header->magic != MAGIC) {
+    return std::unexpected("Not a mesh pack");
+  }
+  if (header->version != VERSION) {
+    return std::unexpected(fmt::format("Unsupported mesh pack version {}",
+                                       header->version));
+  }
+  if (header->vertexStride != sizeof(PackedWeightedVertex)) {
+    return std::unexpected("Mesh pack was written with a different vertex "
+                           "layout");
+  }
+
+  auto expect = [&](const Section& s, uint64_t size) {
+    return s.size == size && s.offset % SECTION_ALIGNMENT == 0 &&
+           s.offset + s.size <= data.size();
+  };
+  uint64_t vertexSize = uint64_t(header->vertexCount) * header->vertexStride;
+  uint64_t indexSize = uint64_t(header->indexCount) * sizeof(uint32_t);
+  uint64_t jointSize =
+      uint64_t(header->jointCount) * header->frameCount * sizeof(glm::mat4);
+  uint64_t layerSize = uint64_t(header->layerCount) * sizeof(Layer);
+  if (!expect(header->vertices, vertexSize) ||
+      !expect(header->indices, indexSize) ||
+      !expect(header->joints, jointSize) ||
+      !expect(header->layers, layerSize) ||
+      !expect(header->strings, header->strings.size)) {
+    return std::unexpected("Mesh pack sections are out of bounds");
+  }
+  if (header->strings.size != 0 &&
+      data[header->strings.offset + header->strings.size - 1] !=
+          std::byte{0}) {
+    return std::unexpected("Mesh pack string table is not terminated");
+  }
+
+  bytes = data;
+  hdr = header;
+  return {};
+}
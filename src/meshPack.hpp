@@ -0,0 +1,146 @@
+#pragma once
+
+#include "mappedFile.hpp"
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Binary container holding everything setupMeshes needs from a .msh, .anm
+/// and .mat triple, already laid out the way the static mesh buffer expects.
+///
+/// The index and joint sections are the exact bytes the engine's
+/// Mesh::writeIndexData and writeJointData produce (uint32_t and one
+/// glm::mat4 per joint per frame). The vertex section is the engine's
+/// WeightedVertex output already converted to PackedWeightedVertex. So at
+/// runtime the file is memory mapped and the geometry copied straight into
+/// the staging buffer with no parsing at all.
+///
+/// Every section starts on a SECTION_ALIGNMENT boundary, and the file is
+/// native endian. Packs are produced offline by the meshpack tool, or by
+/// MeshPack::load the first time a pack is missing or out of date.
+/// </summary>
+class MeshPack {
+public:
+  constexpr static std::array<char, 4> MAGIC = {'M', 'P', 'A', 'K'};
+  constexpr static uint32_t VERSION = 2;
+  constexpr static uint32_t SECTION_ALIGNMENT = 256;
+  constexpr static uint32_t NO_STRING = ~0u;
+
+  struct Section {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+
+  struct Header {
+    std::array<char, 4> magic = MAGIC;
+    uint32_t version = VERSION;
+    /// sizeof(PackedWeightedVertex) when the pack was written
+    uint32_t vertexStride = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    uint32_t layerCount = 0;
+    /// Zero for meshes without an animation
+    uint32_t jointCount = 0;
+    uint32_t frameCount = 0;
+    float frameRate = 0.0f;
+    uint32_t padding = 0;
+
+    Section vertices;
+    Section indices;
+    Section joints;
+    Section layers;
+    Section strings;
+  };
+
+  /// <summary>
+  /// A sub mesh drawn with its own texture set. Texture paths are offsets
+  /// into the string section, or NO_STRING when the material has no entry.
+  /// </summary>
+  struct Layer {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t diffuse = NO_STRING;
+    uint32_t normal = NO_STRING;
+    uint32_t material = NO_STRING;
+  };
+
+  struct Sources {
+    std::string mesh;
+    /// Optional, leave empty for static meshes
+    std::string animation;
+    /// Optional, leave empty for meshes without textures
+    std::string material;
+  };
+
+  MeshPack(const MeshPack&) = delete;
+  MeshPack& operator=(const MeshPack&) = delete;
+  MeshPack(MeshPack&&) = default;
+  MeshPack& operator=(MeshPack&&) = default;
+
+  /// <summary>
+  /// Maps a pack from disk and validates its header.
+  /// </summary>
+  static std::expected<MeshPack, std::string> open(const std::string& path);
+
+  /// <summary>
+  /// Opens the pack at path if it is newer than every source, otherwise
+  /// rebuilds it from the sources and tries to write it back for next time.
+  /// Rebuilding needs a current GL context.
+  /// </summary>
+  static std::expected<MeshPack, std::string> load(const std::string& path,
+                                                   const Sources& sources);
+
+  /// <summary>
+  /// Parses the text formats and serializes them into a pack. The sections
+  /// are produced by the engine's own Mesh writers into a scratch buffer and
+  /// read back, so this needs a current GL context.
+  /// </summary>
+  static std::expected<std::vector<std::byte>, std::string>
+  build(const Sources& sources);
+
+  static std::expected<void, std::string>
+  write(const std::string& path, std::span<const std::byte> bytes);
+
+  /// <summary>
+  /// Whether the pack at path exists and is at least as new as its sources.
+  /// </summary>
+  static bool isUpToDate(const std::string& path, const Sources& sources);
+
+  inline const Header& header() const { return *hdr; }
+
+  inline std::span<const std::byte> vertices() const {
+    return section(hdr->vertices);
+  }
+  inline std::span<const std::byte> indices() const {
+    return section(hdr->indices);
+  }
+  inline std::span<const std::byte> joints() const {
+    return section(hdr->joints);
+  }
+  std::span<const Layer> layers() const;
+
+  std::optional<std::string_view> string(uint32_t offset) const;
+
+private:
+  MeshPack() = default;
+
+  // Validates the header and points the accessors at data
+  std::expected<void, std::string> bind(std::span<const std::byte> data);
+
+  inline std::span<const std::byte> section(const Section& s) const {
+    return bytes.subspan(s.offset, s.size);
+  }
+
+  MappedFile file;
+  // Only used when the pack was just built and could not be reopened
+  std::vector<std::byte> owned;
+
+  std::span<const std::byte> bytes;
+  const Header* hdr = nullptr;
+};
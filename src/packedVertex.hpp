@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <engine/mesh/mesh.hpp>
+#include <expected>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <string>
+
+// Compact vertex and instance layouts used by the batch path, in place of
+// the engine's all float WeightedVertex, Vertex and per instance mat4.
+//
+// UVs are halfs, and normals and tangents are octahedral encoded into a pair
+// of snorm16s. The tangent's handedness is folded into the sign of its
+// second component, which keeps it to one word and lets the batch VAO fetch
+// normal and tangent as a single normalized short4.
+
+/// <summary>
+/// Skinned output read by the batch VAO, 24 bytes instead of 48.
+/// </summary>
+struct PackedVertex {
+  /// Keeps the tangent's encoded second component away from zero, so its
+  /// sign survives. Must match TANGENT_BIAS in batch.vert.glsl
+  constexpr static float TANGENT_BIAS = 1.0f / 32767.0f;
+
+  std::array<float, 3> position;
+  /// Half float u, v
+  uint32_t texCoord;
+  /// Octahedral snorm16 pair
+  uint32_t normal;
+  /// See packTangent
+  uint32_t tangent;
+
+  static glm::vec2 octEncode(glm::vec3 n) {
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (n.z >= 0.0f) {
+      return {n.x, n.y};
+    }
+
+    // Fold the lower hemisphere over the diagonals
+    return {(1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)};
+  }
+
+  static uint32_t packNormal(const glm::vec3& n) {
+    return glm::packSnorm2x16(octEncode(n));
+  }
+
+  /// <summary>
+  /// Octahedral encodes xyz. The second component is remapped into
+  /// [TANGENT_BIAS, 1] and negated when w is negative.
+  /// </summary>
+  static uint32_t packTangent(const glm::vec4& t) {
+    glm::vec2 e = octEncode(glm::vec3(t));
+    float y = TANGENT_BIAS + (e.y * 0.5f + 0.5f) * (1.0f - TANGENT_BIAS);
+    return glm::packSnorm2x16(glm::vec2(e.x, t.w < 0.0f ? -y : y));
+  }
+};
+
+/// <summary>
+/// Static buffer input to skin.comp.glsl, 32 bytes instead of 80.
+/// </summary>
+struct PackedWeightedVertex {
+  /// Joint indices have to fit in a byte
+  constexpr static uint32_t MAX_JOINTS = 256;
+
+  std::array<float, 3> position;
+  uint32_t texCoord;
+  uint32_t normal;
+  uint32_t tangent;
+  /// unorm8 x4, summing to 255
+  uint32_t weights;
+  /// uint8 x4
+  uint32_t joints;
+
+  /// <summary>
+  /// Quantizes the weights to unorm8, handing the rounding error to the
+  /// heaviest so they still sum to one.
+  /// </summary>
+  static uint32_t packWeights(const glm::vec4& weights) {
+    std::array<int, 4> q;
+    int sum = 0;
+    int heaviest = 0;
+    for (int i = 0; i < 4; ++i) {
+      q[i] = static_cast<int>(
+          std::lround(std::clamp(weights[i], 0.0f, 1.0f) * 255.0f));
+      sum += q[i];
+      if (weights[i] > weights[heaviest]) {
+        heaviest = i;
+      }
+    }
+    if (sum != 0) {
+      q[heaviest] = std::clamp(q[heaviest] + 255 - sum, 0, 255);
+    }
+
+    uint32_t packed = 0;
+    for (int i = 0; i < 4; ++i) {
+      packed |= static_cast<uint32_t>(q[i]) << (8 * i);
+    }
+    return packed;
+  }
+
+  static std::expected<PackedWeightedVertex, std::string>
+  pack(const engine::mesh::WeightedVertex& v) {
+    uint32_t joints = 0;
+    for (int i = 0; i < 4; ++i) {
+      if (v.indices[i] < 0 || uint32_t(v.indices[i]) >= MAX_JOINTS) {
+        return std::unexpected("Joint index " + std::to_string(v.indices[i]) +
+                               " does not fit in a byte");
+      }
+      joints |= static_cast<uint32_t>(v.indices[i]) << (8 * i);
+    }
+
+    return PackedWeightedVertex{
+        {v.position.x, v.position.y, v.position.z},
+        glm::packHalf2x16(v.texCoord),
+        PackedVertex::packNormal(v.normal),
+        PackedVertex::packTangent(v.tangent),
+        packWeights(v.weights),
+        joints,
+    };
+  }
+};
+
+/// <summary>
+/// The top three rows of an affine model matrix, 48 bytes instead of 64.
+/// </summary>
+struct PackedTransform {
+  std::array<glm::vec4, 3> rows;
+
+  static PackedTransform pack(const glm::mat4& model) {
+    glm::mat4 t = glm::transpose(model);
+    return {{t[0], t[1], t[2]}};
+  }
+};
+
+static_assert(sizeof(PackedWeightedVertex) == 32);
+static_assert(sizeof(PackedVertex) == 24);
+static_assert(sizeof(PackedTransform) == 48);
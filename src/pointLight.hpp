@@ -1,5 +1,8 @@
 #pragma once
 
+#include "lightData.hpp"
+#include "shadowAtlas.hpp"
+#include <algorithm>
 #include <array>
 #include <engine/camera.hpp>
 #include <engine/frustum.hpp>
@@ -7,13 +10,15 @@
 #include <glm/glm.hpp>
 #include <glm\ext\matrix_clip_space.hpp>
 #include <glm\ext\matrix_transform.hpp>
+#include <optional>
+#include <span>
 
 class PointLight {
 public:
-  constexpr static int32_t SHADOW_MAP_SIZE = 4096;
+  constexpr static size_t FACES = 6;
 
   struct LightUniform {
-    glm::mat4 shadowMatrix[6];
+    glm::mat4 shadowMatrix[FACES];
     glm::vec3 position;
     float radius;
   };
@@ -25,89 +30,172 @@ public:
   };
 
   PointLight(const glm::vec3& position, const glm::vec4& color, float radius)
-      : m({position, radius, color}) {
-    setupShadowMap();
-  }
+      : m({position, radius, color}) {}
 
+  /// <summary>
+  /// Writes the light's entry in the frame's light buffer.
+  /// </summary>
   void writeInstanceData(const gl::MappingRef mapping) const {
-    mapping.write(&m, sizeof(InstanceData), 0);
+    LightData data = {
+        .sphere = glm::vec4(m.position, m.radius),
+        .color = m.color,
+        .direction = glm::vec4(0.0f),
+        .tileSize = tiles[0].size,
+        .shadowMatrix = glm::mat4(1.0f),
+    };
+    for (size_t face = 0; face < FACES; ++face) {
+      data.tiles[face] = tiles[face].packed();
+    }
+    mapping.write(&data, sizeof(LightData), 0);
   }
 
   constexpr static GLuint dataSize() {
-    return static_cast<GLuint>(sizeof(InstanceData));
-  }
-
-  inline static void setupVao(const gl::Vao& vao, const gl::Buffer& buffer,
-                              GLuint offset) {
-    vao.attribFormat(0, 3, GL_FLOAT, false, 0);
-    vao.attribFormat(1, 1, GL_FLOAT, false, offsetof(InstanceData, radius));
-    vao.attribFormat(2, 4, GL_FLOAT, false, offsetof(InstanceData, color));
-    vao.bindVertexBuffer(0, buffer.id(), offset, sizeof(InstanceData));
+    return static_cast<GLuint>(sizeof(LightData));
   }
 
   const glm::vec3& position() const { return m.position; }
   const glm::vec4& color() const { return m.color; }
   const float& radius() const { return m.radius; }
 
-  void setupShadowMap() {
-    shadowMap.storage(1, GL_DEPTH_COMPONENT24,
-                      gl::Texture::Size{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE});
-    shadowMap.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    shadowMap.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    shadowMapHandle = shadowMap.createHandle();
+  /// <summary>
+  /// Sets where in the shadow atlas each cube face is drawn this frame. No
+  /// tiles means no shadows.
+  /// </summary>
+  void setTiles(std::span<const ShadowAtlas::Tile> atlasTiles) {
+    std::array<ShadowAtlas::Tile, FACES> next = {};
+    std::copy_n(atlasTiles.begin(), std::min(atlasTiles.size(), FACES),
+                next.begin());
+    // Once moved, another light may draw over the old tiles before they
+    // come back, so nothing drawn before can be trusted
+    if (next != tiles) {
+      drawn = false;
+    }
+    tiles = next;
+  }
+  /// <summary>
+  /// Edge of the light's tiles in the atlas, 0 if it got no room and casts
+  /// no shadows.
+  /// </summary>
+  GLuint tileSize() const { return tiles[0].size; }
+
+  /// <summary>
+  /// Whether the tiles hold this light's shadows, as they have not moved
+  /// since it was last rendered.
+  /// </summary>
+  bool tilesDrawn() const { return drawn; }
+
+  /// <summary>
+  /// Whether the static tiles were rendered from casters other than those
+  /// version describes (see SceneIndex::version), or the tiles have moved
+  /// since.
+  /// </summary>
+  bool staticStale(uint64_t version) const {
+    return staticVersion != version || !drawn;
+  }
 
-    shadowFbo.attachTexture(GL_DEPTH_ATTACHMENT, shadowMap.id(), 0);
-    glNamedFramebufferDrawBuffer(shadowFbo.id(), GL_NONE);
-    glNamedFramebufferReadBuffer(shadowFbo.id(), GL_NONE);
+  /// <summary>
+  /// Renders the casters that never move into the atlas's static texture,
+  /// which the light's tiles are restored from each time they are redrawn.
+  /// </summary>
+  void renderStaticMap(const ShadowAtlas& atlas, std::function<void()> renderFn,
+                       const gl::MappingRef matrixMapping, uint64_t version) {
+    atlas.bindStatic();
+    for (const auto& tile : tiles) {
+      atlas.clearStatic(tile);
+    }
+    useTiles();
+
+    writeUniform(matrixMapping);
+    renderFn();
+
+    staticVersion = version;
+    drawn = true;
+    holdsStatic = false;
   }
 
-  void renderShadowMap(std::function<void()> renderFn,
-                       const gl::Mapping& matrixMapping) const {
+  /// <summary>
+  /// Whether renderShadowMap has anything to do, given whether a dynamic
+  /// caster is in range. With none in range now or last time, the tiles
+  /// already hold exactly the static casters.
+  /// </summary>
+  bool shadowStale(bool dynamic) const { return dynamic || !holdsStatic; }
+
+  /// <summary>
+  /// Restores the light's tiles from the static texture, then renders the
+  /// dynamic casters over them if any are in range.
+  /// </summary>
+  void renderShadowMap(const ShadowAtlas& atlas, std::function<void()> renderFn,
+                       const gl::MappingRef matrixMapping, bool dynamic) {
+    for (const auto& tile : tiles) {
+      atlas.restore(tile);
+    }
+    holdsStatic = !dynamic;
+    if (!dynamic) {
+      return;
+    }
+
+    atlas.bindLive();
+    useTiles();
+    writeUniform(matrixMapping);
+    renderFn();
+  }
 
+  /// <summary>
+  /// Each cube face's view projection, in the order the geometry shader
+  /// draws them and the lighting shaders read them.
+  /// </summary>
+  std::array<glm::mat4, FACES> faceViewProjs() const {
     glm::mat4 perspective =
         glm::perspective(glm::radians(90.0f), 1.0f, m.radius, .1f);
 
-    shadowFbo.bind();
-    glClearDepth(0.0f);
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    constexpr std::array<glm::vec3, 6> directions = {
+    constexpr std::array<glm::vec3, FACES> directions = {
         glm::vec3(1.0, 0.0, 0.0), glm::vec3(-1.0, 0.0, 0.0),
         glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, -1.0, 0.0),
         glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, 0.0, -1.0),
     };
 
-    LightUniform uniformData = {};
-    uniformData.position = m.position;
-    uniformData.radius = m.radius;
-
-    for (int d = 0; d < directions.size(); ++d) {
+    std::array<glm::mat4, FACES> viewProjs = {};
+    for (size_t d = 0; d < directions.size(); ++d) {
       glm::mat4 shadowView =
           glm::lookAt(m.position, m.position + directions[d],
                       d == 2 || d == 3 ? glm::vec3(0.0, 0.0, -1.0)
                                        : glm::vec3(0.0, -1.0, 0.0));
-
-      glm::mat4 shadowViewProj = perspective * shadowView;
-      uniformData.shadowMatrix[d] = shadowViewProj;
+      viewProjs[d] = perspective * shadowView;
     }
+    return viewProjs;
+  }
 
-    matrixMapping.write(&uniformData, sizeof(LightUniform), 0);
+protected:
+  void writeUniform(const gl::MappingRef matrixMapping) const {
+    LightUniform uniformData = {};
+    uniformData.position = m.position;
+    uniformData.radius = m.radius;
 
-    renderFn();
-    glMemoryBarrier(GL_UNIFORM_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT |
-                    GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    auto viewProjs = faceViewProjs();
+    std::copy(viewProjs.begin(), viewProjs.end(), uniformData.shadowMatrix);
+
+    matrixMapping.write(&uniformData, sizeof(LightUniform), 0);
   }
 
-  const gl::CubeMap& getShadowMap() const { return shadowMap; }
-  const gl::TextureHandle& getShadowMapHandle() const {
-    return shadowMapHandle;
+  /// Points the geometry shader's per face viewports at the tiles
+  void useTiles() const {
+    for (size_t face = 0; face < FACES; ++face) {
+      const auto& tile = tiles[face];
+      glViewportIndexedf(static_cast<GLuint>(face), static_cast<float>(tile.x),
+                         static_cast<float>(tile.y),
+                         static_cast<float>(tile.size),
+                         static_cast<float>(tile.size));
+    }
   }
 
-protected:
   InstanceData m;
 
-  gl::TextureHandle shadowMapHandle = 0;
-  gl::CubeMap shadowMap;
+  std::array<ShadowAtlas::Tile, FACES> tiles = {};
 
-  gl::Framebuffer shadowFbo = {};
+  // What the atlas's static texture holds for this light
+  std::optional<uint64_t> staticVersion = std::nullopt;
+  // Whether the tiles were rendered since they last moved
+  bool drawn = false;
+  // Whether the live tiles are a plain copy of the static ones
+  bool holdsStatic = false;
 };
\ No newline at end of file
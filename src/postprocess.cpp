@@ -1,8 +1,9 @@
 #include "postprocess.hpp"
 
 std::expected<PostProcess, std::string>
-PostProcess::create(std::string_view name, std::string_view file) {
-  auto programOpt = gl::Program::fromFiles({
+PostProcess::create(ProgramCache& programs, std::string_view name,
+                    std::string_view file) {
+  auto programOpt = programs.load({
       {SHADERDIR "fullscreen.vert.glsl", gl::Shader::Type::VERTEX},
       {file, gl::Shader::Type::FRAGMENT},
   });
@@ -1,12 +1,13 @@
 #pragma once
 
+#include "programCache.hpp"
 #include <expected>
 #include <gl/gl.hpp>
 
 class PostProcess {
 public:
-  static std::expected<PostProcess, std::string> create(std::string_view name,
-                                                        std::string_view file);
+  static std::expected<PostProcess, std::string>
+  create(ProgramCache& programs, std::string_view name, std::string_view file);
 
 public:
   PostProcess() = default;
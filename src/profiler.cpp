@@ -0,0 +1,228 @@
+#include "profiler.hpp"
+
+#include "logger/logger.hpp"
+#include <fstream>
+#include <imgui/imgui.h>
+#include <string_view>
+
+namespace {
+  // Scope names are usually literals, but nothing stops one holding a quote
+  std::string escapeJson(std::string_view str) {
+    std::string out;
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        out += fmt::format("\\u{:04x}", static_cast<unsigned>(c));
+      } else {
+        out += c;
+      }
+    }
+    return out;
+  }
+} // namespace
+
+void Profiler::Scope::end() {
+  if (profiler) {
+    profiler->end(index);
+    profiler = nullptr;
+  }
+}
+
+Profiler::Profiler() {
+  for (auto& slot : slots) {
+    glCreateQueries(GL_TIMESTAMP, static_cast<GLsizei>(slot.queries.size()),
+                    slot.queries.data());
+    slot.records.reserve(MAX_SCOPES);
+  }
+
+  start = Clock::now();
+  glGetInteger64v(GL_TIMESTAMP, &gpuStart);
+}
+
+Profiler::~Profiler() {
+  for (auto& slot : slots) {
+    glDeleteQueries(static_cast<GLsizei>(slot.queries.size()),
+                    slot.queries.data());
+  }
+}
+
+void Profiler::beginFrame() {
+  current = (current + 1) % FRAME_LATENCY;
+  auto& slot = slots[current];
+  resolve(slot);
+
+  slot.frame = frame++;
+  slot.records.clear();
+  depth = 0;
+  recording = enabled;
+}
+
+Profiler::Scope Profiler::scope(std::string_view name) {
+  auto& slot = slots[current];
+  if (!recording || slot.records.size() >= MAX_SCOPES) {
+    return Scope(nullptr, 0);
+  }
+
+  auto index = static_cast<uint32_t>(slot.records.size());
+  slot.records.push_back({name, depth, Clock::now(), {}});
+  slot.lastQuery = slot.queries[index * 2];
+  glQueryCounter(slot.lastQuery, GL_TIMESTAMP);
+  ++depth;
+
+  return Scope(this, index);
+}
+
+void Profiler::end(uint32_t index) {
+  auto& slot = slots[current];
+  slot.lastQuery = slot.queries[index * 2 + 1];
+  glQueryCounter(slot.lastQuery, GL_TIMESTAMP);
+  slot.records[index].cpuEnd = Clock::now();
+  --depth;
+}
+
+void Profiler::resolve(Slot& slot) {
+  if (slot.records.empty()) {
+    return;
+  }
+
+  // Queries complete in order, so once the last one issued is available
+  // every other query in the frame is too
+  GLuint available = GL_FALSE;
+  glGetQueryObjectuiv(slot.lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    ++dropped;
+    return;
+  }
+
+  Frame result;
+  result.index = slot.frame;
+  result.results.reserve(slot.records.size());
+  for (size_t i = 0; i < slot.records.size(); ++i) {
+    const auto& record = slot.records[i];
+
+    GLuint64 gpuBegin = 0;
+    GLuint64 gpuEnd = 0;
+    glGetQueryObjectui64v(slot.queries[i * 2], GL_QUERY_RESULT, &gpuBegin);
+    glGetQueryObjectui64v(slot.queries[i * 2 + 1], GL_QUERY_RESULT, &gpuEnd);
+
+    result.results.push_back({
+        .name = record.name,
+        .depth = record.depth,
+        .cpuStartUs = sinceStartUs(record.cpuStart),
+        .gpuStartUs =
+            static_cast<double>(static_cast<GLint64>(gpuBegin) - gpuStart) /
+            1e3,
+        .cpuMs = std::chrono::duration<float, std::milli>(record.cpuEnd -
+                                                          record.cpuStart)
+                     .count(),
+        .gpuMs = static_cast<float>(gpuEnd - gpuBegin) / 1e6f,
+    });
+  }
+
+  if (captureFrames > 0) {
+    captured.push_back(result);
+    if (captured.size() >= captureFrames) {
+      if (auto res = writeTrace(capturePath, captured); !res) {
+        Logger::error("Failed to write profile capture: {}", res.error());
+      } else {
+        Logger::info("Wrote {} profiled frames to {}", captured.size(),
+                     capturePath);
+      }
+      captured.clear();
+      captureFrames = 0;
+    }
+  }
+
+  latestFrame = std::move(result);
+}
+
+double Profiler::sinceStartUs(Clock::time_point time) const {
+  return std::chrono::duration<double, std::micro>(time - start).count();
+}
+
+void Profiler::capture(uint32_t frames, std::string path) {
+  captured.clear();
+  captured.reserve(frames);
+  captureFrames = frames;
+  capturePath = std::move(path);
+}
+
+std::expected<void, std::string>
+Profiler::writeTrace(const std::string& path,
+                     const std::vector<Frame>& frames) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return std::unexpected("Failed to open " + path + " for writing");
+  }
+
+  file << "{\"traceEvents\": [\n";
+  file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+          "1, \"args\": {\"name\": \"CPU\"}},\n";
+  file << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+          "2, \"args\": {\"name\": \"GPU\"}}";
+
+  for (const auto& frame : frames) {
+    for (const auto& r : frame.results) {
+      auto name = escapeJson(r.name);
+      file << fmt::format(
+          ",\n  {{\"name\": \"{}\", \"cat\": \"cpu\", \"ph\": \"X\", \"pid\": "
+          "1, \"tid\": 1, \"ts\": {:.3f}, \"dur\": {:.3f}, \"args\": "
+          "{{\"frame\": {}}}}}",
+          name, r.cpuStartUs, r.cpuMs * 1e3f, frame.index);
+      file << fmt::format(
+          ",\n  {{\"name\": \"{}\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": "
+          "1, \"tid\": 2, \"ts\": {:.3f}, \"dur\": {:.3f}, \"args\": "
+          "{{\"frame\": {}}}}}",
+          name, r.gpuStartUs, r.gpuMs * 1e3f, frame.index);
+    }
+  }
+  file << "\n]}\n";
+
+  if (!file) {
+    return std::unexpected("Failed to write " + path);
+  }
+  return {};
+}
+
+void Profiler::debugUi() {
+  ImGui::Checkbox("Enabled", &enabled);
+  ImGui::SameLine();
+  ImGui::Text("Frame %llu | %u dropped",
+              static_cast<unsigned long long>(latestFrame.index), dropped);
+
+  constexpr auto tableFlags =
+      ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV;
+  if (ImGui::BeginTable("Passes", 3, tableFlags)) {
+    ImGui::TableSetupColumn("Pass");
+    ImGui::TableSetupColumn("CPU (ms)");
+    ImGui::TableSetupColumn("GPU (ms)");
+    ImGui::TableHeadersRow();
+
+    for (const auto& r : latestFrame.results) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      auto indent = static_cast<float>(r.depth) * 12.0f;
+      if (r.depth > 0) {
+        ImGui::Indent(indent);
+      }
+      ImGui::TextUnformatted(r.name.data(), r.name.data() + r.name.size());
+      if (r.depth > 0) {
+        ImGui::Unindent(indent);
+      }
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", static_cast<double>(r.cpuMs));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", static_cast<double>(r.gpuMs));
+    }
+    ImGui::EndTable();
+  }
+
+  ImGui::SliderInt("Capture Frames", &captureLength, 1, 600);
+  if (captureFrames > 0) {
+    ImGui::Text("Capturing %zu / %u", captured.size(), captureFrames);
+  } else if (ImGui::Button("Capture Chrome Trace")) {
+    capture(static_cast<uint32_t>(captureLength), "profile.json");
+  }
+}
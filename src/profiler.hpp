@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <gl/gl.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Times nested passes on both the CPU and the GPU.
+///
+/// Each scope records CPU timestamps and a GL_TIMESTAMP query at its start
+/// and end. Queries live in a ring of FRAME_LATENCY frames and a frame is only
+/// read back when its slot comes round again, by which point the GPU has
+/// normally finished it, so reading results never stalls. A frame the GPU is
+/// still behind on is dropped rather than waited for.
+///
+/// Scope names are kept as views, so they must outlive the profiler. String
+/// literals and PostProcess names both do.
+/// </summary>
+class Profiler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  constexpr static uint32_t FRAME_LATENCY = 4;
+  /// Scopes beyond this in one frame are not timed
+  constexpr static uint32_t MAX_SCOPES = 128;
+
+  /// <summary>
+  /// Ends its scope when destroyed, or earlier through end.
+  /// </summary>
+  class Scope {
+  public:
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope() { end(); }
+
+    /// <summary>
+    /// Ends the scope before it goes out of C++ scope, for splitting a
+    /// function into consecutive passes.
+    /// </summary>
+    void end();
+
+  private:
+    friend class Profiler;
+    Scope(Profiler* profiler, uint32_t index)
+        : profiler(profiler), index(index) {}
+
+    Profiler* profiler;
+    uint32_t index;
+  };
+
+  struct Result {
+    std::string_view name;
+    uint32_t depth;
+    /// Microseconds since the profiler was created
+    double cpuStartUs;
+    double gpuStartUs;
+    float cpuMs;
+    float gpuMs;
+  };
+
+  struct Frame {
+    uint64_t index = 0;
+    /// In the order the scopes began, so parents come before children
+    std::vector<Result> results;
+  };
+
+  Profiler();
+  ~Profiler();
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  /// <summary>
+  /// Reads back the frame that last used this ring slot, then starts
+  /// recording a new one. Call before any scope in the frame.
+  /// </summary>
+  void beginFrame();
+
+  /// <summary>
+  /// Starts a scope nested inside whichever scopes are still open.
+  /// </summary>
+  [[nodiscard]] Scope scope(std::string_view name);
+
+  /// <summary>
+  /// Records the next frames read back and writes them to path as a Chrome
+  /// trace (chrome://tracing or ui.perfetto.dev) once enough are collected.
+  /// </summary>
+  void capture(uint32_t frames, std::string path);
+
+  /// <summary>
+  /// Writes frames as Chrome trace JSON, CPU scopes on one track and GPU
+  /// scopes on another.
+  /// </summary>
+  static std::expected<void, std::string>
+  writeTrace(const std::string& path, const std::vector<Frame>& frames);
+
+  /// <summary>
+  /// Draws the latest frame's timings as a tree into the current ImGui
+  /// window, along with capture controls.
+  /// </summary>
+  void debugUi();
+
+  inline const Frame& latest() const { return latestFrame; }
+
+  bool enabled = true;
+
+private:
+  struct Record {
+    std::string_view name;
+    uint32_t depth;
+    Clock::time_point cpuStart;
+    Clock::time_point cpuEnd;
+  };
+
+  struct Slot {
+    uint64_t frame = 0;
+    std::vector<Record> records;
+    // Two per record, start then end
+    std::array<GLuint, MAX_SCOPES * 2> queries = {};
+    GLuint lastQuery = 0;
+  };
+
+  void end(uint32_t index);
+  void resolve(Slot& slot);
+  double sinceStartUs(Clock::time_point time) const;
+
+  std::array<Slot, FRAME_LATENCY> slots;
+  size_t current = 0;
+  uint64_t frame = 0;
+  uint32_t depth = 0;
+  bool recording = false;
+
+  Clock::time_point start;
+  // GPU timestamp (ns) matching start, to line the two clocks up
+  GLint64 gpuStart = 0;
+
+  Frame latestFrame;
+  uint32_t dropped = 0;
+
+  std::vector<Frame> captured;
+  uint32_t captureFrames = 0;
+  std::string capturePath;
+  // Frames the capture button asks for, an int for ImGui
+  int captureLength = 60;
+};
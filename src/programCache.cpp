@@ -0,0 +1,161 @@
+#include "programCache.hpp"
+
+#include "logger/logger.hpp"
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace {
+  constexpr std::array<char, 4> MAGIC = {'P', 'B', 'I', 'N'};
+  constexpr uint32_t VERSION = 1;
+
+  struct BinaryHeader {
+    std::array<char, 4> magic = MAGIC;
+    uint32_t version = VERSION;
+    uint64_t key = 0;
+    GLenum format = 0;
+    uint32_t length = 0;
+  };
+
+  // FNV-1a, plenty for telling a few dozen shader revisions apart
+  constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+  constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+  uint64_t hash(uint64_t h, std::string_view data) {
+    for (char c : data) {
+      h ^= static_cast<uint8_t>(c);
+      h *= FNV_PRIME;
+    }
+    return h;
+  }
+
+  std::string glString(GLenum name) {
+    auto str = reinterpret_cast<const char*>(glGetString(name));
+    return str ? str : "";
+  }
+} // namespace
+
+ProgramCache::ProgramCache(std::filesystem::path directory)
+    : directory(std::move(directory)) {
+  if (auto env = std::getenv("PROGRAM_CACHE");
+      env && std::string_view(env) == "0") {
+    Logger::info("Program binary cache disabled by PROGRAM_CACHE=0");
+    enabled = false;
+    return;
+  }
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if (formats == 0) {
+    Logger::info("Driver supports no program binary formats, not caching");
+    enabled = false;
+    return;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(this->directory, ec);
+  if (ec) {
+    Logger::error("Failed to create program cache directory {}: {}",
+                  this->directory.string(), ec.message());
+    enabled = false;
+    return;
+  }
+
+  driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" +
+           glString(GL_VERSION);
+}
+
+std::optional<uint64_t>
+ProgramCache::key(std::span<const ShaderStage> stages) const {
+  uint64_t h = hash(FNV_OFFSET, driver);
+
+  for (const auto& stage : stages) {
+    std::ifstream file{std::string(stage.path), std::ios::binary};
+    if (!file) {
+      return std::nullopt;
+    }
+    std::string source{std::istreambuf_iterator<char>(file), {}};
+
+    auto type = static_cast<int>(stage.type);
+    h = hash(h, std::string_view(reinterpret_cast<const char*>(&type),
+                                 sizeof(type)));
+    h = hash(h, source);
+  }
+
+  return h;
+}
+
+std::filesystem::path ProgramCache::pathFor(uint64_t key) const {
+  return directory / fmt::format("{:016x}.bin", key);
+}
+
+std::optional<gl::Program> ProgramCache::fromBinary(uint64_t key) {
+  std::ifstream file(pathFor(key), std::ios::binary);
+  if (!file) {
+    return std::nullopt;
+  }
+
+  BinaryHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      header.magic != MAGIC || header.version != VERSION ||
+      header.key != key) {
+    return std::nullopt;
+  }
+
+  std::vector<char> binary(header.length);
+  if (!file.read(binary.data(), header.length)) {
+    return std::nullopt;
+  }
+
+  gl::Program program;
+  glProgramBinary(program.id(), header.format, binary.data(),
+                  static_cast<GLsizei>(binary.size()));
+
+  GLint status = GL_FALSE;
+  glGetProgramiv(program.id(), GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    // Usually a driver update the version string didn't capture. The source
+    // compile that follows overwrites the stale binary.
+    ++_stats.rejected;
+    return std::nullopt;
+  }
+
+  return program;
+}
+
+void ProgramCache::store(uint64_t key, const gl::Program& program) const {
+  GLint length = 0;
+  glGetProgramiv(program.id(), GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  BinaryHeader header;
+  header.key = key;
+  header.length = static_cast<uint32_t>(length);
+
+  std::vector<char> binary(header.length);
+  glGetProgramBinary(program.id(), length, nullptr, &header.format,
+                     binary.data());
+
+  auto path = pathFor(key);
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), length);
+    if (!file) {
+      Logger::error("Failed to write program binary {}", tmp.string());
+      return;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+  }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <gl/gl.hpp>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+struct ShaderStage {
+  std::string_view path;
+  gl::Shader::Type type;
+};
+
+/// <summary>
+/// Keeps linked program binaries on disk so later launches can skip GLSL
+/// compilation entirely.
+///
+/// Binaries are keyed by a hash of every stage's source along with the GL
+/// vendor, renderer and version strings, so editing a shader or updating the
+/// driver simply misses. A binary the driver rejects falls back to compiling
+/// from source, which then replaces it.
+///
+/// Set PROGRAM_CACHE=0 in the environment to always compile from source, for
+/// comparing start up times.
+/// </summary>
+class ProgramCache {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    uint32_t loaded = 0;
+    uint32_t compiled = 0;
+    /// Binaries found on disk but refused by the driver
+    uint32_t rejected = 0;
+    float loadMs = 0.0f;
+    float compileMs = 0.0f;
+  };
+
+  explicit ProgramCache(std::filesystem::path directory);
+
+  ProgramCache(const ProgramCache&) = delete;
+  ProgramCache& operator=(const ProgramCache&) = delete;
+
+  /// <summary>
+  /// Loads the program linked from the given stages out of the cache, or
+  /// compiles it with gl::Program::fromFiles and stores the result. Takes
+  /// the same list of {path, type} pairs as fromFiles.
+  /// </summary>
+  template <size_t N>
+  std::expected<gl::Program, std::string>
+  load(const ShaderStage (&stages)[N]) {
+    auto start = Clock::now();
+
+    auto k = enabled ? key(stages) : std::nullopt;
+    if (k) {
+      if (auto program = fromBinary(*k)) {
+        ++_stats.loaded;
+        _stats.loadMs += msSince(start);
+        return std::move(*program);
+      }
+    }
+
+    auto program = compile(stages, std::make_index_sequence<N>{});
+    if (program && k) {
+      store(*k, *program);
+    }
+
+    ++_stats.compiled;
+    _stats.compileMs += msSince(start);
+    return program;
+  }
+
+  inline const Stats& stats() const { return _stats; }
+  inline bool isEnabled() const { return enabled; }
+
+private:
+  template <size_t N, size_t... I>
+  static std::expected<gl::Program, std::string>
+  compile(const ShaderStage (&stages)[N], std::index_sequence<I...>) {
+    return gl::Program::fromFiles({{stages[I].path, stages[I].type}...});
+  }
+
+  // Hashes the driver strings and every stage source. Returns nullopt if a
+  // source can't be read, leaving fromFiles to report the error.
+  std::optional<uint64_t> key(std::span<const ShaderStage> stages) const;
+  std::optional<gl::Program> fromBinary(uint64_t key);
+  void store(uint64_t key, const gl::Program& program) const;
+  std::filesystem::path pathFor(uint64_t key) const;
+
+  static float msSince(Clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(Clock::now() - start)
+        .count();
+  }
+
+  std::filesystem::path directory;
+  std::string driver;
+  bool enabled = true;
+
+  Stats _stats;
+};
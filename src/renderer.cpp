@@ -2,14 +2,19 @@
 
 #include "heightmap.hpp"
 #include "logger/logger.hpp"
+#include "packedVertex.hpp"
 #include "skybox.hpp"
 #include "water.hpp"
+#include <algorithm>
+#include <atomic>
 #include <engine/globals.hpp>
 #include <engine/mesh_node.hpp>
 #include <engine\mesh\mesh.hpp>
 #include <gl/structs.hpp>
 #include <glm\ext\matrix_transform.hpp>
 #include <imgui/imgui.h>
+#include <limits>
+#include <numeric>
 #include <spdlog/fmt/bundled/format.h>
 
 namespace {
@@ -24,14 +29,76 @@ namespace {
 
   DebugView debugView = DebugView::NONE;
 
-  GLuint writeLitDraws(const engine::scene::Graph::NodeLists& nodeLists,
-                       gl::MappingRef& mapping) {
-    GLuint writtenDraws = 0;
-    for (const auto& child : nodeLists.lit) {
-      child.node->writeBatchedDraws(mapping, writtenDraws);
+  constexpr auto COMMAND_SIZE =
+      static_cast<GLuint>(sizeof(gl::DrawElementsIndirectCommand));
+
+  const void* indirectOffset(GLuint offset) {
+    return reinterpret_cast<const void*>(static_cast<uintptr_t>(offset));
+  }
+
+  // Nodes per thread pool job, enough that each job outweighs handing it to
+  // a worker. Smaller scenes never leave the calling thread
+  constexpr size_t PARALLEL_GRAIN = 256;
+
+  /// <summary>
+  /// Brings index up to date with the graph's roots, which are only ever
+  /// added to. Roots that have not moved cost a compare.
+  /// </summary>
+  void indexRoots(const engine::scene::Graph& graph, SceneIndex& index) {
+    const auto& roots = graph.GetRoots();
+    for (size_t i = 0; i < roots.size(); ++i) {
+      glm::vec3 center(roots[i]->GetWorldTransform()[3]);
+      float radius = roots[i]->GetBoundingRadius();
+      if (i < index.size()) {
+        index.move(static_cast<uint32_t>(i), center, radius);
+      } else {
+        index.insert(center, radius);
+      }
+    }
+    index.refit();
+  }
+
+  struct CrowdBox {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+  };
+
+  /// <summary>
+  /// Box around every character's bounds, which lets the lights far from the
+  /// whole crowd skip testing each character.
+  /// </summary>
+  CrowdBox crowdBox(const std::deque<Character>& characters) {
+    CrowdBox box;
+    for (const auto& character : characters) {
+      glm::vec4 bounds = character.bounds();
+      box.min = glm::min(box.min, glm::vec3(bounds) - bounds.w);
+      box.max = glm::max(box.max, glm::vec3(bounds) + bounds.w);
+    }
+    return box;
+  }
+
+  /// <summary>
+  /// Whether any character's bounds touch sphere. Characters animate every
+  /// frame, so one in range is enough to need its shadow redrawn. box is the
+  /// characters' crowdBox.
+  /// </summary>
+  bool casterInRange(const std::deque<Character>& characters,
+                     const CrowdBox& box, const glm::vec4& sphere) {
+    if (characters.empty()) {
+      return false;
+    }
+    glm::vec3 center(sphere);
+    glm::vec3 offset = glm::clamp(center, box.min, box.max) - center;
+    if (glm::dot(offset, offset) > sphere.w * sphere.w) {
+      return false;
     }
 
-    return writtenDraws;
+    return std::ranges::any_of(characters, [&](const Character& character) {
+      glm::vec4 bounds = character.bounds();
+      glm::vec3 offset = glm::vec3(bounds) - glm::vec3(sphere);
+      float reach = bounds.w + sphere.w;
+      return glm::dot(offset, offset) <= reach * reach;
+    });
   }
 
 } // namespace
@@ -78,8 +145,25 @@ bool Renderer::update(const engine::FrameInfo& info) {
   if (engine::App::update(info))
     return true;
 
+  auto frame = info;
+  if (benchmark) {
+    // Stop before the track wraps, so every run covers it exactly once
+    if (track.time() + benchmark->timestep() > track.duration()) {
+      if (auto res = benchmark->finish(); !res) {
+        Logger::error("Failed to write benchmark results: {}", res.error());
+        bail();
+      }
+      return true;
+    }
+
+    // Step by the same amount every frame so runs see identical frames no
+    // matter how long each one takes to draw
+    frame.frameDelta = benchmark->timestep();
+    benchmark->beginFrame(track.time() + frame.frameDelta);
+  }
+
   if (onTrack) {
-    track.update(info.frameDelta);
+    track.update(frame.frameDelta);
     auto pos = track.position();
     auto rot = track.rotation();
 
@@ -88,13 +172,13 @@ bool Renderer::update(const engine::FrameInfo& info) {
     cam.SetPosition(pos);
     cam.SetRotation(rot);
 
-    if (input.isKeyDown(GLFW_KEY_ESCAPE)) {
+    if (!benchmark && input.isKeyDown(GLFW_KEY_ESCAPE)) {
       onTrack = false;
       camera.left().EnableMouse(true);
     }
   }
 
-  camera.update(input, info.frameDelta, !onTrack);
+  camera.update(input, frame.frameDelta, !onTrack);
 
   if (input.isKeyPressed(GLFW_KEY_B))
     enableBloom = !enableBloom;
@@ -106,7 +190,12 @@ bool Renderer::update(const engine::FrameInfo& info) {
     window.fullscreen(!window.isFullscreen());
   }
 
-  graph.update(info);
+  graph.update(frame);
+  pointLightGraph.update(frame);
+  rightPointLightGraph.update(frame);
+  indexRoots(graph, graphIndex);
+  indexRoots(rightGraph, rightGraphIndex);
+  scene.update(frame.frameDelta);
 
   return false;
 }
@@ -114,22 +203,38 @@ bool Renderer::update(const engine::FrameInfo& info) {
 void Renderer::useLeftCamera() {
   camera.leftView();
   camera.left().bindMatrixBuffer(0);
-  envMap.bind(4);
+  envMap->bind(4);
 }
 
 void Renderer::useRightCamera() {
   camera.rightView();
   camera.right().bindMatrixBuffer(0);
-  nightEnvMap.bind(4);
+  nightEnvMap->bind(4);
 }
 
 void Renderer::render(const engine::FrameInfo& info) {
-  (void)info;
+  counters = {};
+  profiler.beginFrame();
+  {
+    auto scope = profiler.scope("Frame");
+    renderFrame(info);
+  }
+  dynamicRing.end();
+
+  if (benchmark) {
+    benchmark->endFrame(counters);
+  }
+}
+
+void Renderer::renderFrame(const engine::FrameInfo& info) {
   gbuffers->fbo.bind();
   glClearDepth(0.0f);
   glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  // Before the crowd is culled, so lights without a tile or anything on
+  // screen to light skip their culls too
+  layoutShadows();
   auto batch = setupBatches();
 
   glEnable(GL_DEPTH_TEST);
@@ -147,7 +252,9 @@ void Renderer::render(const engine::FrameInfo& info) {
     auto nodeLists =
         graph.BuildNodeLists(camera.GetFrustum(), camera.GetPosition());
 
-    renderLit(nodeLists, batch, camera, 0);
+    auto scope = profiler.scope("Lit (Left)");
+    renderLit(nodeLists, batch, camera, batch.indirectOffset,
+              batch.textureOffset, LEFT_VIEW, LEFT_MASK);
   }
 
   if (camera.getSplitRatio() > 0.0f) {
@@ -155,7 +262,9 @@ void Renderer::render(const engine::FrameInfo& info) {
     auto& camera = this->camera.right();
     auto nodeLists =
         rightGraph.BuildNodeLists(camera.GetFrustum(), camera.GetPosition());
-    renderLit(nodeLists, batch, camera, rightIndirectOffset);
+    auto scope = profiler.scope("Lit (Right)");
+    renderLit(nodeLists, batch, camera, batch.rightIndirectOffset,
+              batch.rightTextureOffset, RIGHT_VIEW, RIGHT_MASK);
   }
 
   camera.fullView();
@@ -186,8 +295,13 @@ void Renderer::render(const engine::FrameInfo& info) {
     return;
   }
 
+  writeLights();
+  testLightVisibility();
   renderPointLights();
   renderSpotLights();
+  if (lightingMode == LightingMode::CLUSTERED) {
+    renderClusteredLights();
+  }
 
   if (debugView == DebugView::DIFFUSE_LIGHT ||
       debugView == DebugView::SPECULAR_LIGHT) {
@@ -218,117 +332,377 @@ void Renderer::render(const engine::FrameInfo& info) {
 }
 
 Renderer::BatchSetup Renderer::setupBatches() {
+  auto scope = profiler.scope("Setup Batches");
+
+  // Characters request their texture handles while writing instance data
+  textureResidency.beginFrame();
+
   auto& leftRoots = graph.GetRoots();
   auto& rightRoots = rightGraph.GetRoots();
 
-  engine::scene::Node::DrawParams leftDrawParams = {0, 0, 0};
-  for (const auto& node : leftRoots) {
-    leftDrawParams += node->getBatchDrawParams();
-  }
+  const auto& leftDrawParams = countDrawParams(graph, leftCounted);
+  const auto& rightDrawParams = countDrawParams(rightGraph, rightCounted);
+  engine::scene::Node::DrawParams drawParams = leftDrawParams + rightDrawParams;
 
-  engine::scene::Node::DrawParams rightDrawParams = {0, 0, 0};
-  for (const auto& node : rightRoots) {
-    rightDrawParams += node->getBatchDrawParams();
+  // A graph the split hides is never drawn, so none of its nodes are
+  // skinned or written
+  bool leftActive = camera.getSplitRatio() < 1.0f;
+  bool rightActive = camera.getSplitRatio() > 0.0f;
+
+  // Each crowd's tiers are measured from its own graph's camera
+  auto updateLods = [&](std::deque<Character>& characters,
+                        const glm::vec3& eye) {
+    threadPool.parallelFor(characters.size(), PARALLEL_GRAIN,
+                           [&](size_t begin, size_t end) {
+                             for (size_t i = begin; i < end; ++i) {
+                               characters[i].updateLod(animationLod, eye);
+                             }
+                           });
+  };
+  if (leftActive) {
+    updateLods(crowd, camera.left().GetPosition());
+  }
+  if (rightActive) {
+    updateLods(rightCrowd, camera.right().GetPosition());
   }
 
-  engine::scene::Node::DrawParams drawParams = leftDrawParams + rightDrawParams;
+  // Nodes only add their instances, poses shared between them are skinned
+  // once in a single dispatch
+  skinning.begin();
+  {
+    GLuint writtenVertices = 0;
+    if (leftActive) {
+      skinning.setViewMask(LEFT_MASK);
+      for (const auto& node : leftRoots) {
+        node->skinVertices(writtenVertices);
+      }
+      for (auto& character : crowd) {
+        character.skinVertices(writtenVertices);
+      }
+    }
+    if (rightActive) {
+      skinning.setViewMask(RIGHT_MASK);
+      for (const auto& node : rightRoots) {
+        node->skinVertices(writtenVertices);
+      }
+      for (auto& character : rightCrowd) {
+        character.skinVertices(writtenVertices);
+      }
+    }
+  }
 
-  GLuint verticesSize = drawParams.maxVertices * sizeof(engine::mesh::Vertex);
+  GLuint verticesSize = std::max(skinning.outputVertices(), 1u) *
+                        static_cast<GLuint>(sizeof(PackedVertex));
   if (verticesSize > skinnedVerticesBuffer.size()) {
     skinnedVerticesBuffer = {};
     skinnedVerticesBuffer.label("Skinned Vertices Buffer");
     skinnedVerticesBuffer.init(verticesSize);
     batchVao.bindVertexBuffer(0, skinnedVerticesBuffer.id(), 0,
-                              sizeof(engine::mesh::Vertex));
+                              sizeof(PackedVertex));
+    crowdVao.bindVertexBuffer(0, skinnedVerticesBuffer.id(), 0,
+                              sizeof(PackedVertex));
   }
 
-  skinProgram.bind();
+  auto indirectSize = drawParams.maxIndirectCmds * COMMAND_SIZE;
+  auto instanceSize =
+      static_cast<GLuint>(drawParams.instances * sizeof(PackedTransform));
+  // Texture sets are written per draw by each camera's lit pass, so each
+  // camera gets its own section
+  auto textureOffset = gl::Buffer::roundToAlignment(
+      indirectSize + instanceSize, gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  auto rightTextureOffset = gl::Buffer::roundToAlignment(
+      textureOffset + static_cast<GLuint>(
+                          leftDrawParams.maxIndirectCmds *
+                          sizeof(engine::mesh::TextureHandleSet)),
+      gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  auto textureSize =
+      rightTextureOffset - textureOffset +
+      static_cast<GLuint>(
+          std::max(rightDrawParams.maxIndirectCmds, 1u) *
+          sizeof(engine::mesh::TextureHandleSet));
+  auto dynamicSize = textureOffset + textureSize;
 
-  staticBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 1, 0,
-                         staticVertexSize);
-  skinnedVerticesBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 2, 0,
-                                  verticesSize);
-  staticBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 3, jointOffset,
-                         jointSize);
-  {
-    GLuint writtenVertices = 0;
-    for (const auto& node : leftRoots) {
-      node->skinVertices(writtenVertices);
+  // Every shadow pass writes its draws and matrices to its own slice, so
+  // no pass overwrites what an earlier one still has queued
+  auto aligned = [](size_t size) {
+    return gl::Buffer::roundToAlignment(static_cast<GLuint>(size),
+                                        gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  };
+  GLuint leftCommands = aligned(leftDrawParams.maxIndirectCmds * COMMAND_SIZE);
+  GLuint rightCommands =
+      aligned(rightDrawParams.maxIndirectCmds * COMMAND_SIZE);
+  GLuint shadowSize =
+      static_cast<GLuint>(pointLights.size() + spotLights.size()) *
+          leftCommands +
+      static_cast<GLuint>(rightPointLights.size() + rightSpotLights.size()) *
+          rightCommands +
+      static_cast<GLuint>(pointLights.size() + rightPointLights.size()) *
+          aligned(sizeof(PointLight::LightUniform)) +
+      static_cast<GLuint>(spotLights.size() + rightSpotLights.size()) *
+          aligned(sizeof(SpotLight::LightUniform));
+
+  GLuint lightsSize = aligned(
+      (pointLights.size() + rightPointLights.size() + spotLights.size() +
+       rightSpotLights.size() + 1) *
+      sizeof(LightData));
+
+  dynamicRing.begin(aligned(dynamicSize) + shadowSize + lightsSize +
+                    skinning.stagingSize() +
+                    gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  // begin made room for it, and it is the first allocation of the frame
+  GLuint base = *dynamicRing.allocate(dynamicSize);
+  batchVao.bindVertexBuffer(1, dynamicRing.getBuffer().id(),
+                            base + indirectSize, sizeof(PackedTransform));
+
+  // Each root's instances and texture sets start where the counted roots
+  // before it end, the right graph's after all of the left's, so roots
+  // write their ranges in parallel. A hidden graph's range is left unwritten
+  size_t leftCount = leftRoots.size();
+  size_t firstRoot = leftActive ? 0 : leftCount;
+  size_t lastRoot = rightActive ? leftCount + rightRoots.size() : leftCount;
+  threadPool.parallelFor(
+      lastRoot - firstRoot, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = firstRoot + begin; i < firstRoot + end; ++i) {
+          bool left = i < leftCount;
+          const auto& node = left ? leftRoots[i] : rightRoots[i - leftCount];
+          auto first = left ? leftCounted.firsts[i]
+                            : leftDrawParams +
+                                  rightCounted.firsts[i - leftCount];
+
+          GLuint written = first.instances;
+          gl::MappingRef instanceMap = dynamicRing.ref(
+              base + indirectSize +
+              first.instances * static_cast<GLuint>(sizeof(PackedTransform)));
+          gl::MappingRef textureMap = dynamicRing.ref(
+              base + textureOffset +
+              first.maxIndirectCmds *
+                  static_cast<GLuint>(
+                      sizeof(engine::mesh::TextureHandleSet)));
+          node->writeInstanceData(instanceMap, written, textureMap);
+        }
+      });
+  GLuint writtenInstances =
+      (leftActive ? leftDrawParams.instances : 0) +
+      (rightActive ? rightDrawParams.instances : 0);
+
+  lodCounts = {};
+  // Transforms only touch each character's own instance. Texture sets are
+  // per pose and go through residency, so stay on this thread
+  for (auto [characters, active] :
+       {std::pair{&crowd, leftActive}, std::pair{&rightCrowd, rightActive}}) {
+    if (!active) {
+      continue;
     }
-    for (const auto& node : rightRoots) {
-      node->skinVertices(writtenVertices);
+    threadPool.parallelFor(characters->size(), PARALLEL_GRAIN,
+                           [&](size_t begin, size_t end) {
+                             for (size_t i = begin; i < end; ++i) {
+                               (*characters)[i].writeTransform();
+                             }
+                           });
+    for (auto& character : *characters) {
+      character.writeTextures();
+      ++lodCounts[static_cast<size_t>(character.lodTier())];
     }
   }
 
-  auto indirectSize = static_cast<GLuint>(
-      drawParams.maxIndirectCmds * sizeof(gl::DrawElementsIndirectCommand));
-  rightIndirectOffset =
-      leftDrawParams.maxIndirectCmds * sizeof(gl::DrawElementsIndirectCommand);
-  auto instanceSize =
-      static_cast<GLuint>(drawParams.instances * sizeof(glm::mat4));
-  auto textureSize = static_cast<GLuint>(
-      drawParams.maxIndirectCmds * sizeof(engine::mesh::TextureHandleSet));
-  auto textureOffset = gl::Buffer::roundToAlignment(
-      indirectSize + instanceSize, gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  // One view per camera and per shadow pass, so no pass overwrites the
+  // draws of one still in flight
+  skinning.upload(dynamicRing, viewCount());
 
-  auto dynamicSize = textureOffset + textureSize;
-  if (dynamicBuffer.size() < dynamicSize) {
-    Logger::debug("Resizing dynamic buffer from {} to {}. Instance Offset: {} "
-                  "| Texture Offset: {}",
-                  dynamicBuffer.size(), dynamicSize, indirectSize,
-                  textureOffset);
-    dynamicBuffer = {};
-    dynamicBuffer.label("Dynamic Buffer");
-    dynamicBuffer.init(dynamicSize, nullptr,
-                       gl::Buffer::Usage::WRITE |
-                           gl::Buffer::Usage::PERSISTENT |
-                           gl::Buffer::Usage::COHERENT);
-    dynamicMapping = dynamicBuffer.map(gl::Buffer::Mapping::WRITE |
-                                       gl::Buffer::Mapping::PERSISTENT |
-                                       gl::Buffer::Mapping::COHERENT);
-    batchVao.bindVertexBuffer(1, dynamicBuffer.id(), indirectSize,
-                              sizeof(glm::mat4));
-  }
-
-  GLuint writtenInstances = 0;
-  gl::MappingRef indirectMap = {dynamicMapping, 0};
-  gl::MappingRef instanceMap = {dynamicMapping,
-                                static_cast<GLuint>(indirectSize)};
-  gl::MappingRef textureMap = {dynamicMapping,
-                               static_cast<GLuint>(textureOffset)};
-  for (auto& node : leftRoots) {
-    node->writeInstanceData(instanceMap, writtenInstances, textureMap);
-  }
-  for (auto& node : rightRoots) {
-    node->writeInstanceData(instanceMap, writtenInstances, textureMap);
+  // Every view is culled before skinning, which then only runs for poses
+  // that something will draw
+  cullViews(leftActive, rightActive);
+
+  skinProgram.bind();
+
+  staticBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 1, 0,
+                         staticVertexSize);
+  skinnedVerticesBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 2, 0,
+                                  verticesSize);
+  if (keySize != 0) {
+    staticBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 3, keyOffset,
+                           keySize);
   }
+  staticBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 5, clipOffset,
+                         clipSize);
+  skinning.dispatch(dynamicRing);
+  glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  counters.instances =
+      writtenInstances + static_cast<uint32_t>(skinning.instanceCount());
+  counters.uploadBytes =
+      skinning.uploadedBytes() +
+      writtenInstances * static_cast<uint32_t>(sizeof(PackedTransform));
 
   return {
-      .textureOffset = textureOffset,
+      .indirectOffset = base,
+      .rightIndirectOffset = base + leftDrawParams.maxIndirectCmds *
+                                        COMMAND_SIZE,
+      .textureOffset = base + textureOffset,
+      .rightTextureOffset = base + rightTextureOffset,
       .textureSize = textureSize,
   };
 }
 
+const engine::scene::Node::DrawParams&
+Renderer::countDrawParams(const engine::scene::Graph& from,
+                          CountedDrawParams& counted) {
+  // Roots are only ever added, so the same number means the same roots
+  const auto& roots = from.GetRoots();
+  if (counted.valid && counted.roots == roots.size()) {
+    return counted.params;
+  }
+
+  counted.firsts.resize(roots.size());
+  threadPool.parallelFor(roots.size(), PARALLEL_GRAIN,
+                         [&](size_t begin, size_t end) {
+                           for (size_t i = begin; i < end; ++i) {
+                             counted.firsts[i] = roots[i]->getBatchDrawParams();
+                           }
+                         });
+
+  counted.params = {0, 0, 0};
+  for (auto& first : counted.firsts) {
+    auto params = first;
+    first = counted.params;
+    counted.params += params;
+  }
+  counted.roots = roots.size();
+  counted.valid = true;
+  return counted.params;
+}
+
+template <typename NodeAt>
+Renderer::WrittenDraws Renderer::writeDraws(GLuint offset, GLuint capacity,
+                                            size_t count,
+                                            const NodeAt& nodeAt) {
+  drawFirsts.resize(count + 1);
+  threadPool.parallelFor(count, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      drawFirsts[i] = nodeAt(i)->getBatchDrawParams().maxIndirectCmds;
+    }
+  });
+  drawFirsts[count] = 0;
+  std::exclusive_scan(drawFirsts.begin(), drawFirsts.end(), drawFirsts.begin(),
+                      0u);
+
+  GLuint total = drawFirsts[count];
+  if (total > capacity) {
+    // A node's maximum covers its children, so a list holding both counts
+    // them twice. Writing one after another packs them as tight as they go
+    GLuint writtenDraws = 0;
+    gl::MappingRef indirectMap = dynamicRing.ref(offset);
+    for (size_t i = 0; i < count; ++i) {
+      nodeAt(i)->writeBatchedDraws(indirectMap, writtenDraws);
+    }
+    return {writtenDraws, writtenDraws};
+  }
+
+  std::atomic<GLuint> draws = 0;
+  threadPool.parallelFor(count, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+    constexpr gl::DrawElementsIndirectCommand EMPTY = {};
+    GLuint jobDraws = 0;
+    for (size_t i = begin; i < end; ++i) {
+      GLuint written = drawFirsts[i];
+      gl::MappingRef indirectMap =
+          dynamicRing.ref(offset + written * COMMAND_SIZE);
+      nodeAt(i)->writeBatchedDraws(indirectMap, written);
+      jobDraws += written - drawFirsts[i];
+      // Keeps the draws contiguous for the multi draw
+      for (; written < drawFirsts[i + 1]; ++written) {
+        indirectMap.write(&EMPTY, COMMAND_SIZE, 0);
+        indirectMap += COMMAND_SIZE;
+      }
+    }
+    draws += jobDraws;
+  });
+  return {total, draws.load()};
+}
+
 void Renderer::renderLit(const engine::scene::Graph::NodeLists& nodeLists,
                          const BatchSetup& batch, const engine::Camera& camera,
-                         GLuint offset) {
+                         GLuint offset, GLuint textureOffset, GLuint view,
+                         GLuint mask) {
 
   // Will likely be the larger more custom stuff like terrain
   nodeLists.renderLit(camera.GetFrustum());
 
-  auto bg = batchVao.bindGuard();
   batchProgram.bind();
-  gl::MappingRef indirectMap = {dynamicMapping, offset};
-  auto draws = writeLitDraws(nodeLists, indirectMap);
-  dynamicBuffer.bind(gl::Buffer::BasicTarget::DRAW_INDIRECT);
+  const auto& lit = nodeLists.lit;
+  auto draws = writeDraws(
+      offset,
+      (mask == LEFT_MASK ? leftCounted : rightCounted).params.maxIndirectCmds,
+      lit.size(), [&](size_t i) { return lit[i].node; });
+  if (draws.commands > 0) {
+    auto bg = batchVao.bindGuard();
+    const auto& buffer = dynamicRing.getBuffer();
+    buffer.bind(gl::Buffer::BasicTarget::DRAW_INDIRECT);
+    buffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 2, textureOffset,
+                     batch.textureOffset + batch.textureSize - textureOffset);
+
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES, GL_UNSIGNED_INT,
+        reinterpret_cast<void*>(static_cast<uintptr_t>(offset)),
+        draws.commands, sizeof(gl::DrawElementsIndirectCommand));
+    ++counters.multiDraws;
+    counters.batchedDraws += draws.draws;
+  }
 
-  dynamicBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 2,
-                          batch.textureOffset, batch.textureSize);
+  auto bg = crowdVao.bindGuard();
+  drawCrowd(view);
+}
 
-  glMultiDrawElementsIndirect(
-      GL_TRIANGLES, GL_UNSIGNED_INT,
-      reinterpret_cast<void*>(static_cast<uintptr_t>(offset)), draws,
-      sizeof(gl::DrawElementsIndirectCommand));
+void Renderer::cullCrowd(GLuint view, GLuint mask,
+                         const SkinningBatch::Cull& cull) {
+  cullProgram.bind();
+  skinning.cull(view, mask, cull);
+  cullEmitProgram.bind();
+  skinning.emit(view);
+}
+
+void Renderer::cullViews(bool leftActive, bool rightActive) {
+  auto scope = profiler.scope("Cull Crowd");
+
+  using Mode = SkinningBatch::Cull::Mode;
+  auto cullSide = [&](GLuint view, GLuint mask, const auto& pointLights,
+                      const auto& spotLights, size_t firstPoint,
+                      size_t firstSpot) {
+    cullCrowd(view, mask, {.mode = Mode::CAMERA});
+    // Only characters within a point light's radius can cast into its map
+    for (size_t i = 0; i < pointLights.size(); ++i) {
+      const auto& light = pointLights[i];
+      if (light.tileSize() == 0 ||
+          (!lightVisibility.visible(firstPoint + i) && light.tilesDrawn())) {
+        continue;
+      }
+      cullCrowd(pointShadowView(firstPoint + i), mask,
+                {.mode = Mode::SPHERE,
+                 .sphere = glm::vec4(light.position(), light.radius())});
+    }
+    for (size_t i = 0; i < spotLights.size(); ++i) {
+      cullCrowd(spotShadowView(firstSpot + i), mask,
+                {.mode = Mode::MATRIX, .matrix = spotLights[i].viewProj()});
+    }
+  };
+
+  // Camera culls read the matrices bound to uniform binding 0
+  if (leftActive) {
+    useLeftCamera();
+    cullSide(LEFT_VIEW, LEFT_MASK, pointLights, spotLights, 0, 0);
+  }
+  if (rightActive) {
+    useRightCamera();
+    cullSide(RIGHT_VIEW, RIGHT_MASK, rightPointLights, rightSpotLights,
+             pointLights.size(), spotLights.size());
+  }
+  camera.fullView();
+  // Skinning reads the pose flags the culls set
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Renderer::drawCrowd(GLuint view) {
+  // How many draws survived is only known on the GPU
+  skinning.draw(view, crowdVao);
+  ++counters.multiDraws;
 }
 
 void Renderer::debugUi(const engine::FrameInfo& frame) {
@@ -366,6 +740,29 @@ void Renderer::debugUi(const engine::FrameInfo& frame) {
   }
   ImGui::SeparatorText("Effects");
   ImGui::Checkbox("Enable Bloom", &enableBloom);
+  bool clustered = lightingMode == LightingMode::CLUSTERED;
+  if (ImGui::Checkbox("Clustered Lighting", &clustered)) {
+    lightingMode =
+        clustered ? LightingMode::CLUSTERED : LightingMode::VOLUMES;
+  }
+
+  ImGui::SeparatorText("Shadows");
+  ImGui::SliderFloat("Shadow Detail", &shadowDetail, 0.25f, 4.0f);
+  constexpr double ATLAS_AREA =
+      static_cast<double>(ShadowAtlas::SIZE) * ShadowAtlas::SIZE;
+  ImGui::Text("Atlas: %.1f%% used",
+              static_cast<double>(shadowAtlas.usedArea()) / ATLAS_AREA * 100.0);
+  ImGui::Text("Point lights shadowed: %zu of %zu",
+              lightVisibility.visibleCount(),
+              pointLights.size() + rightPointLights.size());
+
+  ImGui::SeparatorText("Animation LOD");
+  ImGui::SliderFloat("Full Size", &animationLod.fullSize, 0.0f, 0.5f);
+  ImGui::SliderFloat("Frozen Size", &animationLod.frozenSize, 0.0f,
+                     animationLod.fullSize);
+  ImGui::SliderInt("Reduced Interval", &animationLod.interval, 2, 4);
+  ImGui::Text("Full: %u | Reduced: %u | Frozen: %u", lodCounts[0],
+              lodCounts[1], lodCounts[2]);
 
   ImGui::SeparatorText("Post Processes");
   for (auto& pp : postProcesses) {
@@ -374,75 +771,285 @@ void Renderer::debugUi(const engine::FrameInfo& frame) {
       pp->setEnabled(enabled);
     }
   }
-}
 
-void Renderer::renderPointLights() {
-  glViewport(0, 0, PointLight::SHADOW_MAP_SIZE, PointLight::SHADOW_MAP_SIZE);
-  dynamicBuffer.bind(gl::Buffer::BasicTarget::DRAW_INDIRECT);
+  ImGui::SeparatorText("Startup");
+  ImGui::Text("Loaded %zu assets in %.2fms on %zu threads",
+              assets.timings().size(), assets.totalMs(),
+              assets.threadCount());
+  if (ImGui::TreeNode("Asset Timings")) {
+    for (const auto& timing : assets.timings()) {
+      ImGui::Text("%8.2fms decode | %8.2fms upload | %s", timing.decodeMs,
+                  timing.uploadMs, timing.name.c_str());
+    }
+    ImGui::TreePop();
+  }
 
-  glCullFace(GL_FRONT);
+  auto& programStats = programCache.stats();
+  ImGui::Text("Programs: %u cached (%.2fms), %u compiled (%.2fms)%s",
+              programStats.loaded, programStats.loadMs, programStats.compiled,
+              programStats.compileMs,
+              programCache.isEnabled() ? "" : " [cache off]");
 
-  if (camera.getSplitRatio() < 1.0f) {
-    GLuint writtenDraws = 0;
-    gl::MappingRef indirectMap = {dynamicMapping, 0};
-    for (const auto& root : graph.GetRoots()) {
-      root->writeBatchedDraws(indirectMap, writtenDraws);
+  ImGui::SeparatorText("Resource Cache");
+  resources.debugUi();
+
+  ImGui::SeparatorText("Texture Residency");
+  textureResidency.debugUi();
+
+  engine::gui::GuiWindow profilerFrame("Profiler");
+  profiler.debugUi();
+}
+
+void Renderer::layoutShadows() {
+  bool leftActive = camera.getSplitRatio() < 1.0f;
+  bool rightActive = camera.getSplitRatio() > 0.0f;
+  auto height = static_cast<float>(windowSize.height);
+  constexpr auto POINT_FACES = static_cast<GLuint>(PointLight::FACES);
+
+  // Lights are culled against this frame's cameras, so one coming into view
+  // is drawn the frame it arrives
+  lightVisibility.beginFrame(pointLights.size() + rightPointLights.size());
+  auto markInView = [&](const engine::scene::Graph& lightGraph,
+                        const engine::Camera& sideCamera) {
+    auto nodeLists = lightGraph.BuildNodeLists(sideCamera.GetFrustum(),
+                                               sideCamera.GetPosition());
+    for (const auto& entry : nodeLists.lit) {
+      lightVisibility.markInView(*entry.node);
     }
+  };
+  if (leftActive) {
+    markInView(pointLightGraph, camera.left());
+  }
+  if (rightActive) {
+    markInView(rightPointLightGraph, camera.right());
+  }
 
-    size_t idx = 0;
-    auto renderFn = [&]() {
-      shadowMatrixBuffers[idx].buffer.bindBase(
-          gl::Buffer::StorageTarget::UNIFORM, 5);
-      for (const auto& root : graph.GetRoots()) {
-        root->renderDepthOnlyCube();
+  shadowRequests.clear();
+  size_t pointIndex = 0;
+  auto request = [&](const auto& lights, GLuint faces, bool active,
+                     const glm::vec3& eye) {
+    for (const auto& light : lights) {
+      GLuint size = 0;
+      bool hidden = faces == POINT_FACES &&
+                    !lightVisibility.visible(pointIndex++);
+      if (active && hidden) {
+        // Kept at the same size, so its tiles usually stay put for when it
+        // comes back into view, rather than redrawing its static casters
+        size = light.tileSize();
+      } else if (active) {
+        glm::vec4 sphere(light.position(), light.radius());
+        size = ShadowAtlas::tileSize(sphere, eye, height, shadowDetail);
+        // Shrinking takes two steps at once, so a light sitting on a
+        // boundary does not flip between sizes and redraw its static
+        // casters every time
+        if (size * 2 == light.tileSize()) {
+          size = light.tileSize();
+        }
       }
+      shadowRequests.push_back({.faces = faces, .size = size});
+    }
+  };
+  request(pointLights, POINT_FACES, leftActive, camera.left().GetPosition());
+  request(rightPointLights, POINT_FACES, rightActive,
+          camera.right().GetPosition());
+  request(spotLights, 1, leftActive, camera.left().GetPosition());
+  request(rightSpotLights, 1, rightActive, camera.right().GetPosition());
+
+  shadowAtlas.layout(shadowRequests);
+
+  size_t index = 0;
+  auto assign = [&](auto& lights) {
+    for (auto& light : lights) {
+      light.setTiles(shadowAtlas.tiles(index++));
+    }
+  };
+  assign(pointLights);
+  assign(rightPointLights);
+  // Lights out of view light nothing on screen, so once their tiles move
+  // they go without until seen again, rather than being drawn. Lights only
+  // hidden behind the scene are drawn into moved tiles, as their late
+  // queries may not have seen them come out yet
+  for (size_t point = 0; point < index; ++point) {
+    auto& light = point < pointLights.size()
+                      ? pointLights[point]
+                      : rightPointLights[point - pointLights.size()];
+    if (!light.tilesDrawn() && !lightVisibility.inFrustum(point)) {
+      light.setTiles({});
+    }
+  }
+  assign(spotLights);
+  assign(rightSpotLights);
+}
 
-      batchVao.bind();
-      batchShadowCubeProgram.bind();
+void Renderer::testLightVisibility() {
+  auto scope = profiler.scope("Light Visibility");
+  if (!bindLights()) {
+    return;
+  }
 
-      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
-                                  writtenDraws,
-                                  sizeof(gl::DrawElementsIndirectCommand));
-      ++idx;
-    };
+  // Back faces pass wherever the scene is in front of them, so a light
+  // passes if any pixel's surface may be inside it, even with the camera
+  // inside too. Off screen it draws nothing at all. Depth is reversed, so
+  // behind is less
+  gbuffers->fbo.bind();
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_FALSE);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glEnable(GL_CULL_FACE);
+  glCullFace(GL_FRONT);
 
-    for (size_t i = 0; i < pointLights.size(); ++i) {
-      pointLights[i].renderShadowMap(renderFn, shadowMatrixBuffers[i].mapping);
+  lightVisibilityProgram.bind();
+  auto bg = pointLightMesh.bindGuard();
+  auto testSide = [&](size_t count, GLuint first, size_t firstLight) {
+    for (size_t i = 0; i < count; ++i) {
+      lightVisibility.test(firstLight + i, [&]() {
+        pointLightMesh.drawInstanced(first + static_cast<GLuint>(i), 1);
+      });
     }
+  };
+  if (camera.getSplitRatio() < 1.0f) {
+    useLeftCamera();
+    testSide(pointLights.size(), lightRanges.leftPoints, 0);
   }
-
   if (camera.getSplitRatio() > 0.0f) {
-    GLuint writtenDraws = 0;
-    gl::MappingRef indirectMap = {dynamicMapping, rightIndirectOffset};
-    for (const auto& root : rightGraph.GetRoots()) {
-      root->writeBatchedDraws(indirectMap, writtenDraws);
-    }
+    useRightCamera();
+    testSide(rightPointLights.size(), lightRanges.rightPoints,
+             pointLights.size());
+  }
+  camera.fullView();
+
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  glDepthMask(GL_TRUE);
+  glDepthFunc(GL_GREATER);
+}
+
+void Renderer::renderPointLights() {
+  auto scope = profiler.scope("Point Lights");
+  auto shadowScope = profiler.scope("Shadows");
 
-    size_t idx = 0;
-    auto renderFn = [&]() {
-      shadowMatrixBuffers[idx + pointLights.size()].buffer.bindBase(
-          gl::Buffer::StorageTarget::UNIFORM, 5);
-      for (const auto& root : rightGraph.GetRoots()) {
-        root->renderDepthOnlyCube();
+  glCullFace(GL_FRONT);
+
+  // The graph's roots never move, so they are drawn into each light's static
+  // tiles once and copied back every time the crowd is drawn over them
+  auto renderSide = [&](std::vector<PointLight>& lights,
+                        const engine::scene::Graph& sideGraph,
+                        const SceneIndex& index,
+                        const std::deque<Character>& sideCrowd,
+                        GLuint maxCommands, size_t firstView) {
+    uint64_t version = index.version();
+    CrowdBox box = crowdBox(sideCrowd);
+
+    GLuint view = 0;
+    GLuint matrixOffset = 0;
+    const PointLight* current = nullptr;
+    std::optional<GLuint> commands = std::nullopt;
+    auto renderStatic = [&]() {
+      // Only roots inside one of the faces' frustums can cast into the
+      // light, and the geometry shader then sends each of their triangles to
+      // just the faces it touches
+      visibleRoots.clear();
+      for (const auto& faceViewProj : current->faceViewProjs()) {
+        index.query(SceneIndex::planes(faceViewProj), visibleRoots);
+      }
+      std::ranges::sort(visibleRoots);
+      auto duplicates = std::ranges::unique(visibleRoots);
+      visibleRoots.erase(duplicates.begin(), duplicates.end());
+      const auto& roots = sideGraph.GetRoots();
+      auto writtenDraws = writeDraws(
+          *commands, maxCommands, visibleRoots.size(),
+          [&](size_t i) { return roots[visibleRoots[i]].get(); });
+
+      dynamicRing.getBuffer().bindRange(gl::Buffer::StorageTarget::UNIFORM, 5,
+                                        matrixOffset,
+                                        sizeof(PointLight::LightUniform));
+      for (uint32_t root : visibleRoots) {
+        roots[root]->renderDepthOnlyCube();
       }
 
-      batchVao.bind();
       batchShadowCubeProgram.bind();
-
-      glMultiDrawElementsIndirect(
-          GL_TRIANGLES, GL_UNSIGNED_INT,
-          reinterpret_cast<void*>(static_cast<uintptr_t>(rightIndirectOffset)),
-          writtenDraws, sizeof(gl::DrawElementsIndirectCommand));
-      ++idx;
+      if (writtenDraws.commands > 0) {
+        batchVao.bind();
+        dynamicRing.getBuffer().bind(gl::Buffer::BasicTarget::DRAW_INDIRECT);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    indirectOffset(*commands),
+                                    writtenDraws.commands, COMMAND_SIZE);
+        ++counters.multiDraws;
+        counters.batchedDraws += writtenDraws.draws;
+      }
+      ++counters.shadowPasses;
+    };
+    auto renderDynamic = [&]() {
+      dynamicRing.getBuffer().bindRange(gl::Buffer::StorageTarget::UNIFORM, 5,
+                                        matrixOffset,
+                                        sizeof(PointLight::LightUniform));
+      batchShadowCubeProgram.bind();
+      crowdVao.bind();
+      drawCrowd(view);
+      ++counters.shadowPasses;
     };
 
-    for (size_t i = 0; i < rightPointLights.size(); ++i) {
-      rightPointLights[i].renderShadowMap(
-          renderFn, shadowMatrixBuffers[i + pointLights.size()].mapping);
+    for (size_t i = 0; i < lights.size(); ++i) {
+      auto& light = lights[i];
+      if (light.tileSize() == 0) {
+        continue;
+      }
+      // Its tiles keep whatever they last held until it is seen again,
+      // unless they moved
+      if (!lightVisibility.visible(firstView + i) && light.tilesDrawn()) {
+        ++counters.hiddenShadows;
+        continue;
+      }
+      bool stale = light.staticStale(version);
+      bool dynamic = casterInRange(
+          sideCrowd, box, glm::vec4(light.position(), light.radius()));
+      if (!stale && !light.shadowStale(dynamic)) {
+        ++counters.cachedShadows;
+        continue;
+      }
+      // Each light gets its own slice, as the last light's draws may not
+      // have been read yet. Without one the light stays stale and tries
+      // again next frame, rather than caching a map missing the batches
+      if (stale) {
+        commands = dynamicRing.allocate(maxCommands * COMMAND_SIZE);
+        if (!commands) {
+          Logger::error("Frame ring is full, skipping point shadow draws");
+          continue;
+        }
+      }
+
+      auto matrices = dynamicRing.allocate(sizeof(PointLight::LightUniform));
+      if (!matrices) {
+        Logger::error("Frame ring is full, skipping point shadow map");
+        continue;
+      }
+      view = pointShadowView(firstView + i);
+      matrixOffset = *matrices;
+      current = &light;
+      if (stale) {
+        light.renderStaticMap(shadowAtlas, renderStatic,
+                              dynamicRing.ref(*matrices), version);
+      }
+      light.renderShadowMap(shadowAtlas, renderDynamic,
+                            dynamicRing.ref(*matrices), dynamic);
     }
+  };
+
+  if (camera.getSplitRatio() < 1.0f) {
+    renderSide(pointLights, graph, graphIndex, crowd,
+               leftCounted.params.maxIndirectCmds, 0);
+  }
+  if (camera.getSplitRatio() > 0.0f) {
+    renderSide(rightPointLights, rightGraph, rightGraphIndex, rightCrowd,
+               rightCounted.params.maxIndirectCmds, pointLights.size());
   }
 
   gl::Vao::unbind();
+  shadowScope.end();
+  if (lightingMode == LightingMode::CLUSTERED) {
+    return;
+  }
+  auto lightingScope = profiler.scope("Lighting");
 
   pointLight.bind();
 
@@ -465,106 +1072,140 @@ void Renderer::renderPointLights() {
 
   glUniform1ui(3, 0);
 
+  if (!bindLights()) {
+    return;
+  }
+  // Every light of a camera in one draw, each instance reading its own
+  // entry and shadow map from the light buffer
   auto bg = pointLightMesh.bindGuard();
-  if (camera.getSplitRatio() < 1.0f) {
+  if (camera.getSplitRatio() < 1.0f && !pointLights.empty()) {
     useLeftCamera();
-    for (size_t i = 0; i < pointLights.size(); ++i) {
-      glUniform3fv(0, 1, &pointLights[i].position()[0]);
-      glUniform1f(1, pointLights[i].radius());
-      glUniform4fv(2, 1, &pointLights[i].color()[0]);
-      pointLights[i].getShadowMap().bind(4);
-      pointLightMesh.draw();
-    }
+    pointLightMesh.drawInstanced(lightRanges.leftPoints,
+                                 static_cast<GLsizei>(pointLights.size()));
+    counters.lightVolumes += static_cast<uint32_t>(pointLights.size());
   }
-  if (camera.getSplitRatio() > 0.0f) {
+  if (camera.getSplitRatio() > 0.0f && !rightPointLights.empty()) {
     useRightCamera();
-    for (size_t i = 0; i < rightPointLights.size(); ++i) {
-      glUniform3fv(0, 1, &rightPointLights[i].position()[0]);
-      glUniform1f(1, rightPointLights[i].radius());
-      glUniform4fv(2, 1, &rightPointLights[i].color()[0]);
-      rightPointLights[i].getShadowMap().bind(4);
-      pointLightMesh.draw();
-    }
+    pointLightMesh.drawInstanced(
+        lightRanges.rightPoints,
+        static_cast<GLsizei>(rightPointLights.size()));
+    counters.lightVolumes += static_cast<uint32_t>(rightPointLights.size());
   }
   camera.fullView();
 }
 
 void Renderer::renderSpotLights() {
-  glViewport(0, 0, SpotLight::SHADOW_MAP_SIZE, SpotLight::SHADOW_MAP_SIZE);
-  dynamicBuffer.bind(gl::Buffer::BasicTarget::DRAW_INDIRECT);
+  auto scope = profiler.scope("Spot Lights");
+  auto shadowScope = profiler.scope("Shadows");
 
   glCullFace(GL_FRONT);
   glEnable(GL_DEPTH_TEST);
 
-  if (camera.getSplitRatio() < 1.0f && !spotLights.empty()) {
-
-    size_t idx = 0;
-    auto renderFn = [&](const engine::Frustum& frustum,
-                        const glm::vec3& position) {
-      auto nodeLists = graph.BuildNodeLists(frustum, position);
-
-      GLuint writtenDraws = 0;
-      gl::MappingRef indirectMap = {dynamicMapping, 0};
-      for (const auto& root : nodeLists.lit) {
-        root.node->writeBatchedDraws(indirectMap, writtenDraws);
+  // Cached the same way as point lights
+  auto renderSide = [&](std::vector<SpotLight>& lights,
+                        const engine::scene::Graph& sideGraph,
+                        const SceneIndex& index,
+                        const std::deque<Character>& sideCrowd,
+                        GLuint maxCommands, size_t firstView) {
+    uint64_t version = index.version();
+    CrowdBox box = crowdBox(sideCrowd);
+
+    GLuint view = 0;
+    GLuint matrixOffset = 0;
+    std::optional<GLuint> commands = std::nullopt;
+    auto renderStatic = [&](const engine::Frustum& frustum,
+                            const glm::mat4& viewProj) {
+      // Shadows need neither the render type lists nor their sorting, so
+      // the index is enough
+      visibleRoots.clear();
+      index.query(SceneIndex::planes(viewProj), visibleRoots);
+      const auto& roots = sideGraph.GetRoots();
+      auto writtenDraws = writeDraws(
+          *commands, maxCommands, visibleRoots.size(),
+          [&](size_t i) { return roots[visibleRoots[i]].get(); });
+
+      dynamicRing.getBuffer().bindRange(gl::Buffer::StorageTarget::UNIFORM, 5,
+                                        matrixOffset,
+                                        sizeof(SpotLight::LightUniform));
+      for (uint32_t root : visibleRoots) {
+        roots[root]->renderDepthOnly(frustum);
       }
 
-      spotShadowMatrixBuffers[idx].buffer.bindBase(
-          gl::Buffer::StorageTarget::UNIFORM, 5);
-      for (const auto& root : nodeLists.lit) {
-        root.node->renderDepthOnly(frustum);
+      batchShadowProgram.bind();
+      if (writtenDraws.commands > 0) {
+        batchVao.bind();
+        dynamicRing.getBuffer().bind(gl::Buffer::BasicTarget::DRAW_INDIRECT);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    indirectOffset(*commands),
+                                    writtenDraws.commands, COMMAND_SIZE);
+        ++counters.multiDraws;
+        counters.batchedDraws += writtenDraws.draws;
       }
-
-      batchVao.bind();
+      ++counters.shadowPasses;
+    };
+    auto renderDynamic = [&]() {
+      dynamicRing.getBuffer().bindRange(gl::Buffer::StorageTarget::UNIFORM, 5,
+                                        matrixOffset,
+                                        sizeof(SpotLight::LightUniform));
       batchShadowProgram.bind();
-
-      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
-                                  writtenDraws,
-                                  sizeof(gl::DrawElementsIndirectCommand));
-      ++idx;
+      crowdVao.bind();
+      drawCrowd(view);
+      ++counters.shadowPasses;
     };
 
-    for (size_t i = 0; i < spotLights.size(); ++i) {
-      spotLights[i].renderShadowMap(renderFn,
-                                    spotShadowMatrixBuffers[i].mapping);
-    }
-  }
-
-  if (camera.getSplitRatio() > 0.0f && !rightSpotLights.empty()) {
-    size_t idx = 0;
-    auto renderFn = [&](const engine::Frustum& frustum,
-                        const glm::vec3& position) {
-      auto nodeLists = rightGraph.BuildNodeLists(frustum, position);
-
-      GLuint writtenDraws = 0;
-      gl::MappingRef indirectMap = {dynamicMapping, rightIndirectOffset};
-      for (const auto& root : nodeLists.lit) {
-        root.node->writeBatchedDraws(indirectMap, writtenDraws);
+    for (size_t i = 0; i < lights.size(); ++i) {
+      auto& light = lights[i];
+      if (light.tileSize() == 0) {
+        continue;
       }
-
-      spotShadowMatrixBuffers[idx + spotLights.size()].buffer.bindBase(
-          gl::Buffer::StorageTarget::UNIFORM, 5);
-      for (const auto& root : nodeLists.lit) {
-        root.node->renderDepthOnly(frustum);
+      bool stale = light.staticStale(version);
+      // The light's sphere bounds its cone, which the GPU cull then trims to
+      bool dynamic = casterInRange(
+          sideCrowd, box, glm::vec4(light.position(), light.radius()));
+      if (!stale && !light.shadowStale(dynamic)) {
+        ++counters.cachedShadows;
+        continue;
+      }
+      // Each light gets its own slice, as for point lights
+      if (stale) {
+        commands = dynamicRing.allocate(maxCommands * COMMAND_SIZE);
+        if (!commands) {
+          Logger::error("Frame ring is full, skipping spot shadow draws");
+          continue;
+        }
       }
 
-      batchVao.bind();
-      batchShadowProgram.bind();
-
-      glMultiDrawElementsIndirect(
-          GL_TRIANGLES, GL_UNSIGNED_INT,
-          reinterpret_cast<void*>(static_cast<uintptr_t>(rightIndirectOffset)),
-          writtenDraws, sizeof(gl::DrawElementsIndirectCommand));
-      ++idx;
-    };
-
-    for (size_t i = 0; i < rightSpotLights.size(); ++i) {
-      rightSpotLights[i].renderShadowMap(
-          renderFn, spotShadowMatrixBuffers[i + spotLights.size()].mapping);
+      auto matrices = dynamicRing.allocate(sizeof(SpotLight::LightUniform));
+      if (!matrices) {
+        Logger::error("Frame ring is full, skipping spot shadow map");
+        continue;
+      }
+      view = spotShadowView(firstView + i);
+      matrixOffset = *matrices;
+      if (stale) {
+        light.renderStaticMap(shadowAtlas, renderStatic,
+                              dynamicRing.ref(*matrices), version);
+      }
+      light.renderShadowMap(shadowAtlas, renderDynamic,
+                            dynamicRing.ref(*matrices), dynamic);
     }
+  };
+
+  if (camera.getSplitRatio() < 1.0f) {
+    renderSide(spotLights, graph, graphIndex, crowd,
+               leftCounted.params.maxIndirectCmds, 0);
+  }
+  if (camera.getSplitRatio() > 0.0f) {
+    renderSide(rightSpotLights, rightGraph, rightGraphIndex, rightCrowd,
+               rightCounted.params.maxIndirectCmds, spotLights.size());
   }
 
   gl::Vao::unbind();
+  shadowScope.end();
+  if (lightingMode == LightingMode::CLUSTERED) {
+    return;
+  }
+  auto lightingScope = profiler.scope("Lighting");
 
   spotLight.bind();
   lightFbo.fbo.bind();
@@ -574,37 +1215,105 @@ void Renderer::renderSpotLights() {
   glEnable(GL_BLEND);
   glBlendFunc(GL_ONE, GL_ONE);
 
+  if (!bindLights()) {
+    return;
+  }
   auto bg = spotLightMesh.bindGuard();
-  if (camera.getSplitRatio() < 1.0f) {
+  if (camera.getSplitRatio() < 1.0f && !spotLights.empty()) {
     useLeftCamera();
-    for (size_t i = 0; i < spotLights.size(); ++i) {
-      glUniform3fv(0, 1, &spotLights[i].position()[0]);
-      glUniform1f(1, spotLights[i].radius());
-      glUniform4fv(2, 1, &spotLights[i].color()[0]);
-      glUniform3fv(3, 1, &spotLights[i].direction()[0]);
-      auto modelMatrix = spotLights[i].modelMatrix();
-      glUniformMatrix4fv(4, 1, GL_FALSE, &modelMatrix[0].x);
-      spotLights[i].getShadowMap().bind(4);
-      spotLightMesh.draw();
+    spotLightMesh.drawInstanced(lightRanges.leftSpots,
+                                static_cast<GLsizei>(spotLights.size()));
+    counters.lightVolumes += static_cast<uint32_t>(spotLights.size());
+  }
+  if (camera.getSplitRatio() > 0.0f && !rightSpotLights.empty()) {
+    useRightCamera();
+    spotLightMesh.drawInstanced(lightRanges.rightSpots,
+                                static_cast<GLsizei>(rightSpotLights.size()));
+    counters.lightVolumes += static_cast<uint32_t>(rightSpotLights.size());
+  }
+  camera.fullView();
+}
+
+void Renderer::writeLights() {
+  constexpr auto LIGHT_SIZE = static_cast<GLuint>(sizeof(LightData));
+  auto count = static_cast<GLuint>(pointLights.size() + spotLights.size() +
+                                   rightPointLights.size() +
+                                   rightSpotLights.size());
+  // Bound even when empty, so always at least one light long
+  GLuint size = std::max(count, 1u) * LIGHT_SIZE;
+  auto offset = dynamicRing.allocate(size);
+  if (!offset) {
+    Logger::error("Frame ring is full, skipping lighting");
+    lightRanges = {};
+    return;
+  }
+
+  GLuint index = 0;
+  auto write = [&](const auto& lights) {
+    GLuint first = index;
+    for (const auto& light : lights) {
+      light.writeInstanceData(dynamicRing.ref(*offset + index * LIGHT_SIZE));
+      ++index;
     }
+    return first;
+  };
+  lightRanges.offset = *offset;
+  lightRanges.size = size;
+  lightRanges.leftPoints = write(pointLights);
+  lightRanges.leftSpots = write(spotLights);
+  lightRanges.rightPoints = write(rightPointLights);
+  lightRanges.rightSpots = write(rightSpotLights);
+}
+
+bool Renderer::bindLights() {
+  if (lightRanges.size == 0) {
+    return false;
+  }
+  dynamicRing.getBuffer().bindRange(gl::Buffer::StorageTarget::STORAGE, 1,
+                                    lightRanges.offset, lightRanges.size);
+  shadowAtlas.texture().bind(5);
+  return true;
+}
+
+void Renderer::renderClusteredLights() {
+  auto scope = profiler.scope("Clustered Lights");
+
+  if (!bindLights()) {
+    return;
+  }
+
+  lightFbo.fbo.bind();
+  gbuffers->diffuse.bind(0);
+  gbuffers->normal.bind(1);
+  gbuffers->material.bind(2);
+  gbuffers->depthStencil.bind(3);
+
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_BLEND);
+
+  // Every pixel of the viewport is written, so the light buffers need no
+  // clear
+  auto bg = engine::globals::DUMMY_VAO.bindGuard();
+  if (camera.getSplitRatio() < 1.0f) {
+    useLeftCamera();
+    clusteredLighting.bin(0, lightRanges.leftPoints,
+                          lightRanges.rightPoints - lightRanges.leftPoints);
+    clusteredLighting.shade(0);
   }
   if (camera.getSplitRatio() > 0.0f) {
     useRightCamera();
-    for (size_t i = 0; i < rightSpotLights.size(); ++i) {
-      glUniform3fv(0, 1, &rightSpotLights[i].position()[0]);
-      glUniform1f(1, rightSpotLights[i].radius());
-      glUniform4fv(2, 1, &rightSpotLights[i].color()[0]);
-      glUniform3fv(3, 1, &rightSpotLights[i].direction()[0]);
-      auto modelMatrix = rightSpotLights[i].modelMatrix();
-      glUniformMatrix4fv(4, 1, GL_FALSE, &modelMatrix[0].x);
-      rightSpotLights[i].getShadowMap().bind(4);
-      spotLightMesh.draw();
-    }
+    clusteredLighting.bin(
+        1, lightRanges.rightPoints,
+        static_cast<GLuint>(rightPointLights.size() + rightSpotLights.size()));
+    clusteredLighting.shade(1);
   }
   camera.fullView();
 }
 
 bool Renderer::combineDeferredLightBuffers() {
+  auto scope = profiler.scope("Combine Lights");
+
   glDisable(GL_CULL_FACE);
   glDisable(GL_BLEND);
 
@@ -630,6 +1339,8 @@ bool Renderer::combineDeferredLightBuffers() {
 }
 
 void Renderer::renderPostProcesses() {
+  auto scope = profiler.scope("Post Processes");
+
   glDisable(GL_DEPTH_TEST);
   glDisable(GL_CULL_FACE);
   glEnable(GL_BLEND);
@@ -646,9 +1357,13 @@ void Renderer::renderPostProcesses() {
   if (enableBloom) {
     flip();
     bloomBrightTex.bind(0);
-    blurPP.run(flip);
+    {
+      auto blurScope = profiler.scope(blurPP.name());
+      blurPP.run(flip);
+    }
     flip();
     hdrOutput.tex.bind(1);
+    auto bloomScope = profiler.scope(bloomPP.name());
     bloomPP.run(flip);
   } else {
     hdrOutput.fbo.blit(postProcessFlipFlops[0].fbo.id(), 0, 0, windowSize.width,
@@ -668,6 +1383,7 @@ void Renderer::renderPostProcesses() {
       continue;
     flip();
 
+    auto ppScope = profiler.scope(pp->name());
     if (camera.getSplitRatio() < 1.0f) {
       useLeftCamera();
       pp->run(flip);
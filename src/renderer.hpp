@@ -1,20 +1,38 @@
 #pragma once
 
+#include "assetLoader.hpp"
+#include "benchmark.hpp"
 #include "blur.hpp"
 #include "cameraTrack.hpp"
+#include "character.hpp"
+#include "clusteredLighting.hpp"
+#include "frameRing.hpp"
+#include "lightVisibility.hpp"
 #include "pointLight.hpp"
 #include "postprocess.hpp"
+#include "profiler.hpp"
+#include "programCache.hpp"
+#include "resourceCache.hpp"
+#include "scenePool.hpp"
+#include "sceneIndex.hpp"
+#include "shadowAtlas.hpp"
+#include "skinningBatch.hpp"
+#include "staticMesh.hpp"
+#include "textureResidency.hpp"
+#include "threadPool.hpp"
 #include <array>
+#include <deque>
 #include <engine/app.hpp>
-#include <engine/mesh/basic.hpp>
 #include <engine/split_camera.hpp>
 #include <gl/gl.hpp>
 #include <memory>
+#include <optional>
 #include <spotLight.hpp>
 
 class Renderer : public engine::App {
 public:
-  Renderer(int width, int height, const char title[]);
+  Renderer(int width, int height, const char title[],
+           std::optional<Benchmark::Options> benchmark = std::nullopt);
 
   bool update(const engine::FrameInfo& frame) override;
   void render(const engine::FrameInfo& frame) override;
@@ -29,22 +47,147 @@ private:
   void setupLights();
 
   void debugUi(const engine::FrameInfo& frame);
+  void renderFrame(const engine::FrameInfo& info);
+
+  ThreadPool threadPool;
+  AssetLoader assets{threadPool};
+  ProgramCache programCache{PROGRAMCACHEDIR};
+  ResourceCache resources{assets, programCache};
+  TextureResidency textureResidency{assets};
+  Profiler profiler;
 
   struct BatchSetup {
+    uint32_t indirectOffset;
+    uint32_t rightIndirectOffset;
     uint32_t textureOffset;
+    uint32_t rightTextureOffset;
+    /// Covers both cameras' sections
     uint32_t textureSize;
     uint32_t draws;
   };
 
   BatchSetup setupBatches();
+
+  struct CountedDrawParams {
+    bool valid = false;
+    size_t roots = 0;
+    engine::scene::Node::DrawParams params = {0, 0, 0};
+    /// Summed params of the roots before each, which is where each root's
+    /// instances and texture sets start
+    std::vector<engine::scene::Node::DrawParams> firsts;
+  };
+
+  /// <summary>
+  /// The graph's summed batch draw params, only recounted when its roots
+  /// change. Roots are counted in parallel.
+  /// </summary>
+  const engine::scene::Node::DrawParams&
+  countDrawParams(const engine::scene::Graph& from, CountedDrawParams& counted);
+  CountedDrawParams leftCounted;
+  CountedDrawParams rightCounted;
+
+  struct WrittenDraws {
+    /// Commands to multi draw, including padding
+    GLuint commands = 0;
+    /// Commands the nodes wrote, for the counters
+    GLuint draws = 0;
+  };
+
+  /// <summary>
+  /// Writes the batched draws of count nodes from offset, on the thread pool.
+  /// Each node's maximum is counted and prefix summed first, so every node
+  /// writes its own range at once. Nodes writing fewer pad with empty draws.
+  /// Falls back to a single thread if the maximums would overrun capacity.
+  /// </summary>
+  template <typename NodeAt>
+  WrittenDraws writeDraws(GLuint offset, GLuint capacity, size_t count,
+                          const NodeAt& nodeAt);
+  // Where each node's draws start, reused between passes
+  std::vector<GLuint> drawFirsts;
   void renderLit(const engine::scene::Graph::NodeLists& nodeLists,
                  const BatchSetup& batch, const engine::Camera& camera,
-                 GLuint offset);
+                 GLuint offset, GLuint textureOffset, GLuint view,
+                 GLuint mask);
+
+  // Views the skinning batch culls and draws. Each shadow map gets its own,
+  // point lights first, left graph's lights before the right's
+  constexpr static GLuint LEFT_VIEW = 0;
+  constexpr static GLuint RIGHT_VIEW = 1;
+  constexpr static GLuint FIRST_SHADOW_VIEW = 2;
+  inline GLuint pointShadowView(size_t light) const {
+    return FIRST_SHADOW_VIEW + static_cast<GLuint>(light);
+  }
+  inline GLuint spotShadowView(size_t light) const {
+    return pointShadowView(pointLights.size() + rightPointLights.size() +
+                           light);
+  }
+  inline GLuint viewCount() const {
+    return spotShadowView(spotLights.size() + rightSpotLights.size());
+  }
+  // Which graph's crowd a view draws
+  constexpr static GLuint LEFT_MASK = 1;
+  constexpr static GLuint RIGHT_MASK = 2;
+
+  /// <summary>
+  /// Culls the crowd for the view and writes its draws, all on the GPU.
+  /// </summary>
+  void cullCrowd(GLuint view, GLuint mask, const SkinningBatch::Cull& cull);
+  /// <summary>
+  /// Culls the crowd for every camera and shadow view of the active sides,
+  /// before skinning, so only poses some view kept are skinned.
+  /// </summary>
+  void cullViews(bool leftActive, bool rightActive);
+  /// <summary>
+  /// Draws what cullViews kept with the bound program. crowdVao must be
+  /// bound.
+  /// </summary>
+  void drawCrowd(GLuint view);
+  /// <summary>
+  /// Sizes every light's tiles in the shadow atlas from how large it is on
+  /// its camera's screen. Lights on a hidden side get none, and point lights
+  /// lighting nothing on screen keep what they have.
+  /// </summary>
+  void layoutShadows();
+  /// <summary>
+  /// Queries which point lights reach anything in the G-buffer, for the
+  /// frames after this one to skip the shadows of those that do not.
+  /// </summary>
+  void testLightVisibility();
   void renderPointLights();
   void renderSpotLights();
+  /// <summary>
+  /// Shades every point and spot light at once with the clustered pass.
+  /// Their shadow maps must already be rendered.
+  /// </summary>
+  void renderClusteredLights();
+
+  /// Where each group of lights starts in the frame's light buffer
+  struct LightRanges {
+    GLuint offset = 0;
+    /// 0 if the ring had no room, in which case nothing is lit
+    GLuint size = 0;
+    GLuint leftPoints = 0;
+    GLuint leftSpots = 0;
+    GLuint rightPoints = 0;
+    GLuint rightSpots = 0;
+  };
+  LightRanges lightRanges;
+  /// <summary>
+  /// Writes every light into the frame's light buffer once, for whichever
+  /// lighting pass runs.
+  /// </summary>
+  void writeLights();
+  /// <summary>
+  /// Binds the light buffer to storage binding 1 and the shadow atlas to
+  /// unit 5.
+  /// </summary>
+  /// <returns>False if there is none this frame</returns>
+  bool bindLights();
   bool combineDeferredLightBuffers();
   void renderPostProcesses();
 
+  constexpr static float CAMERA_NEAR = 0.1f;
+  constexpr static float CAMERA_FAR = 10000.0f;
   engine::SplitCamera<engine::PerspectiveCamera, engine::PerspectiveCamera>
       camera;
 
@@ -53,37 +196,55 @@ private:
 
   engine::scene::Graph graph;
   engine::scene::Graph rightGraph;
+  // Bounds of each graph's roots, by root index
+  SceneIndex graphIndex;
+  SceneIndex rightGraphIndex;
+  std::vector<uint32_t> visibleRoots;
+
+  // Characters live outside the graphs, so they are only ever culled on
+  // the GPU. Their transforms and animation are pooled in scene, which must
+  // outlive them. Deques construct them in place and never move them
+  ScenePool scene{threadPool};
+  std::deque<Character> crowd;
+  std::deque<Character> rightCrowd;
+  AnimationLod animationLod;
+  // Characters in each tier last frame, by AnimationLod::Tier
+  std::array<uint32_t, AnimationLod::TIER_COUNT> lodCounts = {};
 
   bool onTrack = true;
   CameraTrack track = {};
 
+  std::optional<Benchmark> benchmark = std::nullopt;
+  FrameCounters counters = {};
+
   GLuint staticVertexSize = 0;
-  GLuint jointOffset = 0;
-  GLuint jointSize = 0;
-  GLuint rightIndirectOffset = 0;
+  GLuint keyOffset = 0;
+  GLuint keySize = 0;
+  GLuint clipOffset = 0;
+  GLuint clipSize = 0;
 
   gl::Program skinProgram;
+  gl::Program cullProgram;
+  gl::Program cullEmitProgram;
+  SkinningBatch skinning;
 
   gl::Buffer staticBuffer;
   gl::Buffer skinnedVerticesBuffer;
-  gl::Buffer dynamicBuffer;
-  gl::Mapping dynamicMapping;
+  // Draws, instances, texture sets, light matrices and skinning inputs,
+  // written fresh every frame
+  FrameRing dynamicRing{"Dynamic Buffer"};
 
   gl::Vao batchVao;
+  // Same format as batchVao, but reads instances from the skinning batch's
+  // culled output
+  gl::Vao crowdVao;
   gl::Program batchProgram;
 
   gl::Program batchShadowProgram;
   gl::Program batchShadowCubeProgram;
 
-  struct MappedBuffer {
-    gl::Buffer buffer;
-    gl::Mapping mapping;
-  };
-
-  std::vector<MappedBuffer> shadowMatrixBuffers;
-  std::vector<MappedBuffer> spotShadowMatrixBuffers;
-
   gl::Program pointLight;
+  gl::Program lightVisibilityProgram;
   gl::Program spotLight;
   gl::Program deferredLightCombine;
 
@@ -95,16 +256,37 @@ private:
 
   LightFbo lightFbo = {};
 
-  engine::mesh::BasicMesh pointLightMesh;
+  StaticMesh pointLightMesh;
   std::vector<PointLight> pointLights = {};
   std::vector<PointLight> rightPointLights = {};
 
-  engine::mesh::BasicMesh spotLightMesh;
+  StaticMesh spotLightMesh;
   std::vector<SpotLight> spotLights = {};
   std::vector<SpotLight> rightSpotLights = {};
 
-  gl::CubeMap envMap = {};
-  gl::CubeMap nightEnvMap = {};
+  // Every light's shadow map. Requests are by light, point lights first
+  ShadowAtlas shadowAtlas;
+  std::vector<ShadowAtlas::Request> shadowRequests;
+  // Scales every light's tile size, see ShadowAtlas::tileSize
+  float shadowDetail = 1.0f;
+  // Point lights by shadow view, left then right
+  LightVisibility lightVisibility;
+  // A LightVisibility::proxy per point light, culled against each camera
+  engine::scene::Graph pointLightGraph;
+  engine::scene::Graph rightPointLightGraph;
+
+  enum class LightingMode {
+    /// A sphere or cone per light, each reading the G-buffer again, drawn
+    /// instanced per camera and light type
+    VOLUMES,
+    /// One full screen pass per camera over binned lights
+    CLUSTERED,
+  };
+  LightingMode lightingMode = LightingMode::CLUSTERED;
+  ClusteredLighting clusteredLighting;
+
+  std::shared_ptr<gl::CubeMap> envMap = nullptr;
+  std::shared_ptr<gl::CubeMap> nightEnvMap = nullptr;
 
   std::vector<std::unique_ptr<PostProcess>> postProcesses;
   PostProcess copyPP;
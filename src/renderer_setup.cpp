@@ -1,90 +1,66 @@
 #include "renderer.hpp"
 
+#include "animationClip.hpp"
+#include "character.hpp"
 #include "heightmap.hpp"
 #include "logger/logger.hpp"
+#include "meshPack.hpp"
+#include "packedVertex.hpp"
 #include "skybox.hpp"
 #include "water.hpp"
 #include <engine/image.hpp>
+#include <cstring>
 #include <engine/mesh/mesh.hpp>
-#include <engine/mesh/mesh_material.hpp>
-#include <engine/mesh_node.hpp>
 #include <random>
 
 namespace {
-  std::expected<engine::mesh::TextureSet, std::string>
-  createTextureSet(const engine::mesh::MaterialEntry& matEntry,
-                   const std::string_view name) {
-    engine::mesh::TextureSet texSet;
-    auto diffuseImgPathOpt = matEntry.GetEntry("Diffuse");
-    if (!diffuseImgPathOpt) {
+  // Registers every map of a layer with the residency manager. Nothing is
+  // uploaded until a character using the layer is first drawn.
+  std::expected<SkinnedMesh::TextureSet, std::string>
+  registerTextureSet(TextureResidency& textures, const MeshPack& pack,
+                     const MeshPack::Layer& layer,
+                     const std::string_view name) {
+    auto add = [&](uint32_t entry, TexturePack::Role role,
+                   std::string_view map)
+        -> std::expected<TextureResidency::Id, std::string> {
+      auto path = pack.string(entry);
+      if (!path) {
+        return TextureResidency::NONE;
+      }
+      auto image = std::string(TEXTUREDIR) + path->data();
+      auto id = textures.add(TexturePack::pathFor(image),
+                             {role, {{image, true}}},
+                             fmt::format("{} {}", name, map));
+      if (!id) {
+        return std::unexpected(fmt::format(
+            "Failed to load {} texture: {} for {}", map, id.error(), name));
+      }
+      return id;
+    };
+
+    if (!pack.string(layer.diffuse)) {
       return std::unexpected(
           fmt::format("Material {} missing diffuse texture", name));
     }
-    auto diffuseRes = engine::Image::fromFile(
-        std::string(TEXTUREDIR) + diffuseImgPathOpt->data(), true, 4);
-    if (!diffuseRes) {
-      return std::unexpected(
-          fmt::format("Failed to load diffuse texture: {} for {}",
-                      diffuseRes.error(), name));
-    }
-    auto diffuseTex = diffuseRes->toTexture(-1);
-    diffuseTex.label(fmt::format("{} Diffuse", name).c_str());
-    diffuseTex.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    diffuseTex.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    texSet.images.diffuse = std::move(diffuseTex);
-    auto diffuseHandle = texSet.images.diffuse.createHandle();
-    if (!diffuseHandle.isValid()) {
-      return std::unexpected(
-          fmt::format("Failed to create diffuse texture handle for {}", name));
+
+    SkinnedMesh::TextureSet texSet;
+    auto diffuse = add(layer.diffuse, TexturePack::Role::COLOR, "Diffuse");
+    if (!diffuse) {
+      return std::unexpected(diffuse.error());
     }
-    diffuseHandle.use();
-    texSet.handles.diffuse = diffuseHandle.handle();
-
-    auto normalImgPathOpt = matEntry.GetEntry("Normal");
-    if (normalImgPathOpt) {
-      auto normalRes = engine::Image::fromFile(
-          std::string(TEXTUREDIR) + (normalImgPathOpt->data()), true, 4);
-      if (!normalRes) {
-        return std::unexpected(
-            fmt::format("Failed to load goober normal texture: {} for {}",
-                        normalRes.error(), name));
-      }
-      auto normalTex = normalRes->toTexture(-1);
-      normalTex.label(fmt::format("{} Normal", name).c_str());
-      normalTex.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-      normalTex.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      texSet.images.bump = std::move(normalTex);
-      auto normalHandle = texSet.images.bump->createHandle();
-      if (!normalHandle.isValid()) {
-        return std::unexpected(fmt::format(
-            "Failed to create goober normal texture handle for {}", name));
-      }
-      normalHandle.use();
-      texSet.handles.bump = normalHandle.handle();
+    texSet.diffuse = *diffuse;
+
+    auto normal = add(layer.normal, TexturePack::Role::NORMAL, "Normal");
+    if (!normal) {
+      return std::unexpected(normal.error());
     }
+    texSet.bump = *normal;
 
-    auto materialImgPathOpt = matEntry.GetEntry("Material");
-    if (materialImgPathOpt) {
-      auto materialRes = engine::Image::fromFile(
-          std::string(TEXTUREDIR) + (materialImgPathOpt->data()), true, 4);
-      if (!materialRes) {
-        return std::unexpected(
-            fmt::format("Failed to load goober material texture: {} for {}",
-                        materialRes.error(), name));
-      }
-      auto materialTex = materialRes->toTexture(-1);
-      materialTex.label(fmt::format("{} Material", name).c_str());
-      materialTex.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-      materialTex.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      texSet.images.material = std::move(materialTex);
-      auto materialHandle = texSet.images.material->createHandle();
-      if (!materialHandle.isValid()) {
-        return std::unexpected(fmt::format(
-            "Failed to create goober material texture handle for {}", name));
-      }
-      materialHandle.use();
-      texSet.handles.material = materialHandle.handle();
+    auto material = add(layer.material, TexturePack::Role::COLOR, "Material");
+    if (!material) {
+      return std::unexpected(material.error());
     }
+    texSet.material = *material;
 
     return texSet;
   }
@@ -99,68 +75,110 @@ namespace {
     EnvPath(const char* p) : path(p) {}
   };
 
-  std::expected<gl::CubeMap, std::string>
-  getEnvMap(EnvPath up, std::string_view down, std::string_view east,
-            std::string_view west, std::string_view north,
-            std::string_view south) {
-    auto topRes = engine::Image::fromFile(up.path, up.flip, 4);
-    if (!topRes) {
-      return std::unexpected(
-          fmt::format("Failed to load env map top: {}", topRes.error()));
-    }
-    auto bottomRes = engine::Image::fromFile(down, false, 4);
-    if (!bottomRes) {
-      return std::unexpected(
-          fmt::format("Failed to load env map bottom: {}", bottomRes.error()));
+  void prefetchTextureSet(AssetLoader& assets, const MeshPack& pack,
+                          const MeshPack::Layer& layer) {
+    std::pair<uint32_t, TexturePack::Role> entries[] = {
+        {layer.diffuse, TexturePack::Role::COLOR},
+        {layer.normal, TexturePack::Role::NORMAL},
+        {layer.material, TexturePack::Role::COLOR},
+    };
+    for (auto [entry, role] : entries) {
+      if (auto path = pack.string(entry)) {
+        auto image = std::string(TEXTUREDIR) + path->data();
+        assets.prefetch(TexturePack::pathFor(image), {role, {{image, true}}});
+      }
     }
+  }
 
-    auto leftRes = engine::Image::fromFile(east, false, 4);
-    if (!leftRes) {
-      return std::unexpected(
-          fmt::format("Failed to load env map left: {}", leftRes.error()));
+  // Opening a pack only maps it, so it can happen on the pool. Rebuilding a
+  // missing or stale one replays the engine's mesh writers, which needs the
+  // GL context, so that is left to loadPack on the main thread.
+  std::expected<MeshPack, std::string>
+  openPack(const std::string& path, const MeshPack::Sources& sources) {
+    if (!MeshPack::isUpToDate(path, sources)) {
+      return std::unexpected(path + " is missing or out of date");
     }
+    return MeshPack::open(path);
+  }
 
-    auto rightRes = engine::Image::fromFile(west, false, 4);
-    if (!rightRes) {
-      return std::unexpected(
-          fmt::format("Failed to load env map right: {}", rightRes.error()));
-    }
-    auto frontRes = engine::Image::fromFile(north, false, 4);
-    if (!frontRes) {
-      return std::unexpected(
-          fmt::format("Failed to load env map front: {}", frontRes.error()));
-    }
-    auto backRes = engine::Image::fromFile(south, false, 4);
-    if (!backRes) {
-      return std::unexpected(
-          fmt::format("Failed to load env map back: {}", backRes.error()));
+  std::expected<MeshPack, std::string>
+  loadPack(std::future<std::expected<MeshPack, std::string>>& opened,
+           const std::string& path, const MeshPack::Sources& sources) {
+    auto pack = opened.get();
+    if (pack) {
+      return pack;
     }
+    return MeshPack::load(path, sources);
+  }
+
+  const MeshPack::Sources SPHERE_SOURCES = {MESHDIR "Sphere.msh", "", ""};
+  const MeshPack::Sources CONE_SOURCES = {MESHDIR "Cone.msh", "", ""};
+  const MeshPack::Sources GOOBER_SOURCES = {
+      MESHDIR "Role_T.msh", MESHDIR "Role_T.anm", MESHDIR "Role_T.mat"};
+
+  struct EnvMapPaths {
+    EnvPath up;
+    std::string_view down;
+    std::string_view east;
+    std::string_view west;
+    std::string_view north;
+    std::string_view south;
+    /// The texture pack all six faces are compressed into
+    std::string_view pack;
+  };
 
-    gl::CubeMap cubeMap;
-    glm::ivec2 size = topRes->getDimensions();
+  const EnvMapPaths RUSTED_ENV_MAP = {
+      TEXTUREDIR "envmaps/rusted_up.jpg",
+      TEXTUREDIR "envmaps/rusted_down.jpg",
+      TEXTUREDIR "envmaps/rusted_east.jpg",
+      TEXTUREDIR "envmaps/rusted_west.jpg",
+      TEXTUREDIR "envmaps/rusted_north.jpg",
+      TEXTUREDIR "envmaps/rusted_south.jpg",
+      TEXTUREDIR "envmaps/rusted.tpk",
+  };
 
-    if (leftRes->getDimensions() != size || rightRes->getDimensions() != size ||
-        frontRes->getDimensions() != size || backRes->getDimensions() != size ||
-        bottomRes->getDimensions() != size) {
-      return std::unexpected("Env map faces have mismatched dimensions");
-    }
+  const EnvMapPaths NIGHT_ENV_MAP = {
+      {TEXTUREDIR "envmaps/AllSkyFree/ColdNightUp.png", true},
+      TEXTUREDIR "envmaps/AllSkyFree/ColdNightDown.png",
+      TEXTUREDIR "envmaps/AllSkyFree/ColdNightLeft.png",
+      TEXTUREDIR "envmaps/AllSkyFree/ColdNightRight.png",
+      TEXTUREDIR "envmaps/AllSkyFree/ColdNightFront.png",
+      TEXTUREDIR "envmaps/AllSkyFree/ColdNightBack.png",
+      TEXTUREDIR "envmaps/AllSkyFree/ColdNight.tpk",
+  };
+
+  std::string envMapKey(const EnvMapPaths& paths) {
+    return fmt::format("{}|{}|{}|{}|{}|{}|{}", paths.up.path, paths.up.flip,
+                       paths.down, paths.east, paths.west, paths.north,
+                       paths.south);
+  }
+
+  // The faces in GL order, +X, -X, +Y, -Y, +Z, -Z
+  TexturePack::Sources envMapSources(const EnvMapPaths& paths) {
+    return {TexturePack::Role::COLOR,
+            {
+                {std::string(paths.west), false},
+                {std::string(paths.east), false},
+                {std::string(paths.up.path), paths.up.flip},
+                {std::string(paths.down), false},
+                {std::string(paths.south), false},
+                {std::string(paths.north), false},
+            }};
+  }
 
-    auto mipLevels = gl::Texture::calcMipLevels(size.x, size.y);
-
-    cubeMap.storage(mipLevels + 1, GL_RGBA8, size);
-    cubeMap.subImage(0, 0, 0, gl::CubeMap::Face::POSITIVE_Y, size.x, size.y, 1,
-                     GL_RGBA, GL_UNSIGNED_BYTE, topRes->getData());
-    cubeMap.subImage(0, 0, 0, gl::CubeMap::Face::NEGATIVE_Y, size.x, size.y, 1,
-                     GL_RGBA, GL_UNSIGNED_BYTE, bottomRes->getData());
-    cubeMap.subImage(0, 0, 0, gl::CubeMap::Face::NEGATIVE_X, size.x, size.y, 1,
-                     GL_RGBA, GL_UNSIGNED_BYTE, leftRes->getData());
-    cubeMap.subImage(0, 0, 0, gl::CubeMap::Face::POSITIVE_X, size.x, size.y, 1,
-                     GL_RGBA, GL_UNSIGNED_BYTE, rightRes->getData());
-    cubeMap.subImage(0, 0, 0, gl::CubeMap::Face::NEGATIVE_Z, size.x, size.y, 1,
-                     GL_RGBA, GL_UNSIGNED_BYTE, frontRes->getData());
-    cubeMap.subImage(0, 0, 0, gl::CubeMap::Face::POSITIVE_Z, size.x, size.y, 1,
-                     GL_RGBA, GL_UNSIGNED_BYTE, backRes->getData());
-    cubeMap.generateMipmaps();
+  void prefetchEnvMap(AssetLoader& assets, const EnvMapPaths& paths) {
+    assets.prefetch(std::string(paths.pack), envMapSources(paths));
+  }
+
+  std::expected<gl::CubeMap, std::string>
+  getEnvMap(AssetLoader& assets, const EnvMapPaths& paths) {
+    auto cubeMapRes =
+        assets.cubeMap(std::string(paths.pack), envMapSources(paths));
+    if (!cubeMapRes) {
+      return std::unexpected(
+          fmt::format("Failed to load env map: {}", cubeMapRes.error()));
+    }
+    auto cubeMap = std::move(*cubeMapRes);
 
     cubeMap.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     cubeMap.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -219,6 +237,10 @@ void Renderer::setupCameraTrack() {
   track.addKeyframe(75.f, {-300, 350.f, -300.f}, {-35.f, 225.f});
   track.addKeyframe(80.f, {300.f, 350.f, -300.f}, {-35.f, 135.f});
   track.addEffect(80.f, [&](float) {
+    // Benchmarks play the track to its end, where they finish
+    if (benchmark) {
+      return;
+    }
     onTrack = false;
     enableDebugUi = true;
   });
@@ -226,31 +248,56 @@ void Renderer::setupCameraTrack() {
 }
 
 bool Renderer::setupMeshes() {
+  auto pointLightLoad = assets.load(MESHDIR "Sphere.mpk", []() {
+    return openPack(MESHDIR "Sphere.mpk", SPHERE_SOURCES);
+  });
+  auto spotLightLoad = assets.load(MESHDIR "Cone.mpk", []() {
+    return openPack(MESHDIR "Cone.mpk", CONE_SOURCES);
+  });
+  auto gooberLoad = assets.load(MESHDIR "Role_T.mpk", []() {
+    return openPack(MESHDIR "Role_T.mpk", GOOBER_SOURCES);
+  });
+
   {
-    auto pointLightMeshDataOpt =
-        engine::mesh::Data::fromFile(MESHDIR "Sphere.msh");
-    if (!pointLightMeshDataOpt) {
+    auto pointLightPackOpt =
+        loadPack(pointLightLoad, MESHDIR "Sphere.mpk", SPHERE_SOURCES);
+    if (!pointLightPackOpt) {
       Logger::error("Failed to load point light mesh: {}",
-                    pointLightMeshDataOpt.error());
+                    pointLightPackOpt.error());
       return true;
     }
-    pointLightMesh = engine::mesh::BasicMesh(pointLightMeshDataOpt.value());
+    pointLightMesh = StaticMesh(pointLightPackOpt.value());
   }
 
   {
-    auto spotLightMeshDataOpt =
-        engine::mesh::Data::fromFile(MESHDIR "Cone.msh");
-    if (!spotLightMeshDataOpt) {
+    auto spotLightPackOpt =
+        loadPack(spotLightLoad, MESHDIR "Cone.mpk", CONE_SOURCES);
+    if (!spotLightPackOpt) {
       Logger::error("Failed to load spot light mesh: {}",
-                    spotLightMeshDataOpt.error());
+                    spotLightPackOpt.error());
       return true;
     }
-    spotLightMesh = engine::mesh::BasicMesh(spotLightMeshDataOpt.value());
+    spotLightMesh = StaticMesh(spotLightPackOpt.value());
+  }
+
+  auto gooberPackOpt =
+      loadPack(gooberLoad, MESHDIR "Role_T.mpk", GOOBER_SOURCES);
+  if (!gooberPackOpt) {
+    Logger::error("Failed to load goober mesh: {}", gooberPackOpt.error());
+    return true;
+  }
+
+  auto& gooberPack = gooberPackOpt.value();
+  auto gooberLayers = gooberPack.layers();
+
+  // Get the character textures decoding while the terrain uploads
+  for (const auto& layer : gooberLayers) {
+    prefetchTextureSet(assets, gooberPack, layer);
   }
 
-  auto heightmapResult = Heightmap::fromFile(TEXTUREDIR "terrain/height.png",
-                                             TEXTUREDIR "terrain/diffuse.png",
-                                             TEXTUREDIR "terrain/normal.png");
+  auto heightmapResult = Heightmap::fromFile(
+      resources, TEXTUREDIR "terrain/height.png",
+      TEXTUREDIR "terrain/diffuse.png", TEXTUREDIR "terrain/normal.png");
   if (!heightmapResult) {
     Logger::error("Failed to load heightmap: {}", heightmapResult.error());
     return true;
@@ -259,8 +306,8 @@ bool Renderer::setupMeshes() {
       std::make_shared<Heightmap>(std::move(heightmapResult.value())));
 
   auto summerHeightmapResult = Heightmap::fromFile(
-      TEXTUREDIR "terrain/height.png", TEXTUREDIR "terrain/diffuse_summer.png",
-      TEXTUREDIR "terrain/normal.png");
+      resources, TEXTUREDIR "terrain/height.png",
+      TEXTUREDIR "terrain/diffuse_summer.png", TEXTUREDIR "terrain/normal.png");
   if (!summerHeightmapResult) {
     Logger::error("Failed to load summer heightmap: {}",
                   summerHeightmapResult.error());
@@ -269,110 +316,155 @@ bool Renderer::setupMeshes() {
   rightGraph.AddChild(
       std::make_shared<Heightmap>(std::move(summerHeightmapResult.value())));
 
-  graph.AddChild(std::make_shared<Water>(5000.0f, 110.0f, envMap));
-  rightGraph.AddChild(std::make_shared<Water>(5000.0f, 250.0f, envMap));
+  graph.AddChild(
+      std::make_shared<Water>(resources, 5000.0f, 110.0f, *envMap));
+  rightGraph.AddChild(
+      std::make_shared<Water>(resources, 5000.0f, 250.0f, *envMap));
 
-  auto gooberMeshDataOpt = engine::mesh::Data::fromFile(MESHDIR "Role_T.msh");
-  if (!gooberMeshDataOpt) {
-    Logger::error("Failed to load goober mesh: {}", gooberMeshDataOpt.error());
-    return true;
-  }
+  auto gooberMesh = std::make_shared<SkinnedMesh>();
 
-  auto& gooberMeshData = gooberMeshDataOpt.value();
-  engine::mesh::Animation gooberAnimation(MESHDIR "Role_T.anm");
+  for (size_t i = 0; i < gooberLayers.size(); i++) {
+    auto texSetRes =
+        registerTextureSet(textureResidency, gooberPack, gooberLayers[i],
+                           fmt::format("Goober {}", i));
+    if (!texSetRes) {
+      Logger::error("Failed to create goober texture set: {}",
+                    texSetRes.error());
+      return true;
+    }
+    gooberMesh->textures.push_back(std::move(texSetRes.value()));
+  }
 
-  engine::mesh::Material gooberMat(MESHDIR "Role_T.mat");
+  struct MeshWithPack {
+    SkinnedMesh& mesh;
+    const MeshPack& pack;
+  };
 
-  std::vector<engine::mesh::TextureSet> gooberTexs;
+  std::vector<MeshWithPack> meshes = {{*gooberMesh, gooberPack}};
+
+  // Packs keep the baked matrices, which are compressed here so the pack
+  // format is untouched. Each mesh can have any number of clips, all sharing
+  // its skeleton
+  std::vector<AnimationClip> clips;
+  size_t bakedBytes = 0;
+  for (auto& [mesh, pack] : meshes) {
+    const auto& header = pack.header();
+    mesh.jointCount = header.jointCount;
+    if (header.jointCount == 0 || header.frameCount == 0) {
+      continue;
+    }
 
-  {
-    for (size_t i = 0; i < gooberMeshData.meshLayers().size(); i++) {
-      auto matEntry = gooberMat.GetMaterialForLayer(static_cast<int>(i));
-      if (!matEntry) {
-        continue;
-      }
+    std::vector<glm::mat4> matrices(size_t(header.jointCount) *
+                                    header.frameCount);
+    std::memcpy(matrices.data(), pack.joints().data(),
+                matrices.size() * sizeof(glm::mat4));
 
-      auto texSetRes = createTextureSet(*matEntry, fmt::format("Goober {}", i));
-      if (!texSetRes) {
-        Logger::error("Failed to create goober texture set: {}",
-                      texSetRes.error());
-        return true;
-      }
-      gooberTexs.push_back(std::move(texSetRes.value()));
+    auto clip = AnimationClip::compress(matrices, header.jointCount,
+                                        header.frameCount, header.frameRate,
+                                        {});
+    if (!clip) {
+      Logger::error("Failed to compress animation: {}", clip.error());
+      return true;
+    }
+    if (!clip->problem().empty()) {
+      Logger::warn("Animation clip {} keeps every frame: {}", clips.size(),
+                   clip->problem());
     }
-  }
-
-  engine::mesh::Mesh gooberMesh(gooberMeshData, std::move(gooberTexs));
 
-  struct MeshWithData {
-    engine::mesh::Mesh& mesh;
-    const engine::mesh::Data& data;
-    std::optional<engine::mesh::Animation*> anim;
-  };
+    mesh.clips.push_back({static_cast<GLuint>(clips.size()),
+                          clip->frameCount(), clip->frameRate()});
+    bakedBytes += clip->bakedBytes();
+    clips.push_back(std::move(clip.value()));
+  }
 
-  MeshWithData gooberWithData = {gooberMesh, gooberMeshData, &gooberAnimation};
+  // Static meshes still index the table, so it is never empty
+  std::vector<AnimationClip::Params> clipParams;
+  uint32_t keys = 0;
+  for (const auto& clip : clips) {
+    auto params = clip.params();
+    params.keyStart = keys;
+    clipParams.push_back(params);
+    keys += static_cast<uint32_t>(clip.keys().size());
+  }
+  if (clipParams.empty()) {
+    clipParams.push_back({});
+  }
 
-  std::vector<MeshWithData> meshes = {gooberWithData};
+  if (!clips.empty()) {
+    float maxError = 0.0f;
+    for (const auto& clip : clips) {
+      maxError = std::max(maxError, clip.maxError());
+    }
+    Logger::info("Animation clips: {} KiB compressed from {} KiB, max "
+                 "error {:.5f}",
+                 keys * sizeof(AnimationClip::Key) / 1024, bakedBytes / 1024,
+                 maxError);
+  }
 
   uint32_t vertices = 0;
   uint32_t indices = 0;
-  uint32_t joints = 0;
-  for (const auto& mesh : meshes) {
-    vertices += static_cast<uint32_t>(mesh.data.vertices().size());
-    indices += static_cast<uint32_t>(mesh.data.indices().size());
-    if (mesh.anim)
-      joints += (**mesh.anim).GetFrameCount() * (**mesh.anim).GetJointCount();
+  for (const auto& [mesh, pack] : meshes) {
+    vertices += pack.header().vertexCount;
+    indices += pack.header().indexCount;
   }
 
-  staticVertexSize = vertices * sizeof(engine::mesh::WeightedVertex);
+  staticVertexSize = vertices * sizeof(PackedWeightedVertex);
 
   uint32_t indexOffset =
       gl::Buffer::roundToAlignment(staticVertexSize, sizeof(uint32_t));
   uint32_t indicesSize = indices * sizeof(uint32_t);
 
-  jointOffset = gl::Buffer::roundToAlignment(
+  keyOffset = gl::Buffer::roundToAlignment(
       indexOffset + indicesSize, gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
-  jointSize = joints * sizeof(glm::mat4);
+  keySize = keys * sizeof(AnimationClip::Key);
+
+  clipOffset = gl::Buffer::roundToAlignment(
+      keyOffset + keySize, gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  clipSize =
+      static_cast<GLuint>(clipParams.size() * sizeof(AnimationClip::Params));
 
-  uint32_t bufferSize = jointOffset + jointSize;
+  uint32_t bufferSize = clipOffset + clipSize;
 
   gl::Buffer stagingBuffer(bufferSize, nullptr,
                            gl::Buffer::Usage::WRITE |
                                gl::Buffer::Usage::DYNAMIC);
   {
     auto stagingMapping = stagingBuffer.map(gl::Buffer::Mapping::WRITE);
-    {
-      gl::MappingRef sm = stagingMapping;
 
-      GLuint written = 0;
-      for (const auto& mesh : meshes) {
-        mesh.mesh.writeVertexData(gooberMeshData, written, sm);
-
-        sm += sizeof(engine::mesh::WeightedVertex);
+    // Packs already hold the exact bytes each section expects, so filling
+    // the staging buffer is just a copy out of the mapped files
+    GLuint vertexWrite = 0;
+    GLuint indexWrite = indexOffset;
+    for (auto& [mesh, pack] : meshes) {
+      const auto& header = pack.header();
+
+      mesh.baseVertex = static_cast<GLuint>(
+          vertexWrite / sizeof(PackedWeightedVertex));
+      mesh.vertexCount = header.vertexCount;
+
+      auto firstIndex = static_cast<GLuint>(indexWrite / sizeof(uint32_t));
+      for (const auto& layer : pack.layers()) {
+        mesh.layers.push_back(
+            {firstIndex + layer.firstIndex, layer.indexCount});
       }
-    }
 
-    {
-      gl::MappingRef sm = {stagingMapping, indexOffset};
-      GLuint offset = indexOffset;
-      for (const auto& mesh : meshes) {
-        mesh.mesh.writeIndexData(mesh.data, offset, sm);
-        sm += static_cast<uint32_t>(mesh.data.indices().size() *
-                                    sizeof(uint32_t));
-      }
+      stagingMapping.write(pack.vertices().data(), pack.vertices().size(),
+                           vertexWrite);
+      vertexWrite += static_cast<GLuint>(pack.vertices().size());
+
+      stagingMapping.write(pack.indices().data(), pack.indices().size(),
+                           indexWrite);
+      indexWrite += static_cast<GLuint>(pack.indices().size());
     }
 
-    gl::MappingRef sm = {stagingMapping, jointOffset};
-    uint32_t jointsWritten = 0;
-    for (const auto& mesh : meshes) {
-      if (mesh.anim) {
-        auto anim = *mesh.anim.value();
-        mesh.mesh.writeJointData(mesh.data, anim, sm, jointsWritten);
-        auto writtenJoints = anim.GetFrameCount() * anim.GetJointCount();
-        sm += writtenJoints * sizeof(glm::mat4);
-        jointsWritten += writtenJoints;
-      }
+    GLuint keyWrite = keyOffset;
+    for (const auto& clip : clips) {
+      auto size = static_cast<GLuint>(clip.compressedBytes());
+      stagingMapping.write(clip.keys().data(), size, keyWrite);
+      keyWrite += size;
     }
+
+    stagingMapping.write(clipParams.data(), clipSize, clipOffset);
   }
 
   staticBuffer.init(bufferSize);
@@ -381,7 +473,7 @@ bool Renderer::setupMeshes() {
 
   std::mt19937 rng(12345);
   std::uniform_int_distribution<uint32_t> gooberAnimPos(
-      0, gooberAnimation.GetFrameCount());
+      0, gooberMesh->clips.empty() ? 0 : gooberMesh->clips[0].frameCount);
 
   constexpr std::array<glm::vec3, 5> gooberSetups = {{
       {9.5f, 268.75f, 0.0f},
@@ -391,51 +483,49 @@ bool Renderer::setupMeshes() {
       {70.f, 268.75f, 0.0f},
   }};
 
-  auto gooberMeshPtr =
-      std::make_shared<engine::mesh::Mesh>(std::move(gooberMesh));
-
   for (auto& position : gooberSetups) {
-    std::shared_ptr gooberNode =
-        std::make_shared<engine::scene::MeshNode>(gooberMeshPtr);
-    gooberNode->SetTransform(glm::translate(glm::mat4(1.0f), position));
-    gooberNode->SetScale(glm::vec3(10.f));
-    gooberNode->SetBoundingRadius(15.f);
-    gooberNode->setFrame(gooberAnimPos(rng));
-    graph.AddChild(std::move(gooberNode));
-  }
-
-  for (float x = 1000.f; x <= 1300.f; x += 30.f) {
-    for (float z = 1000.f; z <= 1300.f; z += 30.f) {
-      glm::vec3 position = {x, 110.f, z};
-      std::shared_ptr gooberNode =
-          std::make_shared<engine::scene::MeshNode>(gooberMeshPtr);
-      gooberNode->SetTransform(glm::translate(glm::mat4(1.0f), position));
-      gooberNode->SetScale(glm::vec3(10.f));
-      gooberNode->SetBoundingRadius(15.f);
-      gooberNode->setFrame(gooberAnimPos(rng));
-      graph.AddChild(std::move(gooberNode));
+    auto& goober =
+        crowd.emplace_back(gooberMesh, textureResidency, skinning, scene);
+    goober.place(glm::translate(glm::mat4(1.0f), position), glm::vec3(10.f));
+    goober.setRadius(15.f);
+    goober.setFrame(gooberAnimPos(rng));
+  }
+
+  // The grid is placed as a whole, each goober relative to its corner
+  auto formation = scene.create();
+  scene.setLocal(formation, glm::translate(glm::mat4(1.0f),
+                                           glm::vec3(1000.f, 110.f, 1000.f)));
+  for (float x = 0.f; x <= 300.f; x += 30.f) {
+    for (float z = 0.f; z <= 300.f; z += 30.f) {
+      auto& goober = crowd.emplace_back(gooberMesh, textureResidency, skinning,
+                                        scene, formation);
+      goober.place(glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.f, z)),
+                   glm::vec3(10.f));
+      goober.setRadius(15.f);
+      goober.setFrame(gooberAnimPos(rng));
     }
   }
 
-  batchVao.attribFormat(0, 3, GL_FLOAT, GL_FALSE,
-                        offsetof(engine::mesh::Vertex, position), 0);
-  batchVao.attribFormat(1, 2, GL_FLOAT, GL_FALSE,
-                        offsetof(engine::mesh::Vertex, texCoord), 0);
-  batchVao.attribFormat(2, 3, GL_FLOAT, GL_FALSE,
-                        offsetof(engine::mesh::Vertex, normal), 0);
-  batchVao.attribFormat(3, 4, GL_FLOAT, GL_FALSE,
-                        offsetof(engine::mesh::Vertex, tangent), 0);
-  batchVao.attribFormat(4, 4, GL_FLOAT, GL_FALSE, 0, 1);
-  batchVao.attribFormat(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 1);
-  batchVao.attribFormat(6, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), 1);
-  batchVao.attribFormat(7, 4, GL_FLOAT, GL_FALSE, 3 * sizeof(glm::vec4), 1);
-  batchVao.bufferDivisor(1, 1);
+  // Normal and tangent sit next to each other, so are fetched as one short4
+  for (gl::Vao* vao : {&batchVao, &crowdVao}) {
+    vao->attribFormat(0, 3, GL_FLOAT, GL_FALSE,
+                      offsetof(PackedVertex, position), 0);
+    vao->attribFormat(1, 2, GL_HALF_FLOAT, GL_FALSE,
+                      offsetof(PackedVertex, texCoord), 0);
+    vao->attribFormat(2, 4, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal),
+                      0);
+    vao->attribFormat(4, 4, GL_FLOAT, GL_FALSE, 0, 1);
+    vao->attribFormat(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 1);
+    vao->attribFormat(6, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), 1);
+    vao->bufferDivisor(1, 1);
+  }
 
   return false;
 }
 
 bool Renderer::setupPostProcesses() {
-  auto copyPPOpt = PostProcess::create("Copy", SHADERDIR "tex.frag.glsl");
+  auto copyPPOpt = PostProcess::create(programCache, "Copy",
+                                       SHADERDIR "tex.frag.glsl");
   if (!copyPPOpt) {
     Logger::error("Failed to create test post process: {}", copyPPOpt.error());
     bail();
@@ -443,7 +533,7 @@ bool Renderer::setupPostProcesses() {
   }
   copyPP = std::move(*copyPPOpt);
 
-  auto blurPPOpt = Blur::create();
+  auto blurPPOpt = Blur::create(programCache);
   if (!blurPPOpt) {
     Logger::error("Failed to create blur post process: {}", blurPPOpt.error());
     bail();
@@ -451,8 +541,8 @@ bool Renderer::setupPostProcesses() {
   }
   blurPP = std::move(*blurPPOpt);
 
-  auto bloomPPOpt =
-      PostProcess::create("Bloom", SHADERDIR "postprocess/bloom.frag.glsl");
+  auto bloomPPOpt = PostProcess::create(
+      programCache, "Bloom", SHADERDIR "postprocess/bloom.frag.glsl");
   if (!bloomPPOpt) {
     Logger::error("Failed to create bloom post process: {}",
                   bloomPPOpt.error());
@@ -461,7 +551,7 @@ bool Renderer::setupPostProcesses() {
   }
   bloomPP = std::move(*bloomPPOpt);
 
-  auto skyboxRes = Skybox::create(envMap);
+  auto skyboxRes = Skybox::create(programCache, *envMap);
   if (!skyboxRes) {
     Logger::error("Failed to create skybox: {}", skyboxRes.error());
     bail();
@@ -473,8 +563,9 @@ bool Renderer::setupPostProcesses() {
 
   postProcesses.emplace_back(std::move(skyboxPtr));
 
-  auto reflectionsOpt = PostProcess::create(
-      "Reflections", SHADERDIR "postprocess/reflections.frag.glsl");
+  auto reflectionsOpt =
+      PostProcess::create(programCache, "Reflections",
+                          SHADERDIR "postprocess/reflections.frag.glsl");
   if (!reflectionsOpt) {
     Logger::error("Failed to create reflections post process");
     bail();
@@ -485,8 +576,8 @@ bool Renderer::setupPostProcesses() {
 
   postProcesses.emplace_back(std::move(reflectionsPPtr));
 
-  auto fxaaRes =
-      PostProcess::create("FXAA", SHADERDIR "postprocess/fxaa.frag.glsl");
+  auto fxaaRes = PostProcess::create(programCache, "FXAA",
+                                     SHADERDIR "postprocess/fxaa.frag.glsl");
   if (!fxaaRes) {
     Logger::error("Failed to create FXAA post process: {}", fxaaRes.error());
     bail();
@@ -501,7 +592,7 @@ bool Renderer::setupPostProcesses() {
 }
 
 bool Renderer::setupShaders() {
-  auto skinProgramOpt = gl::Program::fromFiles(
+  auto skinProgramOpt = programCache.load(
       {{SHADERDIR "compute/skin.comp.glsl", gl::Shader::Type::COMPUTE}});
   if (!skinProgramOpt) {
     Logger::error("Failed to create skinning program: {}",
@@ -511,7 +602,26 @@ bool Renderer::setupShaders() {
   }
   skinProgram = std::move(*skinProgramOpt);
 
-  auto batchProgramOpt = gl::Program::fromFiles(
+  auto cullProgramOpt = programCache.load(
+      {{SHADERDIR "compute/cull.comp.glsl", gl::Shader::Type::COMPUTE}});
+  if (!cullProgramOpt) {
+    Logger::error("Failed to create cull program: {}", cullProgramOpt.error());
+    bail();
+    return true;
+  }
+  cullProgram = std::move(*cullProgramOpt);
+
+  auto cullEmitProgramOpt = programCache.load(
+      {{SHADERDIR "compute/cull_emit.comp.glsl", gl::Shader::Type::COMPUTE}});
+  if (!cullEmitProgramOpt) {
+    Logger::error("Failed to create cull emit program: {}",
+                  cullEmitProgramOpt.error());
+    bail();
+    return true;
+  }
+  cullEmitProgram = std::move(*cullEmitProgramOpt);
+
+  auto batchProgramOpt = programCache.load(
       {{SHADERDIR "batch.vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "tex_bindless.frag.glsl", gl::Shader::Type::FRAGMENT}});
   if (!batchProgramOpt) {
@@ -522,7 +632,7 @@ bool Renderer::setupShaders() {
   }
   batchProgram = std::move(*batchProgramOpt);
 
-  auto batchShadowProgramOpt = gl::Program::fromFiles(
+  auto batchShadowProgramOpt = programCache.load(
       {{SHADERDIR "batch_shadow.vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "lighting/depth_to_linear.frag.glsl",
         gl::Shader::Type::FRAGMENT}});
@@ -534,7 +644,7 @@ bool Renderer::setupShaders() {
   }
   batchShadowProgram = std::move(*batchShadowProgramOpt);
 
-  auto batchShadowCubeProgramOpt = gl::Program::fromFiles(
+  auto batchShadowCubeProgramOpt = programCache.load(
       {{SHADERDIR "batch_shadow_cube.vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "lighting/omni_shadow.geom.glsl", gl::Shader::Type::GEOMETRY},
        {SHADERDIR "lighting/depth_to_linear.frag.glsl",
@@ -547,7 +657,7 @@ bool Renderer::setupShaders() {
   }
   batchShadowCubeProgram = std::move(*batchShadowCubeProgramOpt);
 
-  auto pointLightOpt = gl::Program::fromFiles(
+  auto pointLightOpt = programCache.load(
       {{SHADERDIR "lighting/point_light.vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "lighting/point_light.frag.glsl",
         gl::Shader::Type::FRAGMENT}});
@@ -559,7 +669,19 @@ bool Renderer::setupShaders() {
   }
   pointLight = std::move(*pointLightOpt);
 
-  auto spotLightOpt = gl::Program::fromFiles(
+  auto lightVisibilityOpt = programCache.load(
+      {{SHADERDIR "lighting/point_light.vert.glsl", gl::Shader::Type::VERTEX},
+       {SHADERDIR "lighting/light_visibility.frag.glsl",
+        gl::Shader::Type::FRAGMENT}});
+  if (!lightVisibilityOpt) {
+    Logger::error("Failed to create light visibility program: {}",
+                  lightVisibilityOpt.error());
+    bail();
+    return true;
+  }
+  lightVisibilityProgram = std::move(*lightVisibilityOpt);
+
+  auto spotLightOpt = programCache.load(
       {{SHADERDIR "lighting/spot_light.vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "lighting/spot_light.frag.glsl",
         gl::Shader::Type::FRAGMENT}});
@@ -571,7 +693,7 @@ bool Renderer::setupShaders() {
   }
   spotLight = std::move(*spotLightOpt);
 
-  auto deferredLightCombineOpt = gl::Program::fromFiles(
+  auto deferredLightCombineOpt = programCache.load(
       {{SHADERDIR "fullscreen.vert.glsl", gl::Shader::Type::VERTEX},
        {SHADERDIR "lighting/combine.frag.glsl", gl::Shader::Type::FRAGMENT}});
 
@@ -583,6 +705,16 @@ bool Renderer::setupShaders() {
   }
   deferredLightCombine = std::move(*deferredLightCombineOpt);
 
+  auto clusteredLightingOpt =
+      ClusteredLighting::create(programCache, CAMERA_NEAR, CAMERA_FAR);
+  if (!clusteredLightingOpt) {
+    Logger::error("Failed to create clustered lighting: {}",
+                  clusteredLightingOpt.error());
+    bail();
+    return true;
+  }
+  clusteredLighting = std::move(*clusteredLightingOpt);
+
   return false;
 }
 
@@ -609,34 +741,27 @@ void Renderer::setupLights() {
   rightSpotLights.emplace_back(glm::vec3(0, 300, -50), glm::vec3(1, 0, 0),
                                glm::vec4(0.8, 0.5, 0.5, 50), 500.f);
 
-  shadowMatrixBuffers.resize(pointLights.size() + rightPointLights.size());
-  for (auto& buf : shadowMatrixBuffers) {
-    buf.buffer.init(sizeof(PointLight::LightUniform), nullptr,
-                    gl::Buffer::Usage::WRITE | gl::Buffer::Usage::PERSISTENT |
-                        gl::Buffer::Usage::COHERENT);
-    buf.mapping = buf.buffer.map(gl::Buffer::Mapping::WRITE |
-                                 gl::Buffer::Mapping::PERSISTENT |
-                                 gl::Buffer::Mapping::COHERENT);
-  }
-  spotShadowMatrixBuffers.resize(spotLights.size() + rightSpotLights.size());
-  for (auto& buf : spotShadowMatrixBuffers) {
-    buf.buffer.init(sizeof(SpotLight::LightUniform), nullptr,
-                    gl::Buffer::Usage::WRITE | gl::Buffer::Usage::PERSISTENT |
-                        gl::Buffer::Usage::COHERENT);
-    buf.mapping = buf.buffer.map(gl::Buffer::Mapping::WRITE |
-                                 gl::Buffer::Mapping::PERSISTENT |
-                                 gl::Buffer::Mapping::COHERENT);
+  // Numbered the same as the point shadow views, left then right
+  size_t light = 0;
+  for (const auto& pointLight : pointLights) {
+    pointLightGraph.AddChild(LightVisibility::proxy(
+        light++, glm::vec4(pointLight.position(), pointLight.radius())));
+  }
+  for (const auto& pointLight : rightPointLights) {
+    rightPointLightGraph.AddChild(LightVisibility::proxy(
+        light++, glm::vec4(pointLight.position(), pointLight.radius())));
   }
 }
 
-Renderer::Renderer(int width, int height, const char title[])
+Renderer::Renderer(int width, int height, const char title[],
+                   std::optional<Benchmark::Options> benchmark)
     : engine::App(width, height, title, true),
       camera(
-          engine::PerspectiveCamera{0.1f, 10000.0f,
+          engine::PerspectiveCamera{CAMERA_NEAR, CAMERA_FAR,
                                     static_cast<float>(windowSize.width) /
                                         static_cast<float>(windowSize.height),
                                     glm::radians(90.0f)},
-          engine::PerspectiveCamera{0.1f, 10000.0f,
+          engine::PerspectiveCamera{CAMERA_NEAR, CAMERA_FAR,
                                     static_cast<float>(windowSize.width) /
                                         static_cast<float>(windowSize.height),
                                     glm::radians(90.f)},
@@ -654,12 +779,33 @@ Renderer::Renderer(int width, int height, const char title[])
 
   setupCameraTrack();
 
-  auto cubeMapResult = getEnvMap(TEXTUREDIR "envmaps/rusted_up.jpg",
-                                 TEXTUREDIR "envmaps/rusted_down.jpg",
-                                 TEXTUREDIR "envmaps/rusted_east.jpg",
-                                 TEXTUREDIR "envmaps/rusted_west.jpg",
-                                 TEXTUREDIR "envmaps/rusted_north.jpg",
-                                 TEXTUREDIR "envmaps/rusted_south.jpg");
+  if (benchmark) {
+    this->benchmark.emplace(std::move(*benchmark));
+    // Frames should take as long as they take to draw, not the refresh rate
+    glfwSwapInterval(0);
+  }
+
+  // Queue up every texture we know about so reading packs (or decoding the
+  // images behind stale ones) overlaps shader compiles
+  prefetchEnvMap(assets, RUSTED_ENV_MAP);
+  prefetchEnvMap(assets, NIGHT_ENV_MAP);
+  resources.prefetch(TEXTUREDIR "terrain/height.png",
+                     {true, TexturePack::Role::HEIGHT});
+  resources.prefetch(TEXTUREDIR "terrain/diffuse.png");
+  resources.prefetch(TEXTUREDIR "terrain/diffuse_summer.png");
+  resources.prefetch(TEXTUREDIR "terrain/normal.png");
+  resources.prefetch(TEXTUREDIR "water.tga");
+  resources.prefetch(TEXTUREDIR "waterbump.png",
+                     {true, TexturePack::Role::NORMAL});
+
+  if (setupShaders()) {
+    bail();
+    return;
+  }
+
+  auto cubeMapResult =
+      resources.cubeMap(envMapKey(RUSTED_ENV_MAP),
+                        [&] { return getEnvMap(assets, RUSTED_ENV_MAP); });
   if (!cubeMapResult) {
     Logger::error("Failed to load environment map: {}", cubeMapResult.error());
     bail();
@@ -668,12 +814,8 @@ Renderer::Renderer(int width, int height, const char title[])
   envMap = std::move(*cubeMapResult);
 
   auto nightCubeMapResult =
-      getEnvMap({TEXTUREDIR "envmaps/AllSkyFree/ColdNightUp.png", true},
-                TEXTUREDIR "envmaps/AllSkyFree/ColdNightDown.png",
-                TEXTUREDIR "envmaps/AllSkyFree/ColdNightLeft.png",
-                TEXTUREDIR "envmaps/AllSkyFree/ColdNightRight.png",
-                TEXTUREDIR "envmaps/AllSkyFree/ColdNightFront.png",
-                TEXTUREDIR "envmaps/AllSkyFree/ColdNightBack.png");
+      resources.cubeMap(envMapKey(NIGHT_ENV_MAP),
+                        [&] { return getEnvMap(assets, NIGHT_ENV_MAP); });
   if (!nightCubeMapResult) {
     Logger::error("Failed to load night environment map: {}",
                   nightCubeMapResult.error());
@@ -682,10 +824,6 @@ Renderer::Renderer(int width, int height, const char title[])
   }
   nightEnvMap = std::move(*nightCubeMapResult);
 
-  if (setupShaders()) {
-    bail();
-    return;
-  }
   if (setupPostProcesses()) {
     bail();
     return;
@@ -696,12 +834,24 @@ Renderer::Renderer(int width, int height, const char title[])
     return;
   }
 
+  assets.release();
+
   setupLights();
 
   batchVao.bindIndexBuffer(staticBuffer.id());
   batchVao.label("Batch Vao");
+  crowdVao.bindIndexBuffer(staticBuffer.id());
+  crowdVao.label("Crowd Vao");
 
   setupHdrOutput(windowSize.width, windowSize.height);
   setupPostProcesses(windowSize.width, windowSize.height);
   setupLightFbo(windowSize.width, windowSize.height);
+
+  assets.logSummary();
+
+  auto& programStats = programCache.stats();
+  Logger::info("Programs: {} from binary cache in {:.2f}ms, {} compiled from "
+               "source in {:.2f}ms ({} binaries rejected)",
+               programStats.loaded, programStats.loadMs, programStats.compiled,
+               programStats.compileMs, programStats.rejected);
 }
@@ -0,0 +1,119 @@
+#include "resourceCache.hpp"
+
+#include <imgui/imgui.h>
+#include <spdlog/fmt/bundled/format.h>
+
+std::expected<std::shared_ptr<gl::Texture>, std::string>
+ResourceCache::texture(std::string_view path, TextureParams params) {
+  auto key = fmt::format("{}|{}|{}", path, params.flip,
+                         static_cast<uint32_t>(params.role));
+  if (auto cached = find(textures, key)) {
+    return cached;
+  }
+
+  auto res = assets.texture(TexturePack::pathFor(path),
+                            textureSources(path, params));
+  if (!res) {
+    return std::unexpected(res.error());
+  }
+
+  auto texture = std::make_shared<gl::Texture>(std::move(*res));
+  insert(textures, key, texture, textureBytes(texture->id()));
+  return texture;
+}
+
+void ResourceCache::prefetch(std::string_view path, TextureParams params) {
+  assets.prefetch(TexturePack::pathFor(path), textureSources(path, params));
+}
+
+TexturePack::Sources ResourceCache::textureSources(std::string_view path,
+                                                   TextureParams params) {
+  return {params.role, {{std::string(path), params.flip}}};
+}
+
+std::string ResourceCache::programKey(const ShaderStage* stages,
+                                      size_t count) {
+  std::string key;
+  for (size_t i = 0; i < count; ++i) {
+    key += fmt::format("{}:{};", static_cast<int>(stages[i].type),
+                       stages[i].path);
+  }
+  return key;
+}
+
+size_t ResourceCache::textureBytes(GLuint texture, int faces) {
+  GLint levels = 0;
+  glGetTextureParameteriv(texture, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+
+  size_t bytes = 0;
+  for (GLint level = 0; level < levels; ++level) {
+    GLint compressed = GL_FALSE;
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_COMPRESSED,
+                                 &compressed);
+    if (compressed) {
+      GLint size = 0;
+      glGetTextureLevelParameteriv(texture, level,
+                                   GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+      bytes += static_cast<size_t>(size);
+      continue;
+    }
+
+    GLint width = 0, height = 0;
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_WIDTH, &width);
+    glGetTextureLevelParameteriv(texture, level, GL_TEXTURE_HEIGHT, &height);
+
+    GLint bits = 0;
+    for (GLenum channel :
+         {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+          GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE}) {
+      GLint size = 0;
+      glGetTextureLevelParameteriv(texture, level, channel, &size);
+      bits += size;
+    }
+
+    bytes += static_cast<size_t>(width) * height * bits / 8;
+  }
+
+  return bytes * faces;
+}
+
+size_t ResourceCache::programBytes(const gl::Program& program) {
+  GLint length = 0;
+  glGetProgramiv(program.id(), GL_PROGRAM_BINARY_LENGTH, &length);
+  return static_cast<size_t>(length);
+}
+
+void ResourceCache::debugUi() const {
+  if (!ImGui::BeginTable("Resource Cache", 5,
+                         ImGuiTableFlags_Borders |
+                             ImGuiTableFlags_SizingStretchProp)) {
+    return;
+  }
+
+  ImGui::TableSetupColumn("Kind");
+  ImGui::TableSetupColumn("Hits");
+  ImGui::TableSetupColumn("Misses");
+  ImGui::TableSetupColumn("Resident");
+  ImGui::TableSetupColumn("MiB");
+  ImGui::TableHeadersRow();
+
+  auto row = [](const char* kind, const Stats& s) {
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted(kind);
+    ImGui::TableNextColumn();
+    ImGui::Text("%u", s.hits);
+    ImGui::TableNextColumn();
+    ImGui::Text("%u", s.misses);
+    ImGui::TableNextColumn();
+    ImGui::Text("%u", s.resident);
+    ImGui::TableNextColumn();
+    ImGui::Text("%.2f", s.residentBytes / (1024.0 * 1024.0));
+  };
+
+  row("Textures", textureStats());
+  row("Cube Maps", cubeMapStats());
+  row("Programs", programStats());
+
+  ImGui::EndTable();
+}
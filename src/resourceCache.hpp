@@ -0,0 +1,167 @@
+#pragma once
+
+#include "assetLoader.hpp"
+#include "programCache.hpp"
+#include <expected>
+#include <gl/gl.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+struct TextureParams {
+  bool flip = true;
+  /// Picks the block format the texture is compressed to
+  TexturePack::Role role = TexturePack::Role::COLOR;
+};
+
+/// <summary>
+/// Hands out shared GL resources keyed by their source paths and load
+/// parameters, so any number of nodes built from the same files share one
+/// texture or program.
+///
+/// Entries are held weakly. Once the last handle is dropped the resource is
+/// freed, and the next request for it is a miss again.
+/// </summary>
+class ResourceCache {
+public:
+  struct Stats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t resident = 0;
+    size_t residentBytes = 0;
+  };
+
+  ResourceCache(AssetLoader& assets, ProgramCache& programCache)
+      : assets(assets), programCache(programCache) {}
+
+  ResourceCache(const ResourceCache&) = delete;
+  ResourceCache& operator=(const ResourceCache&) = delete;
+
+  /// <summary>
+  /// Returns the texture for an image, uploaded from the compressed pack
+  /// next to it.
+  /// </summary>
+  std::expected<std::shared_ptr<gl::Texture>, std::string>
+  texture(std::string_view path, TextureParams params = {});
+
+  /// <summary>
+  /// Starts opening (or decoding, if it needs rebuilding) the pack a later
+  /// texture call with the same arguments will upload.
+  /// </summary>
+  void prefetch(std::string_view path, TextureParams params = {});
+
+  /// <summary>
+  /// Returns the cube map for a key, calling load to build it on a miss.
+  /// The key should name every face, since two cube maps sharing a face are
+  /// not the same resource.
+  /// </summary>
+  template <typename F>
+  std::expected<std::shared_ptr<gl::CubeMap>, std::string>
+  cubeMap(const std::string& key, F&& load) {
+    if (auto cached = find(cubeMaps, key)) {
+      return cached;
+    }
+
+    auto res = load();
+    if (!res) {
+      return std::unexpected(res.error());
+    }
+
+    auto cubeMap = std::make_shared<gl::CubeMap>(std::move(*res));
+    insert(cubeMaps, key, cubeMap, textureBytes(cubeMap->id(), 6));
+    return cubeMap;
+  }
+
+  /// <summary>
+  /// Returns the program linked from the given stages, going through the
+  /// on-disk ProgramCache on a miss.
+  /// </summary>
+  template <size_t N>
+  std::expected<std::shared_ptr<gl::Program>, std::string>
+  program(const ShaderStage (&stages)[N]) {
+    auto key = programKey(stages, N);
+    if (auto cached = find(programs, key)) {
+      return cached;
+    }
+
+    auto res = programCache.load(stages);
+    if (!res) {
+      return std::unexpected(res.error());
+    }
+
+    auto program = std::make_shared<gl::Program>(std::move(*res));
+    insert(programs, key, program, programBytes(*program));
+    return program;
+  }
+
+  Stats textureStats() const { return stats(textures); }
+  Stats cubeMapStats() const { return stats(cubeMaps); }
+  Stats programStats() const { return stats(programs); }
+
+  /// <summary>
+  /// Draws the hit, miss and residency counters into the current ImGui
+  /// window.
+  /// </summary>
+  void debugUi() const;
+
+  /// <summary>
+  /// Sums the storage of every mip level, as reported by the driver.
+  /// </summary>
+  static size_t textureBytes(GLuint texture, int faces = 1);
+  static size_t programBytes(const gl::Program& program);
+
+private:
+  template <typename T> struct Entry {
+    std::weak_ptr<T> resource;
+    size_t bytes;
+  };
+
+  template <typename T> struct Store {
+    std::unordered_map<std::string, Entry<T>> entries;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+  };
+
+  template <typename T>
+  std::shared_ptr<T> find(Store<T>& store, const std::string& key) {
+    if (auto it = store.entries.find(key); it != store.entries.end()) {
+      if (auto resource = it->second.resource.lock()) {
+        ++store.hits;
+        return resource;
+      }
+    }
+
+    ++store.misses;
+    return nullptr;
+  }
+
+  template <typename T>
+  static void insert(Store<T>& store, const std::string& key,
+                     const std::shared_ptr<T>& resource, size_t bytes) {
+    store.entries.insert_or_assign(key, Entry<T>{resource, bytes});
+  }
+
+  template <typename T> static Stats stats(const Store<T>& store) {
+    Stats s = {store.hits, store.misses, 0, 0};
+    for (const auto& [key, entry] : store.entries) {
+      if (!entry.resource.expired()) {
+        ++s.resident;
+        s.residentBytes += entry.bytes;
+      }
+    }
+    return s;
+  }
+
+  static std::string programKey(const ShaderStage* stages, size_t count);
+  static TexturePack::Sources textureSources(std::string_view path,
+                                             TextureParams params);
+
+  AssetLoader& assets;
+  ProgramCache& programCache;
+
+  Store<gl::Texture> textures;
+  Store<gl::CubeMap> cubeMaps;
+  Store<gl::Program> programs;
+};
@@ -0,0 +1,302 @@
+#include "sceneIndex.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <numeric>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SCENE_INDEX_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace {
+  // Leaves are tested this many spheres at a time, and the SoA arrays are
+  // padded so the last group can always be loaded whole
+  constexpr uint32_t GROUP = 4;
+  // Deep enough for any tree of up to 2^32 items split at the median
+  constexpr size_t MAX_DEPTH = 64;
+
+  glm::vec4 normalize(const glm::vec4& plane) {
+    return plane / glm::length(glm::vec3(plane));
+  }
+
+  /// Whether each sphere in the group at base is inside all planes, one bit
+  /// per lane
+  int testGroup(const SceneIndex::Planes& planes, const float* xs,
+                const float* ys, const float* zs, const float* radii) {
+#ifdef SCENE_INDEX_SSE
+    __m128 x = _mm_loadu_ps(xs);
+    __m128 y = _mm_loadu_ps(ys);
+    __m128 z = _mm_loadu_ps(zs);
+    __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radii));
+
+    int mask = 0xF;
+    for (const auto& plane : planes) {
+      __m128 d = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)),
+                     _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)),
+                     _mm_set1_ps(plane.w)));
+      mask &= _mm_movemask_ps(_mm_cmpge_ps(d, negRadius));
+      if (mask == 0) {
+        break;
+      }
+    }
+    return mask;
+#else
+    int mask = 0;
+    for (uint32_t lane = 0; lane < GROUP; ++lane) {
+      bool inside = true;
+      for (const auto& plane : planes) {
+        float d = (xs[lane] * plane.x + ys[lane] * plane.y) +
+                  (zs[lane] * plane.z + plane.w);
+        if (d < -radii[lane]) {
+          inside = false;
+          break;
+        }
+      }
+      mask |= inside ? 1 << lane : 0;
+    }
+    return mask;
+#endif
+  }
+} // namespace
+
+SceneIndex::Planes SceneIndex::planes(const glm::mat4& viewProj) {
+  auto row = [&](int i) {
+    return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i],
+                     viewProj[3][i]);
+  };
+
+  return {
+      normalize(row(3) + row(0)), normalize(row(3) - row(0)),
+      normalize(row(3) + row(1)), normalize(row(3) - row(1)),
+      normalize(row(3) + row(2)), normalize(row(3) - row(2)),
+  };
+}
+
+uint32_t SceneIndex::insert(const glm::vec3& center, float radius) {
+  spheres.emplace_back(center, radius);
+  needsBuild = true;
+  ++changes;
+  return static_cast<uint32_t>(spheres.size() - 1);
+}
+
+void SceneIndex::move(uint32_t id, const glm::vec3& center, float radius) {
+  glm::vec4 sphere(center, radius);
+  if (spheres[id] == sphere) {
+    return;
+  }
+  spheres[id] = sphere;
+  ++changes;
+  if (needsBuild) {
+    return;
+  }
+
+  uint32_t slot = idSlots[id];
+  xs[slot] = center.x;
+  ys[slot] = center.y;
+  zs[slot] = center.z;
+  radii[slot] = radius;
+  dirty[slotLeaves[slot]] = 1;
+  needsRefit = true;
+}
+
+void SceneIndex::clear() {
+  spheres.clear();
+  ++changes;
+  nodes.clear();
+  xs.clear();
+  ys.clear();
+  zs.clear();
+  radii.clear();
+  slotIds.clear();
+  idSlots.clear();
+  slotLeaves.clear();
+  dirty.clear();
+  needsBuild = false;
+  needsRefit = false;
+}
+
+void SceneIndex::build() {
+  auto count = static_cast<uint32_t>(spheres.size());
+  nodes.clear();
+  slotIds.resize(count);
+  std::iota(slotIds.begin(), slotIds.end(), 0u);
+  slotLeaves.resize(count);
+  if (count > 0) {
+    buildNode(0, 0, count);
+  }
+
+  size_t padded = count + GROUP - 1;
+  xs.assign(padded, 0.0f);
+  ys.assign(padded, 0.0f);
+  zs.assign(padded, 0.0f);
+  radii.assign(padded, 0.0f);
+  idSlots.resize(count);
+  for (uint32_t slot = 0; slot < count; ++slot) {
+    const auto& sphere = spheres[slotIds[slot]];
+    xs[slot] = sphere.x;
+    ys[slot] = sphere.y;
+    zs[slot] = sphere.z;
+    radii[slot] = sphere.w;
+    idSlots[slotIds[slot]] = slot;
+  }
+
+  // Fitting every node is the same as refitting with everything moved
+  dirty.assign(nodes.size(), 1);
+  needsBuild = false;
+  needsRefit = true;
+}
+
+uint32_t SceneIndex::buildNode(uint32_t parent, uint32_t first,
+                               uint32_t count) {
+  auto index = static_cast<uint32_t>(nodes.size());
+  nodes.push_back({.min = glm::vec3(0.0f),
+                   .right = 0,
+                   .max = glm::vec3(0.0f),
+                   .parent = parent,
+                   .first = first,
+                   .count = count});
+
+  if (count <= LEAF_SIZE) {
+    std::fill_n(slotLeaves.begin() + first, count, index);
+    return index;
+  }
+
+  // Median split along the longest axis of the centers
+  glm::vec3 lo(std::numeric_limits<float>::max());
+  glm::vec3 hi(std::numeric_limits<float>::lowest());
+  for (uint32_t slot = first; slot < first + count; ++slot) {
+    glm::vec3 center(spheres[slotIds[slot]]);
+    lo = glm::min(lo, center);
+    hi = glm::max(hi, center);
+  }
+  glm::vec3 extent = hi - lo;
+  int axis = extent.x > extent.y ? 0 : 1;
+  axis = extent.z > extent[axis] ? 2 : axis;
+
+  auto begin = slotIds.begin() + first;
+  uint32_t half = count / 2;
+  std::nth_element(begin, begin + half, begin + count,
+                   [&](uint32_t a, uint32_t b) {
+                     return spheres[a][axis] < spheres[b][axis];
+                   });
+
+  buildNode(index, first, half);
+  uint32_t right = buildNode(index, first + half, count - half);
+  nodes[index].right = right;
+  return index;
+}
+
+void SceneIndex::fitLeaf(Node& node) const {
+  node.min = glm::vec3(std::numeric_limits<float>::max());
+  node.max = glm::vec3(std::numeric_limits<float>::lowest());
+  for (uint32_t slot = node.first; slot < node.first + node.count; ++slot) {
+    glm::vec3 center(xs[slot], ys[slot], zs[slot]);
+    node.min = glm::min(node.min, center - radii[slot]);
+    node.max = glm::max(node.max, center + radii[slot]);
+  }
+}
+
+void SceneIndex::refit() {
+  if (needsBuild) {
+    build();
+  }
+  if (!needsRefit) {
+    return;
+  }
+
+  // Children always come after their parent, so walking backwards fits
+  // every child before the box around it
+  for (size_t i = nodes.size(); i-- > 0;) {
+    if (!dirty[i]) {
+      continue;
+    }
+    dirty[i] = 0;
+
+    Node& node = nodes[i];
+    if (node.right == 0) {
+      fitLeaf(node);
+    } else {
+      const Node& left = nodes[i + 1];
+      const Node& right = nodes[node.right];
+      node.min = glm::min(left.min, right.min);
+      node.max = glm::max(left.max, right.max);
+    }
+    if (i != 0) {
+      dirty[node.parent] = 1;
+    }
+  }
+  needsRefit = false;
+}
+
+void SceneIndex::emit(const Node& node, std::vector<uint32_t>& out) const {
+  out.insert(out.end(), slotIds.begin() + node.first,
+             slotIds.begin() + node.first + node.count);
+}
+
+void SceneIndex::testLeaf(const Node& node, const Planes& planes,
+                          std::vector<uint32_t>& out) const {
+  uint32_t end = node.first + node.count;
+  for (uint32_t base = node.first; base < end; base += GROUP) {
+    int mask = testGroup(planes, &xs[base], &ys[base], &zs[base],
+                         &radii[base]);
+    // Lanes past the leaf belong to its neighbour or the padding
+    mask &= (1 << std::min(GROUP, end - base)) - 1;
+    while (mask != 0) {
+      out.push_back(
+          slotIds[base + static_cast<uint32_t>(
+                             std::countr_zero(static_cast<unsigned>(mask)))]);
+      mask &= mask - 1;
+    }
+  }
+}
+
+void SceneIndex::query(const Planes& planes,
+                       std::vector<uint32_t>& out) const {
+  if (nodes.empty()) {
+    return;
+  }
+
+  std::array<uint32_t, MAX_DEPTH> stack;
+  size_t depth = 0;
+  stack[depth++] = 0;
+  while (depth > 0) {
+    uint32_t index = stack[--depth];
+    const Node& node = nodes[index];
+
+    bool outside = false;
+    bool inside = true;
+    for (const auto& plane : planes) {
+      // The box corners furthest along and against the plane normal
+      glm::vec3 ahead(plane.x >= 0.0f ? node.max.x : node.min.x,
+                    plane.y >= 0.0f ? node.max.y : node.min.y,
+                    plane.z >= 0.0f ? node.max.z : node.min.z);
+      glm::vec3 behind(plane.x >= 0.0f ? node.min.x : node.max.x,
+                     plane.y >= 0.0f ? node.min.y : node.max.y,
+                     plane.z >= 0.0f ? node.min.z : node.max.z);
+      if (glm::dot(glm::vec3(plane), ahead) + plane.w < 0.0f) {
+        outside = true;
+        break;
+      }
+      if (glm::dot(glm::vec3(plane), behind) + plane.w < 0.0f) {
+        inside = false;
+      }
+    }
+
+    if (outside) {
+      continue;
+    }
+    if (inside) {
+      emit(node, out);
+    } else if (node.right == 0) {
+      testLeaf(node, planes, out);
+    } else {
+      stack[depth++] = node.right;
+      stack[depth++] = index + 1;
+    }
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+/// <summary>
+/// Bounding volume hierarchy over bounding spheres, for answering frustum
+/// queries without testing every node.
+///
+/// Items are identified by the index insert returned. Inner nodes hold an
+/// AABB around their children, and the spheres themselves are kept as
+/// separate x, y, z and radius arrays in leaf order, so a leaf tests four
+/// spheres against a plane per SIMD op. A subtree entirely inside the
+/// frustum is accepted without testing its spheres at all.
+///
+/// Moving an item only refits the boxes above it. Inserting rebuilds the
+/// tree on the next refit.
+/// </summary>
+class SceneIndex {
+public:
+  constexpr static uint32_t LEAF_SIZE = 8;
+
+  /// Plane normals face inwards, so a point is inside when dot(p, n) + w >= 0
+  using Planes = std::array<glm::vec4, 6>;
+
+  /// <summary>
+  /// Extracts the planes of a view projection matrix. The near plane assumes
+  /// a [-1, 1] depth range, which is only ever looser than the real one.
+  /// </summary>
+  static Planes planes(const glm::mat4& viewProj);
+
+  uint32_t insert(const glm::vec3& center, float radius);
+  /// <summary>
+  /// Does nothing if the sphere is unchanged, so it is cheap to call for
+  /// every item each frame.
+  /// </summary>
+  void move(uint32_t id, const glm::vec3& center, float radius);
+  void clear();
+
+  /// <summary>
+  /// Rebuilds the tree if items were inserted, otherwise refits the boxes
+  /// above anything moved. Call before querying.
+  /// </summary>
+  void refit();
+
+  /// <summary>
+  /// Appends the id of every item touching the frustum to out.
+  /// </summary>
+  void query(const Planes& planes, std::vector<uint32_t>& out) const;
+
+  inline size_t size() const { return spheres.size(); }
+  /// <summary>
+  /// Bumped whenever an item is inserted, moved or cleared, so anything
+  /// cached from the items can tell it is out of date.
+  /// </summary>
+  inline uint64_t version() const { return changes; }
+
+private:
+  struct Node {
+    glm::vec3 min;
+    /// Index of the second child, the first always follows its parent.
+    /// Zero for leaves
+    uint32_t right;
+    glm::vec3 max;
+    /// Parent of the root is itself
+    uint32_t parent;
+    /// Slots in the subtree, which are contiguous
+    uint32_t first;
+    uint32_t count;
+  };
+
+  void build();
+  uint32_t buildNode(uint32_t parent, uint32_t first, uint32_t count);
+  void fitLeaf(Node& node) const;
+  void emit(const Node& node, std::vector<uint32_t>& out) const;
+  void testLeaf(const Node& node, const Planes& planes,
+                std::vector<uint32_t>& out) const;
+
+  /// By id, xyz center and w radius
+  std::vector<glm::vec4> spheres;
+
+  std::vector<Node> nodes;
+  // SoA copies of spheres in slot order
+  std::vector<float> xs;
+  std::vector<float> ys;
+  std::vector<float> zs;
+  std::vector<float> radii;
+  std::vector<uint32_t> slotIds;
+  std::vector<uint32_t> idSlots;
+  std::vector<uint32_t> slotLeaves;
+  std::vector<uint8_t> dirty;
+
+  bool needsBuild = false;
+  bool needsRefit = false;
+  uint64_t changes = 0;
+};
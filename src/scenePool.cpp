@@ -0,0 +1,210 @@
+#include "scenePool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  // Nodes per thread pool job. A world matrix is one multiply, so each job
+  // needs plenty of them to be worth handing out
+  constexpr size_t GRAIN = 1024;
+
+  template <typename T>
+  void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+    std::vector<T> sorted;
+    sorted.reserve(order.size());
+    for (uint32_t i : order) {
+      sorted.push_back(values[i]);
+    }
+    values = std::move(sorted);
+  }
+} // namespace
+
+void ScenePool::reserve(size_t count) {
+  slots.reserve(count);
+  slotIds.reserve(count);
+  parents.reserve(count);
+  depths.reserve(count);
+  alive.reserve(count);
+  locals.reserve(count);
+  worlds.reserve(count);
+  radii.reserve(count);
+  clips.reserve(count);
+  times.reserve(count);
+  lengths.reserve(count);
+  stepRates.reserve(count);
+  stepCounts.reserve(count);
+  steps.reserve(count);
+}
+
+ScenePool::Handle ScenePool::create(Handle parent) {
+  uint32_t slot;
+  if (freeSlots.empty()) {
+    slot = static_cast<uint32_t>(slots.size());
+    slots.emplace_back();
+  } else {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+  }
+
+  uint32_t parentIndex = valid(parent) ? dense(parent) : NONE;
+  uint32_t depth = parentIndex == NONE ? 0 : depths[parentIndex] + 1;
+  // Appending keeps the order as long as nothing shallower follows
+  if (!depths.empty() && depth < depths.back()) {
+    needsRebuild = true;
+  }
+
+  auto index = static_cast<uint32_t>(locals.size());
+  slots[slot].dense = index;
+  slotIds.push_back(slot);
+  parents.push_back(parentIndex);
+  depths.push_back(depth);
+  alive.push_back(1);
+  locals.emplace_back(1.0f);
+  worlds.push_back(parentIndex == NONE ? glm::mat4(1.0f)
+                                       : worlds[parentIndex]);
+  radii.push_back(0.0f);
+  clips.push_back(0);
+  times.push_back(0.0f);
+  lengths.push_back(0.0f);
+  stepRates.push_back(0.0f);
+  stepCounts.push_back(0);
+  steps.push_back(0);
+
+  // Unless a rebuild is due, the node went on the end of the deepest level
+  if (levels.empty()) {
+    levels.push_back(0);
+  }
+  while (levels.size() < depth + 2) {
+    levels.push_back(levels.back());
+  }
+  levels.back() = index + 1;
+
+  return {slot, slots[slot].generation};
+}
+
+void ScenePool::destroy(Handle node) {
+  if (!valid(node)) {
+    return;
+  }
+
+  alive[dense(node)] = 0;
+  slots[node.index].dense = NONE;
+  ++slots[node.index].generation;
+  freeSlots.push_back(node.index);
+  needsRebuild = true;
+}
+
+bool ScenePool::valid(Handle node) const {
+  return node.index < slots.size() &&
+         slots[node.index].generation == node.generation &&
+         slots[node.index].dense != NONE;
+}
+
+void ScenePool::setLocal(Handle node, const glm::mat4& local) {
+  locals[dense(node)] = local;
+}
+
+void ScenePool::setRadius(Handle node, float radius) {
+  radii[dense(node)] = radius;
+}
+
+void ScenePool::setAnimation(Handle node, const Animation& animation,
+                             float time) {
+  uint32_t i = dense(node);
+  clips[i] = animation.clip;
+  lengths[i] = animation.length;
+  stepRates[i] = animation.stepsPerSecond;
+  stepCounts[i] = animation.stepCount;
+  if (animation.stepCount == 0) {
+    times[i] = 0.0f;
+    steps[i] = 0;
+    return;
+  }
+  times[i] = std::fmod(time, animation.length);
+  steps[i] = static_cast<uint32_t>(times[i] * stepRates[i]) % stepCounts[i];
+}
+
+void ScenePool::rebuild() {
+  auto count = static_cast<uint32_t>(locals.size());
+
+  // Parents always come before their children, so one pass front to back
+  // catches every descendant of a destroyed node
+  order.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    if (alive[i] && parents[i] != NONE && !alive[parents[i]]) {
+      alive[i] = 0;
+      uint32_t slot = slotIds[i];
+      slots[slot].dense = NONE;
+      ++slots[slot].generation;
+      freeSlots.push_back(slot);
+    }
+    if (alive[i]) {
+      order.push_back(i);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return depths[a] < depths[b];
+  });
+
+  remap.assign(count, NONE);
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    remap[order[i]] = i;
+  }
+
+  permute(slotIds, order);
+  permute(parents, order);
+  permute(depths, order);
+  permute(alive, order);
+  permute(locals, order);
+  permute(worlds, order);
+  permute(radii, order);
+  permute(clips, order);
+  permute(times, order);
+  permute(lengths, order);
+  permute(stepRates, order);
+  permute(stepCounts, order);
+  permute(steps, order);
+
+  levels.clear();
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    slots[slotIds[i]].dense = i;
+    if (parents[i] != NONE) {
+      parents[i] = remap[parents[i]];
+    }
+    while (levels.size() <= depths[i]) {
+      levels.push_back(i);
+    }
+  }
+  levels.push_back(static_cast<uint32_t>(order.size()));
+
+  needsRebuild = false;
+}
+
+void ScenePool::update(float delta) {
+  if (needsRebuild) {
+    rebuild();
+  }
+
+  threads.parallelFor(size(), GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (stepCounts[i] == 0) {
+        continue;
+      }
+      times[i] = std::fmod(times[i] + delta, lengths[i]);
+      steps[i] =
+          static_cast<uint32_t>(times[i] * stepRates[i]) % stepCounts[i];
+    }
+  });
+
+  // Each level only reads the one above, which is already done
+  for (size_t level = 0; level + 1 < levels.size(); ++level) {
+    size_t first = levels[level];
+    threads.parallelFor(
+        levels[level + 1] - first, GRAIN, [&](size_t begin, size_t end) {
+          for (size_t i = first + begin; i < first + end; ++i) {
+            worlds[i] = parents[i] == NONE ? locals[i]
+                                           : worlds[parents[i]] * locals[i];
+          }
+        });
+  }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "threadPool.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+/// <summary>
+/// Pooled storage for nodes that need a transform and animation every frame
+/// but none of a scene graph node's virtual calls.
+///
+/// Nodes are referred to by generational handles, so a handle to a destroyed
+/// node is simply invalid rather than dangling, and its slot can be reused
+/// without a heap allocation. Local and world transforms, parents, bounds and
+/// animation state are kept in separate arrays sorted by depth in the
+/// hierarchy. Update then walks them front to back: every parent comes
+/// before its children, and each depth is one contiguous range whose world
+/// matrices are worked out on the thread pool at once.
+/// </summary>
+class ScenePool {
+public:
+  constexpr static uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  struct Handle {
+    uint32_t index = NONE;
+    uint32_t generation = 0;
+
+    bool operator==(const Handle&) const = default;
+  };
+
+  /// <summary>
+  /// One clip played on a loop, timed in steps so it matches however the
+  /// owner quantises its frames.
+  /// </summary>
+  struct Animation {
+    uint32_t clip = 0;
+    /// Seconds
+    float length = 0.0f;
+    float stepsPerSecond = 0.0f;
+    uint32_t stepCount = 0;
+  };
+
+  explicit ScenePool(ThreadPool& threads) : threads(threads) {}
+
+  ScenePool(const ScenePool&) = delete;
+  ScenePool& operator=(const ScenePool&) = delete;
+
+  void reserve(size_t count);
+
+  /// <summary>
+  /// Adds a node with an identity transform under parent, or as a root if
+  /// parent is not a valid node.
+  /// </summary>
+  Handle create(Handle parent);
+  inline Handle create() { return create(Handle{}); }
+  /// <summary>
+  /// Frees the node now. Its descendants are freed on the next update.
+  /// </summary>
+  void destroy(Handle node);
+  bool valid(Handle node) const;
+
+  void setLocal(Handle node, const glm::mat4& local);
+  /// <summary>
+  /// Bounding radius around the world position, already in world space.
+  /// </summary>
+  void setRadius(Handle node, float radius);
+  void setAnimation(Handle node, const Animation& animation, float time);
+
+  inline const glm::mat4& world(Handle node) const {
+    return worlds[dense(node)];
+  }
+  inline float radius(Handle node) const { return radii[dense(node)]; }
+  inline uint32_t clip(Handle node) const { return clips[dense(node)]; }
+  /// The step the node's animation is on
+  inline uint32_t step(Handle node) const { return steps[dense(node)]; }
+
+  /// <summary>
+  /// Advances every animation by delta seconds and recomputes every world
+  /// matrix, after packing away destroyed nodes and resorting if the
+  /// hierarchy changed.
+  /// </summary>
+  void update(float delta);
+
+  inline size_t size() const { return locals.size(); }
+  inline size_t depth() const {
+    return levels.empty() ? 0 : levels.size() - 1;
+  }
+
+private:
+  struct Slot {
+    uint32_t dense = NONE;
+    uint32_t generation = 0;
+  };
+
+  inline uint32_t dense(Handle node) const {
+    return slots[node.index].dense;
+  }
+
+  /// Drops dead nodes and sorts the rest by depth, keeping their order
+  /// within each depth
+  void rebuild();
+
+  ThreadPool& threads;
+
+  std::vector<Slot> slots;
+  std::vector<uint32_t> freeSlots;
+
+  // By dense index, sorted by depth after every rebuild
+  std::vector<uint32_t> slotIds;
+  std::vector<uint32_t> parents;
+  std::vector<uint32_t> depths;
+  std::vector<uint8_t> alive;
+  std::vector<glm::mat4> locals;
+  std::vector<glm::mat4> worlds;
+  std::vector<float> radii;
+
+  std::vector<uint32_t> clips;
+  std::vector<float> times;
+  std::vector<float> lengths;
+  std::vector<float> stepRates;
+  std::vector<uint32_t> stepCounts;
+  std::vector<uint32_t> steps;
+
+  /// Start of each depth's range, with the end of the last at the back
+  std::vector<uint32_t> levels;
+  bool needsRebuild = false;
+
+  // Reused by rebuild
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> remap;
+};
@@ -0,0 +1,149 @@
+#include "shadowAtlas.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+namespace {
+  // Every other bit of v starting from the lowest, packed together
+  GLuint compactBits(GLuint v) {
+    v &= 0x55555555u;
+    v = (v | (v >> 1)) & 0x33333333u;
+    v = (v | (v >> 2)) & 0x0f0f0f0fu;
+    v = (v | (v >> 4)) & 0x00ff00ffu;
+    v = (v | (v >> 8)) & 0x0000ffffu;
+    return v;
+  }
+
+  uint64_t tileArea(GLuint faces, GLuint size) {
+    return static_cast<uint64_t>(faces) * size * size;
+  }
+} // namespace
+
+GLuint ShadowAtlas::tileSize(const glm::vec4& sphere, const glm::vec3& eye,
+                             float height, float scale) {
+  float distance = glm::length(glm::vec3(sphere) - eye);
+  if (distance <= sphere.w) {
+    return MAX_TILE;
+  }
+
+  // With a 90 degree field of view, the sphere spans about radius over
+  // distance of the screen's height
+  float pixels = sphere.w / distance * height * scale;
+  auto size = std::bit_ceil(static_cast<GLuint>(std::max(pixels, 1.0f)));
+  return std::clamp(size, MIN_TILE, MAX_TILE);
+}
+
+ShadowAtlas::ShadowAtlas() {
+  for (gl::Texture* texture : {&live, &statics}) {
+    texture->storage(1, GL_DEPTH_COMPONENT24,
+                     gl::Texture::Size{static_cast<int32_t>(SIZE),
+                                       static_cast<int32_t>(SIZE)});
+    texture->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    texture->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  }
+
+  liveFbo.attachTexture(GL_DEPTH_ATTACHMENT, live.id(), 0);
+  staticFbo.attachTexture(GL_DEPTH_ATTACHMENT, statics.id(), 0);
+  for (const gl::Framebuffer* fbo : {&liveFbo, &staticFbo}) {
+    glNamedFramebufferDrawBuffer(fbo->id(), GL_NONE);
+    glNamedFramebufferReadBuffer(fbo->id(), GL_NONE);
+  }
+}
+
+void ShadowAtlas::layout(std::span<const Request> requests) {
+  sizes.resize(requests.size());
+  uint64_t area = 0;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    GLuint size = requests[i].size;
+    sizes[i] = size == 0 ? 0
+                         : std::clamp(std::bit_ceil(size), MIN_TILE, MAX_TILE);
+    area += tileArea(requests[i].faces, sizes[i]);
+  }
+
+  // Halve the largest tiles first, which gives back the most room for each
+  // light that loses detail
+  constexpr uint64_t BUDGET = static_cast<uint64_t>(SIZE) * SIZE;
+  while (area > BUDGET) {
+    size_t largest = requests.size();
+    for (size_t i = 0; i < requests.size(); ++i) {
+      if (sizes[i] > MIN_TILE &&
+          (largest == requests.size() || sizes[i] > sizes[largest])) {
+        largest = i;
+      }
+    }
+    if (largest == requests.size()) {
+      break;
+    }
+    GLuint faces = requests[largest].faces;
+    area -= tileArea(faces, sizes[largest]);
+    sizes[largest] /= 2;
+    area += tileArea(faces, sizes[largest]);
+  }
+  // Only when there are thousands of lights
+  for (size_t i = requests.size(); i > 0 && area > BUDGET; --i) {
+    area -= tileArea(requests[i - 1].faces, sizes[i - 1]);
+    sizes[i - 1] = 0;
+  }
+
+  firsts.resize(requests.size());
+  counts.resize(requests.size());
+  GLuint total = 0;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    firsts[i] = total;
+    counts[i] = requests[i].faces;
+    total += requests[i].faces;
+  }
+  assigned.assign(total, Tile{});
+
+  // Every tile before a square is at least its size, so its start along the
+  // curve is always a multiple of its area and it lands on its own aligned
+  // block
+  order.resize(requests.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::ranges::stable_sort(
+      order, [&](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
+  GLuint cell = 0;
+  for (uint32_t request : order) {
+    GLuint size = sizes[request];
+    if (size == 0) {
+      continue;
+    }
+    GLuint cells = (size / MIN_TILE) * (size / MIN_TILE);
+    for (GLuint face = 0; face < counts[request]; ++face) {
+      assigned[firsts[request] + face] = {
+          .x = compactBits(cell) * MIN_TILE,
+          .y = compactBits(cell >> 1) * MIN_TILE,
+          .size = size,
+      };
+      cell += cells;
+    }
+  }
+  used = static_cast<uint64_t>(cell) * MIN_TILE * MIN_TILE;
+}
+
+std::span<const ShadowAtlas::Tile> ShadowAtlas::tiles(size_t request) const {
+  if (request >= firsts.size()) {
+    return {};
+  }
+  return std::span(assigned).subspan(firsts[request], counts[request]);
+}
+
+void ShadowAtlas::clearStatic(const Tile& tile) const {
+  // Depth is reversed, so 0 is the far plane
+  float cleared = 0.0f;
+  glClearTexSubImage(statics.id(), 0, static_cast<GLint>(tile.x),
+                     static_cast<GLint>(tile.y), 0,
+                     static_cast<GLsizei>(tile.size),
+                     static_cast<GLsizei>(tile.size), 1, GL_DEPTH_COMPONENT,
+                     GL_FLOAT, &cleared);
+}
+
+void ShadowAtlas::restore(const Tile& tile) const {
+  glCopyImageSubData(statics.id(), GL_TEXTURE_2D, 0,
+                     static_cast<GLint>(tile.x), static_cast<GLint>(tile.y), 0,
+                     live.id(), GL_TEXTURE_2D, 0, static_cast<GLint>(tile.x),
+                     static_cast<GLint>(tile.y), 0,
+                     static_cast<GLsizei>(tile.size),
+                     static_cast<GLsizei>(tile.size), 1);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <gl/gl.hpp>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+/// <summary>
+/// One depth texture holding every light's shadow map, with each light's
+/// tiles sized every frame by how much of the screen it covers.
+///
+/// Tiles are power of two squares, and point lights take six of the same
+/// size, one per cube face. Squares like these never leave gaps when laid
+/// out largest first along a Z-order curve, so as long as their total area
+/// fits the atlas so do they. When the lights ask for more than that, the
+/// largest tiles are halved until everything fits, so memory stays at the
+/// atlas's size however many lights there are.
+///
+/// A second texture with the same layout holds just the static casters,
+/// which the live tiles are restored from before the crowd is drawn.
+/// </summary>
+class ShadowAtlas {
+public:
+  /// Edge of the atlas in texels, 256MB for each of the two textures
+  constexpr static GLuint SIZE = 8192;
+  constexpr static GLuint MIN_TILE = 128;
+  constexpr static GLuint MAX_TILE = 2048;
+
+  struct Tile {
+    GLuint x = 0;
+    GLuint y = 0;
+    /// 0 if the light did not fit
+    GLuint size = 0;
+
+    bool operator==(const Tile&) const = default;
+
+    /// The origin as the lighting shaders read it
+    inline GLuint packed() const { return x | (y << 16); }
+  };
+
+  struct Request {
+    /// 6 for point lights, 1 for spot lights
+    GLuint faces = 1;
+    /// Edge of each tile, a power of two from MIN_TILE to MAX_TILE, or 0 for
+    /// a light that needs no shadow this frame
+    GLuint size = MIN_TILE;
+  };
+
+  /// <summary>
+  /// Tile edge for a light whose sphere is seen from eye on a screen height
+  /// pixels tall. Roughly the light's size on screen times scale, rounded up
+  /// to a power of two. A camera inside the light gets MAX_TILE.
+  /// </summary>
+  static GLuint tileSize(const glm::vec4& sphere, const glm::vec3& eye,
+                         float height, float scale);
+
+  ShadowAtlas();
+  ShadowAtlas(const ShadowAtlas&) = delete;
+  ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+  /// <summary>
+  /// Hands out every request's tiles, halving the largest until they fit.
+  /// Lights that still do not fit at MIN_TILE get empty tiles, last first.
+  /// </summary>
+  void layout(std::span<const Request> requests);
+  /// <summary>
+  /// The request's tiles from the last layout, one per face.
+  /// </summary>
+  std::span<const Tile> tiles(size_t request) const;
+
+  /// Texels handed out by the last layout
+  inline uint64_t usedArea() const { return used; }
+
+  void bindLive() const { liveFbo.bind(); }
+  void bindStatic() const { staticFbo.bind(); }
+  /// <summary>
+  /// Clears the tile of the static texture to the far plane.
+  /// </summary>
+  void clearStatic(const Tile& tile) const;
+  /// <summary>
+  /// Copies the tile of the static texture over the live one.
+  /// </summary>
+  void restore(const Tile& tile) const;
+
+  const gl::Texture& texture() const { return live; }
+
+private:
+  gl::Texture live;
+  gl::Texture statics;
+  gl::Framebuffer liveFbo = {};
+  gl::Framebuffer staticFbo = {};
+
+  // Every request's tiles one after the other, in request order
+  std::vector<Tile> assigned;
+  std::vector<GLuint> firsts;
+  std::vector<GLuint> counts;
+
+  // Reused by layout
+  std::vector<GLuint> sizes;
+  std::vector<uint32_t> order;
+
+  uint64_t used = 0;
+};
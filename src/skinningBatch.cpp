@@ -0,0 +1,418 @@
+#include "skinningBatch.hpp"
+
+#include "logger/logger.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+  constexpr GLuint TRANSFORM_SIZE = sizeof(PackedTransform);
+  constexpr GLuint LAYER_SIZE = sizeof(SkinningBatch::Layer);
+  constexpr GLuint TEXTURE_SIZE = sizeof(engine::mesh::TextureHandleSet);
+  constexpr GLuint COMMAND_SIZE = sizeof(gl::DrawElementsIndirectCommand);
+  constexpr GLuint COUNTER_SIZE = sizeof(GLuint);
+  constexpr GLuint POSE_INDEX_SIZE = sizeof(GLuint);
+  // Copies need no more than this, and every staged type is a multiple of it
+  constexpr GLuint STAGING_ALIGNMENT = 4;
+
+  bool same(const auto& a, const auto& b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+  }
+
+  /// <summary>
+  /// Writes the runs of current that differ from uploaded through write,
+  /// then makes uploaded match it. An empty uploaded writes everything.
+  /// </summary>
+  /// <returns>Bytes written</returns>
+  template <typename T, typename Write>
+  GLuint writeChanged(Write&& write, GLuint offset,
+                      const std::vector<T>& current,
+                      std::vector<T>& uploaded) {
+    constexpr auto size = static_cast<GLuint>(sizeof(T));
+    size_t common = std::min(current.size(), uploaded.size());
+    auto changed = [&](size_t i) {
+      return i >= common || !same(current[i], uploaded[i]);
+    };
+
+    GLuint written = 0;
+    for (size_t i = 0; i < current.size();) {
+      if (!changed(i)) {
+        ++i;
+        continue;
+      }
+      size_t end = i + 1;
+      while (end < current.size() && changed(end)) {
+        ++end;
+      }
+      auto bytes = static_cast<GLuint>(end - i) * size;
+      write(&current[i], bytes, offset + static_cast<GLuint>(i) * size);
+      written += bytes;
+      i = end;
+    }
+
+    uploaded = current;
+    return written;
+  }
+} // namespace
+
+void SkinningBatch::begin() {
+  poses.clear();
+  lookup.clear();
+  vertices = 0;
+  groups = 0;
+  slots = 0;
+  added = 0;
+  layerCount = 0;
+  viewMask = 1;
+}
+
+SkinningBatch::Instance SkinningBatch::add(GLuint inputStart,
+                                           GLuint vertexCount,
+                                           GLuint clip,
+                                           GLuint jointCount, GLuint frame,
+                                           std::span<const Layer> layers) {
+  auto [it, inserted] =
+      lookup.try_emplace({inputStart, clip, frame},
+                         static_cast<uint32_t>(poses.size()));
+  if (inserted) {
+    Job job = {inputStart, clip, jointCount, frame, vertices,
+               vertexCount, groups, it->second};
+    poses.push_back({.job = job, .layers = layers});
+    layerCount += static_cast<GLuint>(layers.size());
+    vertices += vertexCount;
+    groups += (vertexCount + GROUP_SIZE - 1) / GROUP_SIZE;
+  }
+
+  auto& pose = poses[it->second];
+  Instance instance = added++;
+  if (instance == instances.size()) {
+    instances.push_back({it->second, pose.instanceCount++, viewMask});
+    return instance;
+  }
+
+  auto& data = instances[instance];
+  data.pose = it->second;
+  data.indexInPose = pose.instanceCount++;
+  if (data.mask != viewMask) {
+    data.mask = viewMask;
+    data.dirty = true;
+  }
+  return instance;
+}
+
+GLuint SkinningBatch::stagingSize() const {
+  auto poseCount = static_cast<GLuint>(poses.size());
+  // The job table is bound, so may need aligning
+  GLuint jobs = gl::Buffer::roundToAlignment(
+      poseCount * static_cast<GLuint>(sizeof(Job)) +
+          gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT,
+      gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+  // Slots are only laid out in upload, but there is one per instance added
+  return jobs +
+         added * (INSTANCE_SIZE + TRANSFORM_SIZE + POSE_INDEX_SIZE) +
+         poseCount * POSE_SIZE + layerCount * (LAYER_SIZE + TEXTURE_SIZE);
+}
+
+void SkinningBatch::dispatch(FrameRing& ring) {
+  if (poses.empty()) {
+    return;
+  }
+
+  jobs.clear();
+  for (const auto& pose : poses) {
+    if (pose.job.vertexCount != 0) {
+      jobs.push_back(pose.job);
+    }
+  }
+  if (jobs.empty()) {
+    return;
+  }
+
+  auto size = static_cast<GLuint>(jobs.size() * sizeof(Job));
+  auto offset = ring.allocate(size);
+  if (!offset) {
+    Logger::error("Frame ring has no room for {} skinning jobs", jobs.size());
+    return;
+  }
+
+  ring.getMapping().write(jobs.data(), size, *offset);
+  ring.getBuffer().bindRange(gl::Buffer::StorageTarget::STORAGE, 4, *offset,
+                             size);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 6, visibleOffset,
+                         static_cast<GLuint>(poses.size()) * COUNTER_SIZE);
+
+  // Only 65535 groups are guaranteed along x, so larger batches spill into
+  // y and the shader flattens the two back out
+  constexpr GLuint MAX_GROUPS_X = 65535;
+  GLuint x = std::min(groups, MAX_GROUPS_X);
+  GLuint y = (groups + x - 1) / x;
+  glUniform1ui(0, groups);
+  glDispatchCompute(x, y, 1);
+}
+
+void SkinningBatch::setTransform(Instance instance, const glm::mat4& model,
+                                 float radius) {
+  auto& data = instances[instance];
+  if (data.model == model && data.radius == radius) {
+    return;
+  }
+  data.model = model;
+  data.radius = radius;
+  data.dirty = true;
+}
+
+bool SkinningBatch::needsTextures(Instance instance) const {
+  return poses[instances[instance].pose].textures.empty();
+}
+
+void SkinningBatch::setTextures(
+    Instance instance, std::vector<engine::mesh::TextureHandleSet>&& sets) {
+  poses[instances[instance].pose].textures = std::move(sets);
+}
+
+void SkinningBatch::upload(FrameRing& ring, GLuint viewCount) {
+  instances.resize(added);
+
+  slots = 0;
+  for (auto& pose : poses) {
+    pose.firstSlot = slots;
+    slots += pose.instanceCount;
+  }
+
+  instancePoses.resize(instances.size());
+  for (size_t i = 0; i < instances.size(); ++i) {
+    instancePoses[i] = instances[i].pose;
+  }
+
+  cullPoses.clear();
+  cullLayers.clear();
+  cullTextures.clear();
+  for (const auto& pose : poses) {
+    auto count = static_cast<GLuint>(pose.layers.size());
+    cullPoses.push_back({pose.firstSlot,
+                         static_cast<GLuint>(cullLayers.size()), count,
+                         pose.job.outputStart});
+    for (GLuint l = 0; l < count; ++l) {
+      cullLayers.push_back(pose.layers[l]);
+      cullTextures.push_back(l < pose.textures.size()
+                                 ? pose.textures[l]
+                                 : engine::mesh::TextureHandleSet{});
+    }
+  }
+
+  // Every section is bound on its own, so each starts aligned
+  auto section = [](GLuint& offset, GLuint size) {
+    GLuint start = offset;
+    offset = gl::Buffer::roundToAlignment(offset + std::max(size, 1u),
+                                          gl::UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+    return start;
+  };
+
+  auto poseCount = static_cast<GLuint>(poses.size());
+  // The sections that hardly change come first, so a change in the number
+  // of poses leaves them where they are
+  InputLayout layout;
+  GLuint offset = 0;
+  layout.instances = section(offset, slots * INSTANCE_SIZE);
+  layout.transforms = section(offset, slots * TRANSFORM_SIZE);
+  layout.instancePoses = section(offset, slots * POSE_INDEX_SIZE);
+  layout.poses = section(offset, poseCount * POSE_SIZE);
+  layout.layers = section(offset, layerCount * LAYER_SIZE);
+  layout.textures = section(offset, layerCount * TEXTURE_SIZE);
+  layout.size = offset;
+
+  bool reupload = layout != input || stagingFailed;
+  if (inputBuffer.size() < layout.size) {
+    inputBuffer = {};
+    inputBuffer.label("Cull Inputs");
+    inputBuffer.init(layout.size);
+    reupload = true;
+  }
+  input = layout;
+  stagingFailed = false;
+
+  // Nothing in the buffer can be trusted once the sections move
+  if (reupload) {
+    for (auto& data : instances) {
+      data.dirty = true;
+    }
+    uploadedInstancePoses.clear();
+    uploadedPoses.clear();
+    uploadedLayers.clear();
+    uploadedTextures.clear();
+  }
+
+  auto write = [&](const void* data, GLuint size, GLuint offset) {
+    stage(ring, data, size, offset);
+  };
+  uploaded = 0;
+  uploadInstances(ring);
+  uploaded += writeChanged(write, input.instancePoses, instancePoses,
+                           uploadedInstancePoses);
+  uploaded += writeChanged(write, input.poses, cullPoses, uploadedPoses);
+  uploaded += writeChanged(write, input.layers, cullLayers, uploadedLayers);
+  uploaded +=
+      writeChanged(write, input.textures, cullTextures, uploadedTextures);
+  if (stagingFailed) {
+    Logger::error("Frame ring has no room for {} bytes of cull inputs",
+                  uploaded);
+  }
+
+  offset = 0;
+  viewLayout.commands = section(offset, layerCount * COMMAND_SIZE);
+  viewLayout.counters = section(offset, (poseCount + 1) * COUNTER_SIZE);
+  viewLayout.transforms = section(offset, slots * TRANSFORM_SIZE);
+  viewLayout.textures = section(offset, layerCount * TEXTURE_SIZE);
+  viewLayout.size = offset;
+  views = viewCount;
+  visibleOffset = viewLayout.size * views;
+
+  GLuint outputSize = visibleOffset + std::max(poseCount, 1u) * COUNTER_SIZE;
+  if (outputBuffer.size() < outputSize) {
+    outputBuffer = {};
+    outputBuffer.label("Culled Draws");
+    outputBuffer.init(outputSize);
+  }
+  // Only views culled this frame mark poses to skin
+  if (poseCount != 0) {
+    glClearNamedBufferSubData(outputBuffer.id(), GL_R32UI, visibleOffset,
+                              poseCount * COUNTER_SIZE, GL_RED_INTEGER,
+                              GL_UNSIGNED_INT, nullptr);
+  }
+}
+
+void SkinningBatch::stage(FrameRing& ring, const void* data, GLuint size,
+                          GLuint offset) {
+  auto source = ring.allocate(size, STAGING_ALIGNMENT);
+  if (!source) {
+    stagingFailed = true;
+    return;
+  }
+
+  ring.getMapping().write(data, size, *source);
+  glCopyNamedBufferSubData(ring.getBuffer().id(), inputBuffer.id(), *source,
+                           offset, size);
+}
+
+void SkinningBatch::uploadInstances(FrameRing& ring) {
+  auto count = static_cast<GLuint>(instances.size());
+  for (GLuint first = 0; first < count;) {
+    if (!instances[first].dirty) {
+      ++first;
+      continue;
+    }
+
+    cullInstances.clear();
+    cullTransforms.clear();
+    GLuint end = first;
+    for (; end < count && instances[end].dirty; ++end) {
+      auto& data = instances[end];
+      cullInstances.push_back(
+          {.sphere = glm::vec4(glm::vec3(data.model[3]), data.radius),
+           .mask = data.mask});
+      cullTransforms.push_back(PackedTransform::pack(data.model));
+      data.dirty = false;
+    }
+
+    GLuint run = end - first;
+    stage(ring, cullInstances.data(), run * INSTANCE_SIZE,
+          input.instances + first * INSTANCE_SIZE);
+    stage(ring, cullTransforms.data(), run * TRANSFORM_SIZE,
+          input.transforms + first * TRANSFORM_SIZE);
+    uploaded += run * (INSTANCE_SIZE + TRANSFORM_SIZE);
+    first = end;
+  }
+}
+
+void SkinningBatch::cull(GLuint view, GLuint mask, const Cull& cull) {
+  if (view >= views) {
+    return;
+  }
+
+  GLuint base = view * viewLayout.size;
+  GLuint countersSize =
+      (static_cast<GLuint>(poses.size()) + 1) * COUNTER_SIZE;
+  // Zeroes the draw count along with every pose's count
+  glClearNamedBufferSubData(outputBuffer.id(), GL_R32UI,
+                            base + viewLayout.counters, countersSize,
+                            GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  if (slots == 0) {
+    return;
+  }
+
+  inputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 1,
+                        input.instances, slots * INSTANCE_SIZE);
+  inputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 2,
+                        input.transforms, slots * TRANSFORM_SIZE);
+  inputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 5,
+                        input.instancePoses, slots * POSE_INDEX_SIZE);
+  inputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 6, input.poses,
+                        static_cast<GLuint>(poses.size()) * POSE_SIZE);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 3,
+                         base + viewLayout.counters, countersSize);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 4,
+                         base + viewLayout.transforms,
+                         slots * TRANSFORM_SIZE);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 7, visibleOffset,
+                         static_cast<GLuint>(poses.size()) * COUNTER_SIZE);
+
+  glUniform1ui(0, slots);
+  glUniform1ui(1, mask);
+  glUniform1ui(2, static_cast<GLuint>(cull.mode));
+  glUniformMatrix4fv(3, 1, GL_FALSE, &cull.matrix[0][0]);
+  glUniform4fv(4, 1, &cull.sphere[0]);
+  glDispatchCompute((slots + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void SkinningBatch::emit(GLuint view) {
+  if (view >= views || poses.empty()) {
+    return;
+  }
+
+  GLuint base = view * viewLayout.size;
+  auto poseCount = static_cast<GLuint>(poses.size());
+  inputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 1, input.poses,
+                        poseCount * POSE_SIZE);
+  inputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 2, input.layers,
+                        layerCount * LAYER_SIZE);
+  inputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 3, input.textures,
+                        layerCount * TEXTURE_SIZE);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 4,
+                         base + viewLayout.counters,
+                         (poseCount + 1) * COUNTER_SIZE);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 5,
+                         base + viewLayout.commands,
+                         layerCount * COMMAND_SIZE);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 6,
+                         base + viewLayout.textures,
+                         layerCount * TEXTURE_SIZE);
+
+  glUniform1ui(0, poseCount);
+  glDispatchCompute((poseCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+                  GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void SkinningBatch::draw(GLuint view, const gl::Vao& vao) {
+  if (view >= views || layerCount == 0) {
+    return;
+  }
+
+  GLuint base = view * viewLayout.size;
+  vao.bindVertexBuffer(1, outputBuffer.id(), base + viewLayout.transforms,
+                       TRANSFORM_SIZE);
+  outputBuffer.bindRange(gl::Buffer::StorageTarget::STORAGE, 2,
+                         base + viewLayout.textures,
+                         layerCount * TEXTURE_SIZE);
+  outputBuffer.bind(gl::Buffer::BasicTarget::DRAW_INDIRECT);
+  glBindBuffer(GL_PARAMETER_BUFFER, outputBuffer.id());
+
+  // The count is only known on the GPU, so every view can draw up to one
+  // command per layer of every pose
+  glMultiDrawElementsIndirectCount(
+      GL_TRIANGLES, GL_UNSIGNED_INT,
+      reinterpret_cast<void*>(
+          static_cast<uintptr_t>(base + viewLayout.commands)),
+      static_cast<GLintptr>(base + viewLayout.counters), layerCount,
+      COMMAND_SIZE);
+}
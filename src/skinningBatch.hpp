@@ -0,0 +1,304 @@
+#pragma once
+
+#include "frameRing.hpp"
+#include "packedVertex.hpp"
+#include <engine/mesh/mesh.hpp>
+#include <gl/gl.hpp>
+#include <glm/glm.hpp>
+#include <map>
+#include <span>
+#include <tuple>
+#include <vector>
+
+/// <summary>
+/// Groups every skinned instance of the frame by pose, meaning the same mesh
+/// and animation on the same frame, so each pose is skinned once and drawn
+/// once for all of its instances.
+///
+/// Poses are skinned by one compute dispatch. Each pose's job is given its
+/// own run of GROUP_SIZE wide workgroups. A workgroup looks its job up in the
+/// table, decodes the pose's joints from its compressed AnimationClip into
+/// shared memory once, then skins up to GROUP_SIZE vertices from them, so the
+/// cost follows the number of distinct poses rather than the crowd size.
+///
+/// Culling and draw generation also happen on the GPU, once per view. The
+/// cull pass tests each instance's bounding sphere and compacts the survivors
+/// to the front of their pose's range of transforms. The emit pass then
+/// writes one command per layer for every pose with a survivor, along with
+/// its texture sets, and counts them for glMultiDrawElementsIndirectCount.
+/// So the CPU's share is the same however large the crowd gets.
+///
+/// Every view is culled before anything is skinned, and the cull pass flags
+/// each pose with a survivor. Skinning then skips the workgroups of any pose
+/// no view kept, so off screen characters cost no skinning at all.
+///
+/// Instances keep their slot in the cull inputs for as long as they are
+/// added in the same order, so an instance's transform and bounds are only
+/// uploaded when they change. What changes with the frame is each
+/// instance's pose, and the small pose, layer and texture tables, which are
+/// diffed against what was last uploaded so only changed runs are written.
+/// Changes are staged through the renderer's FrameRing and copied into the
+/// GPU only input buffer, so they never touch data a frame in flight reads.
+/// </summary>
+class SkinningBatch {
+public:
+  /// Must match local_size_x in skin.comp.glsl
+  constexpr static GLuint GROUP_SIZE = 128;
+  /// Must match local_size_x in cull.comp.glsl and cull_emit.comp.glsl
+  constexpr static GLuint CULL_GROUP_SIZE = 64;
+
+  using Instance = uint32_t;
+
+  struct Layer {
+    /// Absolute index into the static buffer's index section
+    GLuint firstIndex;
+    GLuint indexCount;
+  };
+
+  /// Matches the std430 layout of the job table in skin.comp.glsl
+  struct Job {
+    /// First WeightedVertex in the static buffer
+    GLuint inputStart;
+    /// Entry in the clip table
+    GLuint clip;
+    GLuint jointCount;
+    /// In 1 / AnimationClip::FRAME_STEPS of a frame
+    GLuint frame;
+    /// First Vertex in the skinned vertex buffer
+    GLuint outputStart;
+    GLuint vertexCount;
+    /// First workgroup of the dispatch given to this job
+    GLuint firstGroup;
+    /// Index of the pose, whose visibility flag gates the job
+    GLuint pose;
+  };
+
+  /// <summary>
+  /// What the instances of a view are culled against.
+  /// </summary>
+  struct Cull {
+    /// Must match the CULL_ defines in cull.comp.glsl
+    enum class Mode : GLuint {
+      NONE,
+      /// The frustum of the camera bound to uniform binding 0
+      CAMERA,
+      /// The frustum of matrix
+      MATRIX,
+      /// Anything touching sphere
+      SPHERE,
+    };
+
+    Mode mode = Mode::NONE;
+    glm::mat4 matrix = glm::mat4(1.0f);
+    /// Center in xyz, radius in w
+    glm::vec4 sphere = glm::vec4(0.0f);
+  };
+
+  SkinningBatch() = default;
+  SkinningBatch(const SkinningBatch&) = delete;
+  SkinningBatch& operator=(const SkinningBatch&) = delete;
+
+  /// <summary>
+  /// Drops the previous frame's poses. Instances are kept, and the first
+  /// added this frame takes the slot of the previous frame's first.
+  /// </summary>
+  void begin();
+
+  /// <summary>
+  /// Views that instances added from now on are drawn in, as a bit mask.
+  /// </summary>
+  inline void setViewMask(GLuint mask) { viewMask = mask; }
+
+  /// <summary>
+  /// Adds an instance of the mesh starting at inputStart, posed on frame of
+  /// the clip table's entry clip. The first instance on a pose queues its
+  /// skinning job, later ones share its output. layers must stay valid until
+  /// upload.
+  /// </summary>
+  Instance add(GLuint inputStart, GLuint vertexCount, GLuint clip,
+               GLuint jointCount, GLuint frame, std::span<const Layer> layers);
+
+  /// <summary>
+  /// Skinned vertices the frame's poses need. Only final once every instance
+  /// has been added.
+  /// </summary>
+  inline GLuint outputVertices() const { return vertices; }
+
+  /// <summary>
+  /// Upper bound on what dispatch and upload take from the frame's ring.
+  /// Only final once every instance has been added.
+  /// </summary>
+  GLuint stagingSize() const;
+
+  /// <summary>
+  /// Writes the job table into the ring, binds it to storage binding 4 and
+  /// skins every pose some view's cull kept. The skinning program and its
+  /// vertex, key and clip buffers must already be bound. Every view must
+  /// have been culled first.
+  /// </summary>
+  void dispatch(FrameRing& ring);
+
+  /// <summary>
+  /// Sets the model matrix and the world space radius culled against. Only
+  /// marks the instance for upload if either changed. Different instances
+  /// can be set from different threads at once.
+  /// </summary>
+  void setTransform(Instance instance, const glm::mat4& model, float radius);
+
+  /// <summary>
+  /// True until the instance's pose has been given its texture sets this
+  /// frame. All instances on a pose share a mesh, so share its textures.
+  /// </summary>
+  bool needsTextures(Instance instance) const;
+  void setTextures(Instance instance,
+                   std::vector<engine::mesh::TextureHandleSet>&& sets);
+
+  /// <summary>
+  /// Uploads the transform and bounds of every instance that changed, and
+  /// what changed in the frame's pose tables, for the cull passes. Makes
+  /// room for viewCount views of output and clears the pose visibility
+  /// flags. Every instance's transform and textures must already be set.
+  /// Instances not added this frame are dropped, and no more can be added
+  /// afterwards.
+  /// </summary>
+  void upload(FrameRing& ring, GLuint viewCount);
+
+  /// <summary>
+  /// Culls the view's instances, keeping those sharing a bit with mask, and
+  /// flags the pose of every survivor for skinning. The cull program must
+  /// already be bound.
+  /// </summary>
+  void cull(GLuint view, GLuint mask, const Cull& cull);
+
+  /// <summary>
+  /// Writes the view's draws from what cull kept. The emit program must
+  /// already be bound.
+  /// </summary>
+  void emit(GLuint view);
+
+  /// <summary>
+  /// Draws the view's generated commands with the bound program. vao must
+  /// be bound and share the batch vertex format. The view's texture sets
+  /// are bound to storage binding 2 for gl_DrawID.
+  /// </summary>
+  void draw(GLuint view, const gl::Vao& vao);
+
+  /// <summary>
+  /// The most commands a view can hold, one per layer of every pose.
+  /// </summary>
+  inline GLuint maxDraws() const { return layerCount; }
+  inline size_t poseCount() const { return poses.size(); }
+  inline size_t instanceCount() const { return instances.size(); }
+  /// <summary>
+  /// Bytes the last upload staged for the cull inputs.
+  /// </summary>
+  inline GLuint uploadedBytes() const { return uploaded; }
+
+private:
+  struct Pose {
+    Job job;
+    std::span<const Layer> layers;
+    std::vector<engine::mesh::TextureHandleSet> textures = {};
+    /// Slot of the first instance on the pose, once uploaded
+    GLuint firstSlot = 0;
+    GLuint instanceCount = 0;
+  };
+
+  struct InstanceData {
+    uint32_t pose;
+    GLuint indexInPose;
+    GLuint mask;
+    glm::mat4 model = glm::mat4(1.0f);
+    float radius = 0.0f;
+    /// Transform or bounds not yet uploaded
+    bool dirty = true;
+  };
+
+  /// Match the std430 layouts in cull.comp.glsl and cull_emit.comp.glsl
+  struct CullInstance {
+    glm::vec4 sphere;
+    GLuint mask;
+    GLuint pad0 = 0;
+    GLuint pad1 = 0;
+    GLuint pad2 = 0;
+  };
+
+  struct CullPose {
+    GLuint firstSlot;
+    GLuint firstLayer;
+    GLuint layerCount;
+    GLuint outputStart;
+  };
+
+  /// Byte offsets of one view's output, relative to its section
+  struct ViewLayout {
+    GLuint commands = 0;
+    GLuint counters = 0;
+    GLuint transforms = 0;
+    GLuint textures = 0;
+    GLuint size = 0;
+  };
+
+  struct InputLayout {
+    GLuint instances = 0;
+    GLuint transforms = 0;
+    GLuint instancePoses = 0;
+    GLuint poses = 0;
+    GLuint layers = 0;
+    GLuint textures = 0;
+    GLuint size = 0;
+
+    bool operator==(const InputLayout&) const = default;
+  };
+
+  // Writes the runs of dirty instances
+  void uploadInstances(FrameRing& ring);
+  // Copies data into the input buffer through the ring
+  void stage(FrameRing& ring, const void* data, GLuint size, GLuint offset);
+
+  std::vector<Pose> poses;
+  std::vector<InstanceData> instances;
+  // (inputStart, clip, frame) to index into poses
+  std::map<std::tuple<GLuint, GLuint, GLuint>, uint32_t> lookup;
+
+  GLuint vertices = 0;
+  GLuint groups = 0;
+  GLuint slots = 0;
+  /// Instances added since begin
+  GLuint added = 0;
+  GLuint uploaded = 0;
+  GLuint layerCount = 0;
+  GLuint viewMask = 1;
+
+  constexpr static GLuint INSTANCE_SIZE = sizeof(CullInstance);
+  constexpr static GLuint POSE_SIZE = sizeof(CullPose);
+
+  std::vector<Job> jobs;
+
+  // Staging for one run of dirty instances
+  std::vector<CullInstance> cullInstances;
+  std::vector<PackedTransform> cullTransforms;
+
+  // This frame's tables, and what the input buffer currently holds
+  std::vector<GLuint> instancePoses;
+  std::vector<CullPose> cullPoses;
+  std::vector<Layer> cullLayers;
+  std::vector<engine::mesh::TextureHandleSet> cullTextures;
+  std::vector<GLuint> uploadedInstancePoses;
+  std::vector<CullPose> uploadedPoses;
+  std::vector<Layer> uploadedLayers;
+  std::vector<engine::mesh::TextureHandleSet> uploadedTextures;
+
+  InputLayout input;
+  /// GPU only, filled by copies out of the ring
+  gl::Buffer inputBuffer;
+  /// Set when the ring ran out of room, so the next upload starts over
+  bool stagingFailed = false;
+
+  ViewLayout viewLayout;
+  GLuint views = 0;
+  /// One flag per pose after every view's section, set by cull
+  GLuint visibleOffset = 0;
+  /// GPU only, written by the cull and emit passes
+  gl::Buffer outputBuffer;
+};
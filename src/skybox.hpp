@@ -16,8 +16,8 @@ public:
   Skybox& operator=(Skybox&&) noexcept = default;
 
   inline static std::expected<Skybox, std::string>
-  create(const gl::CubeMap& cubeMap) {
-    auto programOpt = gl::Program::fromFiles({
+  create(ProgramCache& programs, const gl::CubeMap& cubeMap) {
+    auto programOpt = programs.load({
         {SHADERDIR "fullscreen.vert.glsl", gl::Shader::Type::VERTEX},
         {SHADERDIR "postprocess/skybox.frag.glsl", gl::Shader::Type::FRAGMENT},
     });
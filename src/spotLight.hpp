@@ -1,5 +1,7 @@
 #pragma once
 
+#include "lightData.hpp"
+#include "shadowAtlas.hpp"
 #include <array>
 #include <engine/camera.hpp>
 #include <engine/frustum.hpp>
@@ -7,11 +9,11 @@
 #include <glm/glm.hpp>
 #include <glm\ext\matrix_clip_space.hpp>
 #include <glm\ext\matrix_transform.hpp>
+#include <optional>
+#include <span>
 
 class SpotLight {
 public:
-  constexpr static int32_t SHADOW_MAP_SIZE = 4096;
-
   struct LightUniform {
     glm::mat4 shadowMatrix;
     glm::vec3 position;
@@ -30,16 +32,25 @@ public:
 
   SpotLight(const glm::vec3& position, const glm::vec3& direction,
             const glm::vec4& color, float radius)
-      : m({position, radius, color, glm::normalize(direction)}) {
-    setupShadowMap();
-  }
+      : m({position, radius, color, glm::normalize(direction)}) {}
 
+  /// <summary>
+  /// Writes the light's entry in the frame's light buffer.
+  /// </summary>
   void writeInstanceData(const gl::MappingRef mapping) const {
-    mapping.write(&m, sizeof(InstanceData), 0);
+    LightData data = {
+        .sphere = glm::vec4(m.position, m.radius),
+        .color = m.color,
+        .direction = glm::vec4(m.direction, 1.0f),
+        .tileSize = tile.size,
+        .tiles = {tile.packed()},
+        .shadowMatrix = viewProj(),
+    };
+    mapping.write(&data, sizeof(LightData), 0);
   }
 
   constexpr static GLuint dataSize() {
-    return static_cast<GLuint>(sizeof(InstanceData));
+    return static_cast<GLuint>(sizeof(LightData));
   }
 
   const glm::vec3& position() const { return m.position; }
@@ -64,60 +75,118 @@ public:
     return translation * rotation * scale;
   }
 
-  void setupShadowMap() {
-    shadowMap.storage(1, GL_DEPTH_COMPONENT24,
-                      gl::Texture::Size{SHADOW_MAP_SIZE, SHADOW_MAP_SIZE});
-    shadowMap.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    shadowMap.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    shadowMapHandle = shadowMap.createHandle();
-
-    shadowFbo.attachTexture(GL_DEPTH_ATTACHMENT, shadowMap.id(), 0);
-    glNamedFramebufferDrawBuffer(shadowFbo.id(), GL_NONE);
-    glNamedFramebufferReadBuffer(shadowFbo.id(), GL_NONE);
-  }
-
-  void renderShadowMap(
-      std::function<void(const engine::Frustum&, const glm::vec3&)> renderFn,
-      const gl::Mapping& matrixMapping) const {
-
+  /// <summary>
+  /// The light's shadow map projection, which is also what its casters are
+  /// culled against.
+  /// </summary>
+  glm::mat4 viewProj() const {
     glm::mat4 perspective =
         glm::perspective(glm::radians(90.0f), 1.0f, m.radius, .1f);
-
-    shadowFbo.bind();
-    glClearDepth(0.0f);
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    LightUniform uniformData = {};
-    uniformData.position = m.position;
-    uniformData.radius = m.radius;
-
     glm::mat4 shadowView =
         glm::lookAt(m.position, m.position + m.direction,
                     abs(m.direction.y) == 1.0 ? glm::vec3(0.0, 0.0, -1.0)
                                               : glm::vec3(0.0, -1.0, 0.0));
+    return perspective * shadowView;
+  }
 
-    glm::mat4 shadowViewProj = perspective * shadowView;
-    uniformData.shadowMatrix = shadowViewProj;
-
-    matrixMapping.write(&uniformData, sizeof(LightUniform), 0);
+  /// <summary>
+  /// Sets where in the shadow atlas the light is drawn this frame.
+  /// </summary>
+  void setTiles(std::span<const ShadowAtlas::Tile> atlasTiles) {
+    auto next = atlasTiles.empty() ? ShadowAtlas::Tile{} : atlasTiles.front();
+    // Once moved, another light may draw over the old tile before it comes
+    // back, so nothing drawn before can be trusted
+    if (next != tile) {
+      drawn = false;
+    }
+    tile = next;
+  }
+  /// <summary>
+  /// Edge of the light's tiles in the atlas, 0 if it got no room and casts
+  /// no shadows.
+  /// </summary>
+  GLuint tileSize() const { return tile.size; }
+
+  /// <summary>
+  /// Whether the static tile was rendered from casters other than those
+  /// version describes (see SceneIndex::version), or the tile has moved
+  /// since.
+  /// </summary>
+  bool staticStale(uint64_t version) const {
+    return staticVersion != version || !drawn;
+  }
 
+  /// <summary>
+  /// Renders the casters that never move into the atlas's static texture,
+  /// which the light's tile is restored from each time it is redrawn.
+  /// </summary>
+  void renderStaticMap(
+      const ShadowAtlas& atlas,
+      std::function<void(const engine::Frustum&, const glm::mat4&)> renderFn,
+      const gl::MappingRef matrixMapping, uint64_t version) {
+    atlas.bindStatic();
+    atlas.clearStatic(tile);
+    useTile();
+
+    writeUniform(matrixMapping);
+    glm::mat4 shadowViewProj = viewProj();
     engine::Frustum shadowFrustum(shadowViewProj);
+    renderFn(shadowFrustum, shadowViewProj);
 
-    renderFn(shadowFrustum, m.position);
-    glMemoryBarrier(GL_UNIFORM_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT |
-                    GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    staticVersion = version;
+    drawn = true;
+    holdsStatic = false;
   }
 
-  const gl::Texture& getShadowMap() const { return shadowMap; }
-  const gl::TextureHandle& getShadowMapHandle() const {
-    return shadowMapHandle;
+  /// <summary>
+  /// Whether renderShadowMap has anything to do, given whether a dynamic
+  /// caster is in range. With none in range now or last time, the tile
+  /// already holds exactly the static casters.
+  /// </summary>
+  bool shadowStale(bool dynamic) const { return dynamic || !holdsStatic; }
+
+  /// <summary>
+  /// Restores the light's tile from the static texture, then renders the
+  /// dynamic casters over it if any are in range.
+  /// </summary>
+  void renderShadowMap(const ShadowAtlas& atlas, std::function<void()> renderFn,
+                       const gl::MappingRef matrixMapping, bool dynamic) {
+    atlas.restore(tile);
+    holdsStatic = !dynamic;
+    if (!dynamic) {
+      return;
+    }
+
+    atlas.bindLive();
+    useTile();
+    writeUniform(matrixMapping);
+    renderFn();
   }
 
 protected:
+  void writeUniform(const gl::MappingRef matrixMapping) const {
+    LightUniform uniformData = {};
+    uniformData.position = m.position;
+    uniformData.radius = m.radius;
+    uniformData.shadowMatrix = viewProj();
+
+    matrixMapping.write(&uniformData, sizeof(LightUniform), 0);
+  }
+
+  void useTile() const {
+    glViewport(static_cast<GLint>(tile.x), static_cast<GLint>(tile.y),
+               static_cast<GLsizei>(tile.size),
+               static_cast<GLsizei>(tile.size));
+  }
+
   InstanceData m;
 
-  gl::TextureHandle shadowMapHandle = 0;
-  gl::Texture shadowMap;
+  ShadowAtlas::Tile tile = {};
 
-  gl::Framebuffer shadowFbo = {};
+  // What the atlas's static texture holds for this light
+  std::optional<uint64_t> staticVersion = std::nullopt;
+  // Whether the tile was rendered since it last moved
+  bool drawn = false;
+  // Whether the live tile is a plain copy of the static one
+  bool holdsStatic = false;
 };
\ No newline at end of file
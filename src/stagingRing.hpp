@@ -0,0 +1,127 @@
+#pragma once
+
+#include <deque>
+#include <gl/gl.hpp>
+#include <optional>
+
+/// <summary>
+/// Persistently mapped upload buffer used as a ring. Every batch of uploads is
+/// guarded by a fence, and a region is only handed out again once the GPU has
+/// finished copying out of it.
+/// </summary>
+class StagingRing {
+public:
+  explicit StagingRing(GLuint size) : capacity(size) {
+    buffer.label("Staging Ring");
+    buffer.init(size, nullptr,
+                gl::Buffer::Usage::WRITE | gl::Buffer::Usage::PERSISTENT |
+                    gl::Buffer::Usage::COHERENT);
+    mapping = buffer.map(gl::Buffer::Mapping::WRITE |
+                         gl::Buffer::Mapping::PERSISTENT |
+                         gl::Buffer::Mapping::COHERENT);
+  }
+
+  StagingRing(const StagingRing&) = delete;
+  StagingRing& operator=(const StagingRing&) = delete;
+
+  ~StagingRing() {
+    for (auto& region : inFlight) {
+      glDeleteSync(region.fence);
+    }
+  }
+
+  /// <summary>
+  /// Reserves space in the ring and copies the data into it. Blocks if the
+  /// space is still being read by an earlier upload.
+  /// </summary>
+  /// <returns>The offset into the buffer, or nullopt if the data can never
+  /// fit in the ring</returns>
+  std::optional<GLuint> push(const void* data, GLuint size) {
+    if (size > capacity) {
+      return std::nullopt;
+    }
+
+    GLuint start = gl::Buffer::roundToAlignment(head, ALIGNMENT);
+    if (start + size > capacity) {
+      // Keep every fenced region contiguous so overlap tests stay simple
+      fence();
+      start = 0;
+    }
+
+    waitFor(start, start + size);
+
+    mapping.write(data, size, start);
+    if (!pendingStart) {
+      pendingStart = start;
+    }
+    head = start + size;
+
+    return start;
+  }
+
+  /// <summary>
+  /// Fences every push since the last call. Must be called after the GL
+  /// commands reading from the pushed regions have been issued.
+  /// </summary>
+  void fence() {
+    if (!pendingStart) {
+      return;
+    }
+
+    inFlight.push_back({*pendingStart, head,
+                        glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+    pendingStart = std::nullopt;
+  }
+
+  inline const gl::Buffer& getBuffer() const { return buffer; }
+
+  /// <summary>
+  /// Binds the ring as the pixel unpack buffer for texture uploads.
+  /// </summary>
+  void bindUnpack() const {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id());
+  }
+  static void unbindUnpack() { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+
+private:
+  // Enough for any texel format and for glCompressedTexSubImage block rows
+  constexpr static GLuint ALIGNMENT = 16;
+
+  struct Region {
+    GLuint start;
+    GLuint end;
+    GLsync fence;
+  };
+
+  // Fences signal in submission order, so waiting on the newest overlapping
+  // region retires everything before it as well
+  void waitFor(GLuint start, GLuint end) {
+    auto newest = inFlight.end();
+    for (auto it = inFlight.begin(); it != inFlight.end(); ++it) {
+      if (start < it->end && end > it->start) {
+        newest = it;
+      }
+    }
+
+    if (newest == inFlight.end()) {
+      return;
+    }
+
+    glClientWaitSync(newest->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                     GL_TIMEOUT_IGNORED);
+    ++newest;
+    for (auto it = inFlight.begin(); it != newest; ++it) {
+      glDeleteSync(it->fence);
+    }
+    inFlight.erase(inFlight.begin(), newest);
+  }
+
+  GLuint capacity;
+  GLuint head = 0;
+  std::optional<GLuint> pendingStart = std::nullopt;
+
+  gl::Buffer buffer;
+  gl::Mapping mapping;
+
+  std::deque<Region> inFlight;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "meshPack.hpp"
+#include "packedVertex.hpp"
+#include <gl/gl.hpp>
+
+/// <summary>
+/// Position only indexed mesh built from a MeshPack, used for the light
+/// volumes. Vertices keep the pack's PackedWeightedVertex stride so both
+/// sections are uploaded as they are.
+/// </summary>
+class StaticMesh {
+public:
+  StaticMesh() = default;
+
+  explicit StaticMesh(const MeshPack& pack)
+      : indexCount(pack.header().indexCount) {
+    auto vertices = pack.vertices();
+    auto indices = pack.indices();
+
+    GLuint indexOffset = gl::Buffer::roundToAlignment(
+        static_cast<GLuint>(vertices.size()), sizeof(uint32_t));
+    GLuint size = indexOffset + static_cast<GLuint>(indices.size());
+
+    buffer.init(size, nullptr, gl::Buffer::Usage::DYNAMIC);
+    glNamedBufferSubData(buffer.id(), 0, vertices.size(), vertices.data());
+    glNamedBufferSubData(buffer.id(), indexOffset, indices.size(),
+                         indices.data());
+
+    vao.attribFormat(0, 3, GL_FLOAT, GL_FALSE,
+                     offsetof(PackedWeightedVertex, position), 0);
+    vao.bindVertexBuffer(0, buffer.id(), 0, sizeof(PackedWeightedVertex));
+    vao.bindIndexBuffer(buffer.id());
+
+    firstIndex = indexOffset;
+  }
+
+  inline auto bindGuard() const { return vao.bindGuard(); }
+
+  void draw() const {
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT,
+                   reinterpret_cast<void*>(static_cast<uintptr_t>(firstIndex)));
+  }
+
+  /// <summary>
+  /// Draws count instances, with gl_BaseInstance set to firstInstance.
+  /// </summary>
+  void drawInstanced(GLuint firstInstance, GLsizei count) const {
+    glDrawElementsInstancedBaseInstance(
+        GL_TRIANGLES, indexCount, GL_UNSIGNED_INT,
+        reinterpret_cast<void*>(static_cast<uintptr_t>(firstIndex)), count,
+        firstInstance);
+  }
+
+private:
+  GLsizei indexCount = 0;
+  // Byte offset of the indices in buffer
+  GLuint firstIndex = 0;
+
+  gl::Buffer buffer;
+  gl::Vao vao;
+};
@@ -0,0 +1,314 @@
+#include "texturePack.hpp"
+
+#include "logger/logger.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+  uint64_t alignLevel(uint64_t offset) {
+    return (offset + TexturePack::LEVEL_ALIGNMENT - 1) /
+           TexturePack::LEVEL_ALIGNMENT * TexturePack::LEVEL_ALIGNMENT;
+  }
+
+  struct PixelFormat {
+    GLenum internalFormat;
+    GLenum format;
+  };
+
+  PixelFormat pixelFormat(int channels) {
+    if (channels == 1) {
+      return {GL_R8, GL_RED};
+    }
+    return {GL_RGBA8, GL_RGBA};
+  }
+
+  // Bakes the mip chain for one face and compresses every level, returning
+  // the block data for each level in order
+  std::expected<std::vector<std::vector<std::byte>>, std::string>
+  compressFace(GLenum format, int channels, const engine::Image& image,
+               GLsizei levels) {
+    auto size = image.getDimensions();
+    auto pixels = pixelFormat(channels);
+
+    gl::Texture source;
+    source.storage(levels, pixels.internalFormat, {size.x, size.y});
+    glTextureSubImage2D(source.id(), 0, 0, 0, size.x, size.y, pixels.format,
+                        GL_UNSIGNED_BYTE, image.getData());
+    glGenerateTextureMipmap(source.id());
+
+    // Handing uncompressed data to glTexImage2D with a compressed internal
+    // format has the driver do the encoding, which immutable storage does
+    // not allow
+    gl::Texture compressed;
+    glBindTexture(GL_TEXTURE_2D, compressed.id());
+
+    std::vector<std::vector<std::byte>> out;
+    std::vector<unsigned char> level;
+    for (GLint i = 0; i < levels; ++i) {
+      GLsizei width = std::max(size.x >> i, 1);
+      GLsizei height = std::max(size.y >> i, 1);
+
+      level.resize(static_cast<size_t>(width) * height * channels);
+      glGetTextureImage(source.id(), i, pixels.format, GL_UNSIGNED_BYTE,
+                        static_cast<GLsizei>(level.size()), level.data());
+
+      glTexImage2D(GL_TEXTURE_2D, i, static_cast<GLint>(format), width,
+                   height, 0, pixels.format, GL_UNSIGNED_BYTE, level.data());
+
+      GLint isCompressed = GL_FALSE;
+      GLint compressedSize = 0;
+      glGetTextureLevelParameteriv(compressed.id(), i, GL_TEXTURE_COMPRESSED,
+                                   &isCompressed);
+      glGetTextureLevelParameteriv(compressed.id(), i,
+                                   GL_TEXTURE_COMPRESSED_IMAGE_SIZE,
+                                   &compressedSize);
+      if (!isCompressed || compressedSize <= 0) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return std::unexpected(
+            fmt::format("Driver failed to compress level {} to format {:#x}",
+                        i, format));
+      }
+
+      auto& blocks = out.emplace_back(static_cast<size_t>(compressedSize));
+      glGetCompressedTextureImage(compressed.id(), i, compressedSize,
+                                  blocks.data());
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return out;
+  }
+} // namespace
+
+GLenum TexturePack::format(Role role) {
+  switch (role) {
+  case Role::NORMAL:
+    return GL_COMPRESSED_RG_RGTC2;
+  case Role::HEIGHT:
+    return GL_COMPRESSED_RED_RGTC1;
+  default:
+    return GL_COMPRESSED_RGBA_BPTC_UNORM;
+  }
+}
+
+int TexturePack::channels(Role role) {
+  // Two channel decoding gives grey and alpha rather than red and green, so
+  // normals are decoded as RGBA and BC5 keeps the first two
+  return role == Role::HEIGHT ? 1 : 4;
+}
+
+std::string TexturePack::pathFor(std::string_view source) {
+  return std::filesystem::path(source).replace_extension(".tpk").string();
+}
+
+std::expected<TexturePack, std::string>
+TexturePack::open(const std::string& path) {
+  auto fileRes = MappedFile::open(path);
+  if (!fileRes) {
+    return std::unexpected(fileRes.error());
+  }
+
+  TexturePack pack;
+  pack.file = std::move(*fileRes);
+  if (auto res = pack.bind(pack.file.bytes()); !res) {
+    return std::unexpected(fmt::format("{}: {}", path, res.error()));
+  }
+  return pack;
+}
+
+std::expected<TexturePack, std::string>
+TexturePack::fromBytes(std::vector<std::byte>&& bytes) {
+  TexturePack pack;
+  pack.owned = std::move(bytes);
+  if (auto res = pack.bind(pack.owned); !res) {
+    return std::unexpected(res.error());
+  }
+  return pack;
+}
+
+std::expected<std::vector<std::byte>, std::string>
+TexturePack::build(const Sources& sources) {
+  std::vector<engine::Image> images;
+  images.reserve(sources.faces.size());
+  for (const auto& face : sources.faces) {
+    auto image =
+        engine::Image::fromFile(face.path, face.flip, channels(sources.role));
+    if (!image) {
+      return std::unexpected(image.error());
+    }
+    images.push_back(std::move(*image));
+  }
+
+  std::vector<const engine::Image*> faces;
+  for (const auto& image : images) {
+    faces.push_back(&image);
+  }
+  return build(sources.role, faces);
+}
+
+std::expected<std::vector<std::byte>, std::string>
+TexturePack::build(Role role, std::span<const engine::Image* const> faces) {
+  if (faces.size() != 1 && faces.size() != 6) {
+    return std::unexpected(
+        fmt::format("Texture pack needs 1 or 6 faces, got {}", faces.size()));
+  }
+
+  auto size = faces.front()->getDimensions();
+  for (const auto* face : faces) {
+    if (face->getDimensions() != size) {
+      return std::unexpected("Cube map faces have mismatched dimensions");
+    }
+  }
+
+  Header header;
+  header.format = format(role);
+  header.role = role;
+  header.width = static_cast<uint32_t>(size.x);
+  header.height = static_cast<uint32_t>(size.y);
+  header.levels =
+      static_cast<uint32_t>(gl::Texture::calcMipLevels(size.x, size.y) + 1);
+  header.faces = static_cast<uint32_t>(faces.size());
+
+  glHint(GL_TEXTURE_COMPRESSION_HINT, GL_NICEST);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+  std::vector<std::vector<std::vector<std::byte>>> compressed;
+  for (const auto* face : faces) {
+    auto levels = compressFace(header.format, channels(role), *face,
+                               static_cast<GLsizei>(header.levels));
+    if (!levels) {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glPixelStorei(GL_PACK_ALIGNMENT, 4);
+      return std::unexpected(levels.error());
+    }
+    compressed.push_back(std::move(*levels));
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  std::vector<Level> table(header.levels * header.faces);
+  uint64_t offset = alignLevel(sizeof(Header) + table.size() * sizeof(Level));
+  for (uint32_t level = 0; level < header.levels; ++level) {
+    for (uint32_t face = 0; face < header.faces; ++face) {
+      auto& entry = table[level * header.faces + face];
+      entry.offset = offset;
+      entry.size = compressed[face][level].size();
+      entry.width = std::max(header.width >> level, 1u);
+      entry.height = std::max(header.height >> level, 1u);
+      offset = alignLevel(offset + entry.size);
+    }
+  }
+
+  std::vector<std::byte> bytes(offset);
+  std::memcpy(bytes.data(), &header, sizeof(Header));
+  std::memcpy(bytes.data() + sizeof(Header), table.data(),
+              table.size() * sizeof(Level));
+  for (uint32_t level = 0; level < header.levels; ++level) {
+    for (uint32_t face = 0; face < header.faces; ++face) {
+      const auto& entry = table[level * header.faces + face];
+      std::memcpy(bytes.data() + entry.offset, compressed[face][level].data(),
+                  entry.size);
+    }
+  }
+
+  return bytes;
+}
+
+std::expected<void, std::string>
+TexturePack::write(const std::string& path, std::span<const std::byte> bytes) {
+  // Write next to the target and swap it in, so a crash never leaves a
+  // truncated pack that looks up to date
+  auto tmp = path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return std::unexpected("Failed to open " + tmp + " for writing");
+    }
+    file.write(reinterpret_cast<const char*>(bytes.data()),
+               static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+      return std::unexpected("Failed to write " + tmp);
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return std::unexpected("Failed to replace " + path);
+  }
+  return {};
+}
+
+bool TexturePack::isUpToDate(const std::string& path,
+                             const Sources& sources) {
+  std::error_code ec;
+  auto packTime = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return false;
+  }
+
+  for (const auto& face : sources.faces) {
+    auto sourceTime = std::filesystem::last_write_time(face.path, ec);
+    if (ec || sourceTime > packTime) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t TexturePack::dataSize() const {
+  size_t size = 0;
+  for (uint32_t i = 0; i < hdr->levels * hdr->faces; ++i) {
+    size += table[i].size;
+  }
+  return size;
+}
+
+std::expected<void, std::string>
+TexturePack::bind(std::span<const std::byte> data) {
+  if (data.size() < sizeof(Header)) {
+    return std::unexpected("Texture pack is truncated");
+  }
+
+  auto header = reinterpret_cast<const Header*>(data.data());
+  if (header->magic != MAGIC) {
+    return std::unexpected("Not a texture pack");
+  }
+  if (header->version != VERSION) {
+    return std::unexpected(
+        fmt::format("Texture pack version {} is not supported (expected {})",
+                    header->version, VERSION));
+  }
+  if (header->faces != 1 && header->faces != 6) {
+    return std::unexpected(
+        fmt::format("Texture pack has {} faces", header->faces));
+  }
+  if (header->levels == 0 || header->levels > 32) {
+    return std::unexpected(
+        fmt::format("Texture pack has {} levels", header->levels));
+  }
+  if (header->format != format(header->role)) {
+    return std::unexpected("Texture pack format does not match its role");
+  }
+
+  uint64_t count = uint64_t(header->levels) * header->faces;
+  if (sizeof(Header) + count * sizeof(Level) > data.size()) {
+    return std::unexpected("Texture pack level table is truncated");
+  }
+
+  auto levels = reinterpret_cast<const Level*>(data.data() + sizeof(Header));
+  for (uint64_t i = 0; i < count; ++i) {
+    if (levels[i].offset + levels[i].size > data.size()) {
+      return std::unexpected("Texture pack level lies outside the file");
+    }
+  }
+
+  bytes = data;
+  hdr = header;
+  table = levels;
+  return {};
+}
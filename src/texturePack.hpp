@@ -0,0 +1,153 @@
+#pragma once
+
+#include "mappedFile.hpp"
+#include <array>
+#include <cstdint>
+#include <engine/image.hpp>
+#include <expected>
+#include <gl/gl.hpp>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Binary container holding a block compressed texture with its whole mip
+/// chain already baked, so at runtime each level is handed to
+/// glCompressedTextureSubImage* as it is and nothing is decoded or generated.
+///
+/// The block format is picked from the texture's role: BC7 for colour maps,
+/// BC5 for tangent space normal maps (the shader rebuilds z) and BC4 for
+/// single channel height maps. A pack holds either one face for a 2D texture
+/// or six for a cube map, in GL face order (+X, -X, +Y, -Y, +Z, -Z).
+///
+/// The header is followed by a table of levels * faces Level entries, indexed
+/// by level * faces + face, and then the block data. The file is native
+/// endian. Packs are produced offline by the texpack tool, or by the
+/// AssetLoader the first time a pack is missing or out of date.
+/// </summary>
+class TexturePack {
+public:
+  constexpr static std::array<char, 4> MAGIC = {'T', 'P', 'A', 'K'};
+  constexpr static uint32_t VERSION = 1;
+  // One block row of the widest format, and what the staging ring aligns to
+  constexpr static uint32_t LEVEL_ALIGNMENT = 16;
+
+  enum class Role : uint32_t {
+    /// BC7, RGBA
+    COLOR,
+    /// BC5, the x and y of a tangent space normal
+    NORMAL,
+    /// BC4, single channel
+    HEIGHT,
+  };
+
+  struct Level {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+  };
+
+  struct Header {
+    std::array<char, 4> magic = MAGIC;
+    uint32_t version = VERSION;
+    /// The GL compressed internal format of every level
+    uint32_t format = 0;
+    Role role = Role::COLOR;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 0;
+    /// 1 for a 2D texture, 6 for a cube map
+    uint32_t faces = 0;
+  };
+
+  struct Source {
+    std::string path;
+    bool flip = true;
+  };
+
+  struct Sources {
+    Role role = Role::COLOR;
+    /// One image, or six cube faces in GL face order
+    std::vector<Source> faces;
+  };
+
+  TexturePack(const TexturePack&) = delete;
+  TexturePack& operator=(const TexturePack&) = delete;
+  TexturePack(TexturePack&&) = default;
+  TexturePack& operator=(TexturePack&&) = default;
+
+  /// <summary>
+  /// Maps a pack from disk and validates its header and level table.
+  /// </summary>
+  static std::expected<TexturePack, std::string> open(const std::string& path);
+
+  /// <summary>
+  /// Wraps bytes returned by build, for when the pack could not be written
+  /// and read back.
+  /// </summary>
+  static std::expected<TexturePack, std::string>
+  fromBytes(std::vector<std::byte>&& bytes);
+
+  /// <summary>
+  /// Decodes the source images and compresses them into a pack. Needs a
+  /// current GL context.
+  /// </summary>
+  static std::expected<std::vector<std::byte>, std::string>
+  build(const Sources& sources);
+
+  /// <summary>
+  /// Compresses already decoded images into a pack. Every face must have the
+  /// same size and be decoded with channels(role) channels. The mip chain is
+  /// generated and each level compressed by the driver, then read back, so
+  /// this needs a current GL context.
+  /// </summary>
+  static std::expected<std::vector<std::byte>, std::string>
+  build(Role role, std::span<const engine::Image* const> faces);
+
+  static std::expected<void, std::string>
+  write(const std::string& path, std::span<const std::byte> bytes);
+
+  /// <summary>
+  /// Whether the pack at path exists and is at least as new as its sources.
+  /// </summary>
+  static bool isUpToDate(const std::string& path, const Sources& sources);
+
+  /// <summary>
+  /// Where the pack for a single image lives, next to the image with a .tpk
+  /// extension.
+  /// </summary>
+  static std::string pathFor(std::string_view source);
+
+  static GLenum format(Role role);
+  /// Channels to decode a source image with for the given role
+  static int channels(Role role);
+
+  inline const Header& header() const { return *hdr; }
+  inline const Level& level(uint32_t level, uint32_t face = 0) const {
+    return table[level * hdr->faces + face];
+  }
+  inline std::span<const std::byte> data(const Level& level) const {
+    return bytes.subspan(level.offset, level.size);
+  }
+  /// The whole mapped file, for touching its pages ahead of an upload
+  inline std::span<const std::byte> raw() const { return bytes; }
+
+  /// Bytes of block data across every level and face
+  size_t dataSize() const;
+
+private:
+  TexturePack() = default;
+
+  // Validates the header and points the accessors at data
+  std::expected<void, std::string> bind(std::span<const std::byte> data);
+
+  MappedFile file;
+  // Only used when the pack was just built and could not be reopened
+  std::vector<std::byte> owned;
+
+  std::span<const std::byte> bytes;
+  const Header* hdr = nullptr;
+  const Level* table = nullptr;
+};
@@ -0,0 +1,235 @@
+#include "textureResidency.hpp"
+
+#include <imgui/imgui.h>
+
+TextureResidency::~TextureResidency() {
+  for (auto& entry : entries) {
+    if (entry.resident) {
+      glMakeTextureHandleNonResidentARB(entry.handle);
+    }
+  }
+  for (auto& r : retired) {
+    glDeleteSync(r.fence);
+  }
+}
+
+std::expected<TextureResidency::Id, std::string>
+TextureResidency::add(const std::string& path,
+                      const TexturePack::Sources& sources, std::string label) {
+  auto pack = assets.openPack(path, sources);
+  if (!pack) {
+    return std::unexpected(pack.error());
+  }
+  if (pack->header().faces != 1) {
+    return std::unexpected(path + " is a cube map, not a 2D texture");
+  }
+
+  entries.push_back(Entry{.pack = std::move(*pack), .label = std::move(label)});
+  return static_cast<Id>(entries.size() - 1);
+}
+
+GLuint64 TextureResidency::handle(Id id) {
+  if (id == NONE) {
+    return 0;
+  }
+
+  auto& entry = entries[id];
+  entry.lastUsed = frame;
+
+  if (!entry.texture) {
+    // Something small now so the draw has a texture this frame, and the full
+    // chain once beginFrame has upload budget for it. The draw needs it even
+    // over the budget, and beginFrame evicts once others fall out of use
+    makeRoom(levelBytes(entry.pack, reducedLevel(entry.pack)), &entry);
+    load(entry, reducedLevel(entry.pack));
+    ++loads;
+    if (entry.baseLevel != 0) {
+      promotions.push_back(id);
+    }
+  } else if (!entry.resident) {
+    glMakeTextureHandleResidentARB(entry.handle);
+    entry.resident = true;
+  }
+
+  return entry.handle;
+}
+
+void TextureResidency::beginFrame() {
+  freeRetired();
+
+  size_t promotedBytes = 0;
+  while (!promotions.empty() && promotedBytes < promoteBytesPerFrame) {
+    auto& entry = entries[promotions.front()];
+    promotions.pop_front();
+
+    // Evicted (or already promoted) since it was queued
+    if (!entry.texture || entry.baseLevel == 0) {
+      continue;
+    }
+
+    auto full = levelBytes(entry.pack, 0);
+    if (!makeRoom(full - entry.bytes, &entry)) {
+      // Everything else is in use, so stay reduced rather than thrash
+      continue;
+    }
+
+    load(entry, 0);
+    promotedBytes += full;
+    ++promoted;
+  }
+
+  for (auto& entry : entries) {
+    if (entry.resident && entry.lastUsed + keepFrames < frame) {
+      glMakeTextureHandleNonResidentARB(entry.handle);
+      entry.resident = false;
+    }
+  }
+
+  makeRoom(0, nullptr);
+
+  ++frame;
+}
+
+void TextureResidency::load(Entry& entry, uint32_t baseLevel) {
+  if (entry.texture) {
+    retire(entry);
+  }
+
+  auto texture = assets.upload(entry.pack, baseLevel);
+  texture.label(entry.label.c_str());
+  // A handle freezes the sampler state, so it has to be set first
+  texture.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  texture.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  entry.handle = glGetTextureHandleARB(texture.id());
+  glMakeTextureHandleResidentARB(entry.handle);
+  entry.resident = true;
+  entry.texture = std::move(texture);
+  entry.baseLevel = baseLevel;
+  entry.bytes = levelBytes(entry.pack, baseLevel);
+  loadedBytes += entry.bytes;
+}
+
+void TextureResidency::evict(Entry& entry) {
+  // Only textures unused for keepFrames are evicted, long after any frame
+  // that sampled them has finished, so the storage can go straight away
+  if (entry.resident) {
+    glMakeTextureHandleNonResidentARB(entry.handle);
+  }
+  loadedBytes -= entry.bytes;
+  entry.texture = std::nullopt;
+  entry.handle = 0;
+  entry.resident = false;
+  entry.bytes = 0;
+  ++evictions;
+}
+
+void TextureResidency::retire(Entry& entry) {
+  // Frames already submitted may still sample a resident handle, so it stays
+  // resident until they finish
+  if (entry.resident) {
+    retired.push_back({std::move(*entry.texture), entry.handle,
+                       glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+  }
+  loadedBytes -= entry.bytes;
+  entry.texture = std::nullopt;
+  entry.handle = 0;
+  entry.resident = false;
+  entry.bytes = 0;
+}
+
+void TextureResidency::freeRetired() {
+  while (!retired.empty()) {
+    auto& r = retired.front();
+    if (glClientWaitSync(r.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      break;
+    }
+    glDeleteSync(r.fence);
+    glMakeTextureHandleNonResidentARB(r.handle);
+    retired.pop_front();
+  }
+}
+
+bool TextureResidency::makeRoom(size_t extra, const Entry* keep) {
+  while (loadedBytes + extra > budgetBytes) {
+    Entry* oldest = nullptr;
+    for (auto& entry : entries) {
+      if (&entry == keep || !entry.texture ||
+          entry.lastUsed + keepFrames >= frame) {
+        continue;
+      }
+      if (!oldest || entry.lastUsed < oldest->lastUsed) {
+        oldest = &entry;
+      }
+    }
+
+    if (!oldest) {
+      return false;
+    }
+    evict(*oldest);
+  }
+  return true;
+}
+
+uint32_t TextureResidency::reducedLevel(const TexturePack& pack) {
+  const auto& header = pack.header();
+  for (uint32_t i = 0; i < header.levels; ++i) {
+    const auto& level = pack.level(i);
+    if (level.width <= REDUCED_SIZE && level.height <= REDUCED_SIZE) {
+      return i;
+    }
+  }
+  return header.levels - 1;
+}
+
+size_t TextureResidency::levelBytes(const TexturePack& pack,
+                                    uint32_t baseLevel) {
+  size_t bytes = 0;
+  for (uint32_t i = baseLevel; i < pack.header().levels; ++i) {
+    bytes += pack.level(i).size;
+  }
+  return bytes;
+}
+
+TextureResidency::Stats TextureResidency::stats() const {
+  Stats s;
+  s.registered = static_cast<uint32_t>(entries.size());
+  s.loadedBytes = loadedBytes;
+  s.loads = loads;
+  s.promotions = promoted;
+  s.evictions = evictions;
+  for (const auto& entry : entries) {
+    if (entry.texture) {
+      ++s.loaded;
+      if (entry.baseLevel != 0) {
+        ++s.reduced;
+      }
+    }
+    if (entry.resident) {
+      ++s.resident;
+    }
+  }
+  return s;
+}
+
+void TextureResidency::debugUi() {
+  auto s = stats();
+
+  constexpr double MIB = 1024.0 * 1024.0;
+  int budgetMiB = static_cast<int>(budgetBytes / (1024 * 1024));
+  if (ImGui::SliderInt("Budget (MiB)", &budgetMiB, 1, 2048)) {
+    budgetBytes = static_cast<size_t>(budgetMiB) * 1024 * 1024;
+  }
+  int keep = static_cast<int>(keepFrames);
+  if (ImGui::SliderInt("Keep Frames", &keep,
+                       static_cast<int>(MIN_KEEP_FRAMES), 600)) {
+    keepFrames = static_cast<uint32_t>(keep);
+  }
+
+  ImGui::Text("%u / %u loaded (%u reduced), %u resident", s.loaded,
+              s.registered, s.reduced, s.resident);
+  ImGui::Text("%.2f / %.2f MiB", static_cast<double>(s.loadedBytes) / MIB,
+              static_cast<double>(budgetBytes) / MIB);
+  ImGui::Text("Loads: %u | Promotions: %u | Evictions: %u", s.loads,
+              s.promotions, s.evictions);
+}
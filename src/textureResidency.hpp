@@ -0,0 +1,147 @@
+#pragma once
+
+#include "assetLoader.hpp"
+#include "frameRing.hpp"
+#include "texturePack.hpp"
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <gl/gl.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Owns the bindless textures the batch pass draws with, and only keeps the
+/// ones draws are actually using in VRAM.
+///
+/// Textures are registered by their pack, which stays memory mapped, and
+/// nothing is uploaded until a draw first asks for a handle. That first
+/// upload only covers the mips at or below REDUCED_SIZE so it is cheap, and
+/// the full chain follows in a later beginFrame, a few textures per frame.
+///
+/// A texture whose handle has not been asked for in keepFrames frames has its
+/// handle made non-resident. When the textures held exceed the VRAM budget,
+/// the least recently used of those are freed entirely, and are uploaded
+/// again (reduced first) the next time a draw needs them.
+///
+/// Handles are asked for when instance data is written, before the GPU culls
+/// the draws, so an instance that is written but culled still keeps its
+/// textures. That is deliberate: which draws survive is only known on the
+/// GPU, and reading it back would stall.
+/// </summary>
+class TextureResidency {
+public:
+  using Id = uint32_t;
+  constexpr static Id NONE = ~0u;
+  /// Largest top level uploaded when a texture is first brought in
+  constexpr static uint32_t REDUCED_SIZE = 128;
+  /// Textures are evicted without a fence, so every frame in flight that
+  /// could have sampled one must be done by the time it goes
+  constexpr static uint32_t MIN_KEEP_FRAMES = FrameRing::FRAMES + 1;
+
+  struct Stats {
+    uint32_t registered = 0;
+    /// Holding storage, whether or not the handle is resident
+    uint32_t loaded = 0;
+    uint32_t resident = 0;
+    /// Loaded at reduced resolution, waiting to be promoted
+    uint32_t reduced = 0;
+    size_t loadedBytes = 0;
+
+    uint32_t loads = 0;
+    uint32_t promotions = 0;
+    uint32_t evictions = 0;
+  };
+
+  explicit TextureResidency(AssetLoader& assets) : assets(assets) {}
+
+  TextureResidency(const TextureResidency&) = delete;
+  TextureResidency& operator=(const TextureResidency&) = delete;
+
+  ~TextureResidency();
+
+  /// <summary>
+  /// Registers a single face texture pack, building it if it is missing or
+  /// stale. Nothing is uploaded until the first call to handle.
+  /// </summary>
+  std::expected<Id, std::string> add(const std::string& path,
+                                     const TexturePack::Sources& sources,
+                                     std::string label);
+
+  /// <summary>
+  /// Returns the handle to draw with this frame, uploading the texture at
+  /// reduced resolution or making it resident again as needed. Counts as a
+  /// use of the texture for eviction. Returns 0 for
+  /// NONE, which the shaders treat as no texture.
+  /// </summary>
+  GLuint64 handle(Id id);
+
+  /// <summary>
+  /// Call before any handle for the frame is requested. Promotes reduced
+  /// textures to full resolution, makes unused handles non-resident, evicts
+  /// under the budget and frees textures replaced in earlier frames once the
+  /// GPU is done with them.
+  /// </summary>
+  void beginFrame();
+
+  /// <summary>
+  /// Draws the budget controls and counters into the current ImGui window.
+  /// </summary>
+  void debugUi();
+
+  Stats stats() const;
+
+  /// Bytes of texture storage to stay under before evicting
+  size_t budgetBytes = 256ull * 1024 * 1024;
+  /// Frames without a reference before a handle is made non-resident, at
+  /// least MIN_KEEP_FRAMES
+  uint32_t keepFrames = 120;
+  /// Bytes of full resolution uploads to allow per frame
+  size_t promoteBytesPerFrame = 16ull * 1024 * 1024;
+
+private:
+  struct Entry {
+    TexturePack pack;
+    std::string label;
+
+    std::optional<gl::Texture> texture = std::nullopt;
+    GLuint64 handle = 0;
+    bool resident = false;
+    /// The pack level the texture's top level holds
+    uint32_t baseLevel = 0;
+    size_t bytes = 0;
+    uint64_t lastUsed = 0;
+  };
+
+  // A texture swapped out while earlier frames may still sample it
+  struct Retired {
+    gl::Texture texture;
+    GLuint64 handle;
+    GLsync fence;
+  };
+
+  void load(Entry& entry, uint32_t baseLevel);
+  void evict(Entry& entry);
+  void retire(Entry& entry);
+  // Evicts least recently used textures not referenced for keepFrames until
+  // extra more bytes fit in the budget, never touching keep. False if they
+  // still do not fit with nothing left to evict
+  bool makeRoom(size_t extra, const Entry* keep);
+  void freeRetired();
+
+  static uint32_t reducedLevel(const TexturePack& pack);
+  static size_t levelBytes(const TexturePack& pack, uint32_t baseLevel);
+
+  AssetLoader& assets;
+
+  std::vector<Entry> entries;
+  std::deque<Id> promotions;
+  std::deque<Retired> retired;
+
+  uint64_t frame = 0;
+  size_t loadedBytes = 0;
+  uint32_t loads = 0;
+  uint32_t promoted = 0;
+  uint32_t evictions = 0;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// <summary>
+/// Fixed size pool of worker threads that pull jobs from a shared FIFO queue.
+/// Workers never touch GL, anything that needs the context has to be handed
+/// back to the main thread through the returned future.
+/// </summary>
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t threadCount = defaultThreadCount()) {
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+      workers.emplace_back([this](std::stop_token stop) { work(stop); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template <typename F>
+  auto submit(F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+    using Result = std::invoke_result_t<std::decay_t<F>>;
+
+    std::packaged_task<Result()> task(std::forward<F>(fn));
+    auto future = task.get_future();
+    {
+      std::scoped_lock lock(mutex);
+      jobs.emplace(std::move(task));
+    }
+    cv.notify_one();
+
+    return future;
+  }
+
+  /// <summary>
+  /// Splits [0, count) into chunks of grain and calls fn(begin, end) for
+  /// each, on the workers and the calling thread at once. Returns when every
+  /// chunk is done. Chunks are claimed as threads come free, so the caller
+  /// never waits on a worker stuck behind a long job, it just takes more of
+  /// the chunks itself.
+  /// </summary>
+  template <typename F>
+  void parallelFor(size_t count, size_t grain, const F& fn) {
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks <= 1 || workers.empty()) {
+      if (count > 0) {
+        fn(size_t{0}, count);
+      }
+      return;
+    }
+
+    struct Progress {
+      std::atomic<size_t> next = 0;
+      std::atomic<size_t> done = 0;
+    };
+    // Owned by every helper as well, since one may only start once the
+    // chunks are long gone. fn is only ever touched after claiming a chunk
+    auto progress = std::make_shared<Progress>();
+    auto run = [progress, chunks, count, grain, fn = &fn]() {
+      for (size_t chunk = progress->next++; chunk < chunks;
+           chunk = progress->next++) {
+        size_t begin = chunk * grain;
+        (*fn)(begin, std::min(begin + grain, count));
+        if (++progress->done == chunks) {
+          progress->done.notify_all();
+        }
+      }
+    };
+
+    size_t helpers = std::min(workers.size(), chunks - 1);
+    {
+      std::scoped_lock lock(mutex);
+      for (size_t i = 0; i < helpers; ++i) {
+        jobs.emplace(run);
+      }
+    }
+    cv.notify_all();
+
+    run();
+    for (size_t done = progress->done; done < chunks;
+         done = progress->done) {
+      progress->done.wait(done);
+    }
+  }
+
+  inline size_t size() const { return workers.size(); }
+
+  /// <summary>
+  /// Leaves one core for the main thread, which is busy uploading whatever
+  /// the workers produce.
+  /// </summary>
+  static size_t defaultThreadCount() {
+    return std::max(2u, std::thread::hardware_concurrency()) - 1;
+  }
+
+private:
+  void work(std::stop_token stop) {
+    while (true) {
+      std::move_only_function<void()> job;
+      {
+        std::unique_lock lock(mutex);
+        if (!cv.wait(lock, stop, [this]() { return !jobs.empty(); })) {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable_any cv;
+  std::queue<std::move_only_function<void()>> jobs;
+
+  // Declared last so the workers are joined before the queue is destroyed
+  std::vector<std::jthread> workers;
+};
@@ -0,0 +1,127 @@
+#include "logger/logger.hpp"
+#include "sceneIndex.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <random>
+#include <vector>
+
+// Times frustum queries against a SceneIndex, and against testing every
+// sphere in turn the way Graph::BuildNodeLists walks its roots, for scenes
+// of 100 to 100k nodes.
+//
+//   cullbench [queries per size]
+//
+// Spheres are scattered through a cube about the size of the scene, and
+// the cameras are placed and aimed at random inside it.
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  constexpr float WORLD_SIZE = 5000.0f;
+
+  size_t linearQuery(const std::vector<glm::vec4>& spheres,
+                     const SceneIndex::Planes& planes,
+                     std::vector<uint32_t>& out) {
+    for (size_t i = 0; i < spheres.size(); ++i) {
+      const auto& s = spheres[i];
+      bool inside = true;
+      for (const auto& plane : planes) {
+        // Summed in the same order as SceneIndex, so both agree exactly
+        float d = (s.x * plane.x + s.y * plane.y) + (s.z * plane.z + plane.w);
+        if (d < -s.w) {
+          inside = false;
+          break;
+        }
+      }
+      if (inside) {
+        out.push_back(static_cast<uint32_t>(i));
+      }
+    }
+    return out.size();
+  }
+
+  double microseconds(Clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+  }
+} // namespace
+
+int main(int argc, char** argv) {
+  int queries = argc > 1 ? std::atoi(argv[1]) : 1000;
+  if (queries <= 0) {
+    Logger::error("Usage: cullbench [queries per size]");
+    return -1;
+  }
+
+  std::mt19937 rng(8502);
+  std::uniform_real_distribution<float> coord(0.0f, WORLD_SIZE);
+  std::uniform_real_distribution<float> radius(5.0f, 20.0f);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  glm::mat4 proj =
+      glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, WORLD_SIZE);
+  std::vector<SceneIndex::Planes> cameras;
+  for (int i = 0; i < queries; ++i) {
+    glm::vec3 eye(coord(rng), coord(rng), coord(rng));
+    glm::vec3 dir(unit(rng), unit(rng) * 0.5f, unit(rng));
+    glm::mat4 view = glm::lookAt(eye, eye + dir, glm::vec3(0.0f, 1.0f, 0.0f));
+    cameras.push_back(SceneIndex::planes(proj * view));
+  }
+
+  std::vector<uint32_t> visible;
+  for (size_t count : {100u, 1000u, 10000u, 100000u}) {
+    std::vector<glm::vec4> spheres;
+    SceneIndex index;
+    for (size_t i = 0; i < count; ++i) {
+      glm::vec4 s(coord(rng), coord(rng), coord(rng), radius(rng));
+      spheres.push_back(s);
+      index.insert(glm::vec3(s), s.w);
+    }
+
+    auto start = Clock::now();
+    index.refit();
+    double buildUs = microseconds(Clock::now() - start);
+
+    // A tenth of the scene moving a little each frame
+    start = Clock::now();
+    for (size_t i = 0; i < count; i += 10) {
+      spheres[i] += glm::vec4(unit(rng), 0.0f, unit(rng), 0.0f);
+      index.move(static_cast<uint32_t>(i), glm::vec3(spheres[i]),
+                 spheres[i].w);
+    }
+    index.refit();
+    double refitUs = microseconds(Clock::now() - start);
+
+    size_t linearVisible = 0;
+    start = Clock::now();
+    for (const auto& camera : cameras) {
+      visible.clear();
+      linearVisible += linearQuery(spheres, camera, visible);
+    }
+    double linearUs = microseconds(Clock::now() - start) / queries;
+
+    size_t indexVisible = 0;
+    start = Clock::now();
+    for (const auto& camera : cameras) {
+      visible.clear();
+      index.query(camera, visible);
+      indexVisible += visible.size();
+    }
+    double indexUs = microseconds(Clock::now() - start) / queries;
+
+    if (indexVisible != linearVisible) {
+      Logger::error("{} nodes: index found {} visible, linear found {}",
+                    count, indexVisible, linearVisible);
+      return -1;
+    }
+
+    Logger::info("{:>6} nodes: linear {:>9.2f} us, index {:>9.2f} us "
+                 "({:.1f}x), build {:.0f} us, refit {:.0f} us, "
+                 "{} visible on average",
+                 count, linearUs, indexUs, linearUs / indexUs, buildUs,
+                 refitUs, indexVisible / static_cast<size_t>(queries));
+  }
+
+  return 0;
+}
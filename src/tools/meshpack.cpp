@@ -0,0 +1,64 @@
+#include "logger/logger.hpp"
+#include "meshPack.hpp"
+#include <engine/app.hpp>
+
+// Converts a .msh (plus optional .anm and .mat) into a .mpk mesh pack.
+//
+//   meshpack <out.mpk> <mesh.msh> [animation.anm] [material.mat]
+//
+// The vertex, index and joint sections are produced by the engine's own mesh
+// writers, which upload through a GL buffer, so this opens a small window for
+// its context and closes it again once the pack is written.
+
+namespace {
+  class Converter : public engine::App {
+  public:
+    Converter() : engine::App(64, 64, "meshpack", true) {}
+
+    bool update(const engine::FrameInfo& frame) override {
+      (void)frame;
+      return false;
+    }
+    void render(const engine::FrameInfo& frame) override { (void)frame; }
+  };
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3 || argc > 5) {
+    Logger::error("Usage: meshpack <out.mpk> <mesh.msh> [animation.anm] "
+                  "[material.mat]");
+    return -1;
+  }
+
+  {
+    auto err = engine::loadPreInitEnginePlugins();
+    if (err.has_value()) {
+      Logger::error("Failed to load pre init engine plugins: {}", err.value());
+      return -1;
+    }
+  }
+
+  Converter context;
+  if (context.shouldBail()) {
+    Logger::error("Failed to create a GL context");
+    return -1;
+  }
+
+  std::string out = argv[1];
+  MeshPack::Sources sources = {argv[2], argc > 3 ? argv[3] : "",
+                               argc > 4 ? argv[4] : ""};
+
+  auto bytes = MeshPack::build(sources);
+  if (!bytes) {
+    Logger::error("Failed to convert {}: {}", sources.mesh, bytes.error());
+    return -1;
+  }
+
+  if (auto res = MeshPack::write(out, *bytes); !res) {
+    Logger::error("{}", res.error());
+    return -1;
+  }
+
+  Logger::info("Wrote {} ({} bytes)", out, bytes->size());
+  return 0;
+}
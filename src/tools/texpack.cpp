@@ -0,0 +1,103 @@
+#include "logger/logger.hpp"
+#include "texturePack.hpp"
+#include <engine/app.hpp>
+#include <optional>
+#include <string_view>
+
+// Compresses an image (or six cube map faces) into a .tpk texture pack with
+// its mip chain baked in.
+//
+//   texpack <out.tpk> <color|normal|height> [-f] <image> [[-f] <image> ...]
+//
+// -f flips the image that follows it vertically, matching how the renderer
+// loads it. Cube map faces are given in GL order: +X, -X, +Y, -Y, +Z, -Z.
+// The driver does the block compression, so like meshpack this opens a small
+// window for its context.
+
+namespace {
+  class Converter : public engine::App {
+  public:
+    Converter() : engine::App(64, 64, "texpack", true) {}
+
+    bool update(const engine::FrameInfo& frame) override {
+      (void)frame;
+      return false;
+    }
+    void render(const engine::FrameInfo& frame) override { (void)frame; }
+  };
+
+  std::optional<TexturePack::Role> parseRole(std::string_view role) {
+    if (role == "color") {
+      return TexturePack::Role::COLOR;
+    }
+    if (role == "normal") {
+      return TexturePack::Role::NORMAL;
+    }
+    if (role == "height") {
+      return TexturePack::Role::HEIGHT;
+    }
+    return std::nullopt;
+  }
+} // namespace
+
+int main(int argc, char** argv) {
+  constexpr auto USAGE = "Usage: texpack <out.tpk> <color|normal|height> [-f] "
+                         "<image> [[-f] <image> ...]";
+  if (argc < 4) {
+    Logger::error("{}", USAGE);
+    return -1;
+  }
+
+  auto role = parseRole(argv[2]);
+  if (!role) {
+    Logger::error("Unknown texture role {}. {}", argv[2], USAGE);
+    return -1;
+  }
+
+  TexturePack::Sources sources = {*role, {}};
+  bool flip = false;
+  for (int i = 3; i < argc; ++i) {
+    if (std::string_view(argv[i]) == "-f") {
+      flip = true;
+      continue;
+    }
+    sources.faces.push_back({argv[i], flip});
+    flip = false;
+  }
+
+  if (sources.faces.size() != 1 && sources.faces.size() != 6) {
+    Logger::error("Expected 1 image or 6 cube map faces, got {}",
+                  sources.faces.size());
+    return -1;
+  }
+
+  {
+    auto err = engine::loadPreInitEnginePlugins();
+    if (err.has_value()) {
+      Logger::error("Failed to load pre init engine plugins: {}", err.value());
+      return -1;
+    }
+  }
+
+  Converter context;
+  if (context.shouldBail()) {
+    Logger::error("Failed to create a GL context");
+    return -1;
+  }
+
+  std::string out = argv[1];
+  auto bytes = TexturePack::build(sources);
+  if (!bytes) {
+    Logger::error("Failed to convert {}: {}", sources.faces.front().path,
+                  bytes.error());
+    return -1;
+  }
+
+  if (auto res = TexturePack::write(out, *bytes); !res) {
+    Logger::error("{}", res.error());
+    return -1;
+  }
+
+  Logger::info("Wrote {} ({} bytes)", out, bytes->size());
+  return 0;
+}
@@ -1,15 +1,18 @@
 #pragma once
 
+#include "resourceCache.hpp"
 #include <engine/globals.hpp>
 #include <engine/scene_node.hpp>
 #include <gl/gl.hpp>
+#include <memory>
 
 class Water : public engine::scene::Node {
 public:
-  Water(float size, float yLevel, const gl::CubeMap& envMap)
+  Water(ResourceCache& resources, float size, float yLevel,
+        const gl::CubeMap& envMap)
       : engine::scene::Node({engine::scene::Node::RenderType::LIT, true}),
         size(size), yLevel(yLevel), envMap(envMap) {
-    auto waterProgOpt = gl::Program::fromFiles(
+    auto waterProgOpt = resources.program(
         {{SHADERDIR "water/vert.glsl", gl::Shader::Type::VERTEX},
          {SHADERDIR "water/frag.glsl", gl::Shader::Type::FRAGMENT}});
     if (!waterProgOpt) {
@@ -18,7 +21,7 @@ public:
     }
     waterProgram = std::move(*waterProgOpt);
 
-    auto waterDepthProgOpt = gl::Program::fromFiles(
+    auto waterDepthProgOpt = resources.program(
         {{SHADERDIR "water/shadow.vert.glsl", gl::Shader::Type::VERTEX},
          {SHADERDIR "lighting/depth_to_linear.frag.glsl",
           gl::Shader::Type::FRAGMENT}});
@@ -29,7 +32,7 @@ public:
     }
     waterDepthProgram = std::move(*waterDepthProgOpt);
 
-    auto waterDepthCubeProgOpt = gl::Program::fromFiles(
+    auto waterDepthCubeProgOpt = resources.program(
         {{SHADERDIR "water/shadow_cube.vert.glsl", gl::Shader::Type::VERTEX},
          {SHADERDIR "lighting/omni_shadow.geom.glsl",
           gl::Shader::Type::GEOMETRY},
@@ -42,28 +45,29 @@ public:
     }
     waterDepthCubeProgram = std::move(*waterDepthCubeProgOpt);
 
-    auto diffuseImgOpt = engine::Image::fromFile(TEXTUREDIR "water.tga", true);
-    if (!diffuseImgOpt) {
+    auto diffuseTexOpt = resources.texture(TEXTUREDIR "water.tga");
+    if (!diffuseTexOpt) {
       Logger::error("Failed to load water diffuse texture: {}",
-                    diffuseImgOpt.error());
+                    diffuseTexOpt.error());
       throw std::runtime_error("Failed to load water diffuse texture");
     }
-    diffuseMap = diffuseImgOpt->toTexture(-1);
-    diffuseMap.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    diffuseMap.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    diffuseMap.setParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
-    diffuseMap.setParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
-    diffuseMap.setParameter(GL_TEXTURE_MAX_ANISOTROPY, 16);
-
-    auto bumpImgOpt = engine::Image::fromFile(TEXTUREDIR "waterbump.png", true);
-    if (!bumpImgOpt) {
+    diffuseMap = std::move(*diffuseTexOpt);
+    diffuseMap->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    diffuseMap->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    diffuseMap->setParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+    diffuseMap->setParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+    diffuseMap->setParameter(GL_TEXTURE_MAX_ANISOTROPY, 16);
+
+    auto bumpTexOpt = resources.texture(TEXTUREDIR "waterbump.png",
+                                        {true, TexturePack::Role::NORMAL});
+    if (!bumpTexOpt) {
       Logger::error("Failed to load water bump texture: {}",
-                    bumpImgOpt.error());
+                    bumpTexOpt.error());
       throw std::runtime_error("Failed to load water bump texture");
     }
-    bumpMap = bumpImgOpt->toTexture();
-    bumpMap.setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    bumpMap.setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    bumpMap = std::move(*bumpTexOpt);
+    bumpMap->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    bumpMap->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     SetBoundingRadius(size);
     glm::mat4 transform = glm::mat4(1.0f);
@@ -74,9 +78,9 @@ public:
   void update(const engine::FrameInfo& frame) override { (void)frame; }
   void render(const engine::Frustum& frustum) override {
     auto bg = engine::globals::DUMMY_VAO.bindGuard();
-    waterProgram.bind();
-    diffuseMap.bind(0);
-    bumpMap.bind(1);
+    waterProgram->bind();
+    diffuseMap->bind(0);
+    bumpMap->bind(1);
 
     glUniform1f(0, size);
     glUniform1f(1, yLevel);
@@ -88,7 +92,7 @@ public:
 
   void renderDepthOnly(const engine::Frustum& frustum) override {
     auto bg = engine::globals::DUMMY_VAO.bindGuard();
-    waterDepthProgram.bind();
+    waterDepthProgram->bind();
     glUniform1f(1, yLevel);
     glUniform1f(2, 10.f);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -97,7 +101,7 @@ public:
 
   void renderDepthOnlyCube() override {
     auto bg = engine::globals::DUMMY_VAO.bindGuard();
-    waterDepthCubeProgram.bind();
+    waterDepthCubeProgram->bind();
 
     glUniform1f(1, yLevel);
     glUniform1f(2, 10.f);
@@ -110,11 +114,11 @@ private:
   float size;
   float yLevel;
 
-  gl::Program waterProgram;
-  gl::Program waterDepthProgram;
-  gl::Program waterDepthCubeProgram;
+  std::shared_ptr<gl::Program> waterProgram;
+  std::shared_ptr<gl::Program> waterDepthProgram;
+  std::shared_ptr<gl::Program> waterDepthCubeProgram;
 
-  gl::Texture diffuseMap;
-  gl::Texture bumpMap;
+  std::shared_ptr<gl::Texture> diffuseMap;
+  std::shared_ptr<gl::Texture> bumpMap;
   const gl::CubeMap& envMap;
 };
\ No newline at end of file